@@ -0,0 +1,234 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "lox/errorhandler.h"
+#include "lox/scanner.h"
+#include "lox/parser.h"
+#include "lox/resolver.h"
+#include "lox/interpreter.h"
+#include "lox/printhandler.h"
+
+
+// ----------------------------------------------------------------------------
+// allocation counting
+// every operator new in the process goes through here so each workload can
+// report allocations per operation alongside the timing
+
+namespace
+{
+    std::size_t allocation_count = 0;
+}
+
+void* operator new(std::size_t size)
+{
+    allocation_count += 1;
+    if(void* ptr = std::malloc(size)) { return ptr; }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+
+// ----------------------------------------------------------------------------
+
+
+namespace
+{
+
+
+struct IgnoreErrors : lox::PrintHandler
+{
+    void
+    on_line(std::string_view) override
+    {
+    }
+};
+
+
+struct BenchResult
+{
+    double ns_per_op;
+    double allocations_per_op;
+};
+
+
+template<typename Fun>
+BenchResult
+run_bench(std::size_t operations, Fun&& fun)
+{
+    // warmup, also makes sure lazy state (symbol tables, caches) is primed
+    // before we start counting
+    fun();
+
+    const auto allocations_before = allocation_count;
+    const auto time_before = std::chrono::steady_clock::now();
+    for(std::size_t op = 0; op < operations; op += 1)
+    {
+        fun();
+    }
+    const auto time_after = std::chrono::steady_clock::now();
+    const auto allocations_after = allocation_count;
+
+    const auto total_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time_after - time_before).count();
+    return
+    {
+        static_cast<double>(total_ns) / static_cast<double>(operations),
+        static_cast<double>(allocations_after - allocations_before) / static_cast<double>(operations)
+    };
+}
+
+
+void
+report(std::string_view name, const BenchResult& result)
+{
+    std::cout << fmt::format
+    (
+        "{:<24} {:>14.0f} ns/op {:>12.1f} allocs/op\n",
+        name, result.ns_per_op, result.allocations_per_op
+    );
+}
+
+
+// a large source to give the scanner, parser and resolver something to
+// chew on: many small functions and classes with distinct names
+std::string
+make_large_source()
+{
+    std::string source;
+    for(int index = 0; index < 200; index += 1)
+    {
+        source += fmt::format
+        (
+            R"lox(
+            fun add_{0}(a, b)
+            {{
+                var result = a + b;
+                return result;
+            }}
+
+            class Thing{0}
+            {{
+                var val;
+                fun init(v) {{ this.val = v; }}
+                fun get() {{ return this.val; }}
+            }}
+            )lox",
+            index
+        );
+    }
+    return source;
+}
+
+
+constexpr std::string_view fib_source = R"lox(
+    fun fib(n)
+    {
+        if(n < 2) { return n; }
+        return fib(n - 1) + fib(n - 2);
+    }
+    fib(15);
+)lox";
+
+constexpr std::string_view loop_source = R"lox(
+    var sum = 0;
+    for(var i = 0; i < 20000; i += 1)
+    {
+        sum += i;
+    }
+)lox";
+
+constexpr std::string_view oop_source = R"lox(
+    class Counter
+    {
+        var count;
+        fun init() { this.count = 0; }
+        fun bump() { this.count += 1; }
+        fun get() { return this.count; }
+    }
+
+    var counter = new Counter();
+    for(var i = 0; i < 5000; i += 1)
+    {
+        counter.bump();
+    }
+    counter.get();
+)lox";
+
+constexpr std::string_view string_source = R"lox(
+    var text = "";
+    for(var i = 0; i < 500; i += 1)
+    {
+        text = text + "more text";
+    }
+)lox";
+
+
+void
+bench_interpret(std::string_view name, std::string_view source, std::size_t operations)
+{
+    auto errors = IgnoreErrors{};
+    auto interpreter = lox::make_interpreter(&errors, [](const std::string&){});
+
+    auto tokens = lox::scan_tokens(source, interpreter->get_error_handler());
+    auto program = lox::parse_program(tokens.tokens, interpreter->get_error_handler());
+    auto resolved = lox::resolve(*program.program, interpreter->get_error_handler());
+    if(tokens.errors > 0 || program.errors > 0 || resolved.has_value() == false)
+    {
+        std::cerr << "benchmark source failed to compile: " << name << "\n";
+        return;
+    }
+
+    report(name, run_bench(operations, [&]
+    {
+        interpreter->interpret(program.program, *resolved);
+    }));
+}
+
+
+}
+
+
+int
+main()
+{
+    auto errors = IgnoreErrors{};
+    const auto large_source = make_large_source();
+
+    report("scan_tokens", run_bench(50, [&]
+    {
+        lox::scan_tokens(large_source, &errors);
+    }));
+
+    auto tokens = lox::scan_tokens(large_source, &errors);
+    report("parse_program", run_bench(50, [&]
+    {
+        lox::parse_program(tokens.tokens, &errors);
+    }));
+
+    auto program = lox::parse_program(tokens.tokens, &errors);
+    report("resolve", run_bench(50, [&]
+    {
+        lox::resolve(*program.program, &errors);
+    }));
+
+    bench_interpret("interpret fib", fib_source, 10);
+    bench_interpret("interpret loops", loop_source, 10);
+    bench_interpret("interpret oop", oop_source, 10);
+    bench_interpret("interpret strings", string_source, 10);
+
+    return 0;
+}
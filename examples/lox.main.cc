@@ -108,7 +108,7 @@ struct InterpreterRunner : CodeRunner
             return RunError::syntax_error;
         }
 
-        const auto interpret_ok = interpreter->interpret(*program.program, *resolved);
+        const auto interpret_ok = interpreter->interpret(program.program, *resolved);
         if(interpret_ok)
         {
             return RunError::no_error;
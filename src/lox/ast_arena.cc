@@ -0,0 +1,46 @@
+#include "lox/ast_arena.h"
+
+#include <cassert>
+
+
+namespace
+{
+    constexpr std::size_t block_size = 64 * 1024;
+}
+
+
+namespace lox
+{
+
+
+AstArena::~AstArena()
+{
+    // destroy in reverse allocation order so children outlive their parents
+    for(auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+    {
+        it->destroy(it->node);
+    }
+}
+
+
+void*
+AstArena::allocate(std::size_t size, std::size_t alignment)
+{
+    assert(size <= block_size);
+
+    const auto aligned_used = (block_used + alignment - 1) & ~(alignment - 1);
+    if(blocks.empty() || aligned_used + size > block_capacity)
+    {
+        blocks.emplace_back(std::make_unique<char[]>(block_size));
+        block_capacity = block_size;
+        block_used = 0;
+        return allocate(size, alignment);
+    }
+
+    void* memory = blocks.back().get() + aligned_used;
+    block_used = aligned_used + size;
+    return memory;
+}
+
+
+}
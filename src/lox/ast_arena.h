@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+namespace lox
+{
+
+// bump allocator for ast nodes, owned by the Program they belong to
+// nodes are allocated contiguously in parse order and are only destroyed
+// when the arena itself goes away, so the tree is freed in one shot
+// instead of one heap free per node
+struct AstArena
+{
+    AstArena() = default;
+    ~AstArena();
+
+    AstArena(const AstArena&) = delete;
+    void operator=(const AstArena&) = delete;
+    AstArena(AstArena&&) = delete;
+    void operator=(AstArena&&) = delete;
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        void* memory = allocate(sizeof(T), alignof(T));
+        T* node = new (memory) T(std::forward<Args>(args)...);
+        destructors.emplace_back(Destructor{node, [](void* x) { static_cast<T*>(x)->~T(); }});
+        return node;
+    }
+
+private:
+    struct Destructor
+    {
+        void* node;
+        void (*destroy)(void*);
+    };
+
+    void* allocate(std::size_t size, std::size_t alignment);
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::size_t block_capacity = 0;
+    std::size_t block_used = 0;
+    std::vector<Destructor> destructors;
+};
+
+}
@@ -1,6 +1,13 @@
 #pragma once
 
 
+// compile time switch for the hot path tracing hooks in trace.h; off by
+// default so every hook compiles to nothing, build with
+// -DLOX_ENABLE_TRACING=1 to record events into the trace ring buffer
+#ifndef LOX_ENABLE_TRACING
+#define LOX_ENABLE_TRACING 0
+#endif
+
 
 namespace lox
 {
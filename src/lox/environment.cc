@@ -1,5 +1,7 @@
 #include "lox/environment.h"
 
+#include "lox/trace.h"
+
 
 namespace lox
 {
@@ -8,37 +10,89 @@ namespace lox
 Environment::Environment(std::shared_ptr<Environment> parent)
     : enclosing(parent)
 {
+    LOX_TRACE(environment_created);
+    count_environment_created();
+}
+
+
+Environment::~Environment()
+{
+    count_environment_destroyed();
+}
+
+
+bool
+Environment::is_global() const
+{
+    return enclosing == nullptr;
 }
 
 
 void
-Environment::define(const std::string& name, std::shared_ptr<Object> value)
+Environment::define(const std::string& name, const Value& value, bool boxed)
 {
-    values[name] = value;
+    if(is_global())
+    {
+        values[name] = value;
+    }
+    else
+    {
+        // runtime definition order matches the declaration order the resolver
+        // used when assigning slots, so the next free slot is the right one
+        slots.emplace_back(boxed ? Value{} : value);
+        slot_names.emplace_back(name);
+
+        // most locals are never captured, cells stays empty (and costs no
+        // allocation) until one is; boxed locals live in their cell and the
+        // slot entry is just a placeholder
+        if(boxed)
+        {
+            cells.resize(slots.size() - 1);
+            cells.emplace_back(std::make_shared<Value>(value));
+        }
+    }
 }
 
+void
+Environment::clear_locals()
+{
+    assert(is_global() == false);
+    slots.clear();
+    slot_names.clear();
+    cells.clear();
+}
+
+
 // todo(Gustav): provide a list of all variables with their location so we
 // can edit-distance search for potentiall misspelled vars when a miss occurs
 
-std::shared_ptr<Object>
+std::optional<Value>
 Environment::get_or_null(const std::string& name)
 {
-    auto found = values.find(name);
-    if(found != values.end())
+    if(is_global())
     {
-        return found->second;
-    }
-    else
-    {
-        if(enclosing != nullptr)
+        auto found = values.find(name);
+        if(found != values.end())
         {
-            return enclosing->get_or_null(name);
+            return found->second;
         }
-        else
+
+        return std::nullopt;
+    }
+
+    for(std::size_t slot_index = slot_names.size(); slot_index > 0; slot_index -= 1)
+    {
+        if(slot_names[slot_index - 1] == name)
         {
-            return nullptr;
+            if(slot_index - 1 < cells.size() && cells[slot_index - 1] != nullptr)
+            {
+                return *cells[slot_index - 1];
+            }
+            return slots[slot_index - 1];
         }
     }
+
+    return enclosing->get_or_null(name);
 }
 
 
@@ -46,7 +100,7 @@ Environment*
 get_ancestor_or_null(Environment* e, std::size_t dist)
 {
     Environment* env = e;
-    
+
     for(std::size_t count_to_dist = 0; count_to_dist < dist; count_to_dist += 1)
     {
         env = env->enclosing.get();
@@ -56,52 +110,88 @@ get_ancestor_or_null(Environment* e, std::size_t dist)
 }
 
 
-std::shared_ptr<Object>
-Environment::get_at_or_null(std::size_t distance, const std::string& name)
+std::optional<Value>
+Environment::get_at_or_null(std::size_t distance, std::size_t slot)
 {
     Environment* ancestor = get_ancestor_or_null(this, distance);
     assert(ancestor != nullptr);
-    auto found = ancestor->values.find(name);
-    if(found != ancestor->values.end())
+
+    if(slot < ancestor->slots.size())
     {
-        return found->second;
+        if(slot < ancestor->cells.size() && ancestor->cells[slot] != nullptr)
+        {
+            return *ancestor->cells[slot];
+        }
+        return ancestor->slots[slot];
     }
     else
     {
-        return nullptr;
+        return std::nullopt;
     }
 }
 
 
+std::shared_ptr<Value>
+Environment::get_cell_at(std::size_t distance, std::size_t slot)
+{
+    Environment* ancestor = get_ancestor_or_null(this, distance);
+    assert(ancestor != nullptr);
+    assert(slot < ancestor->cells.size());
+    assert(ancestor->cells[slot] != nullptr);
+
+    return ancestor->cells[slot];
+}
+
+
 bool
-Environment::set_or_false(const std::string& name, std::shared_ptr<Object> value)
+Environment::set_or_false(const std::string& name, const Value& value)
 {
-    auto found = values.find(name);
-    if(found == values.end())
+    if(is_global())
     {
-        if(enclosing != nullptr)
+        auto found = values.find(name);
+        if(found == values.end())
         {
-            return enclosing->set_or_false(name, value);
+            return false;
         }
-        else
+        found->second = value;
+        return true;
+    }
+
+    for(std::size_t slot_index = slot_names.size(); slot_index > 0; slot_index -= 1)
+    {
+        if(slot_names[slot_index - 1] == name)
         {
-            return false;
+            if(slot_index - 1 < cells.size() && cells[slot_index - 1] != nullptr)
+            {
+                *cells[slot_index - 1] = value;
+            }
+            else
+            {
+                slots[slot_index - 1] = value;
+            }
+            return true;
         }
     }
-    found->second = value;
-    return true;
+
+    return enclosing->set_or_false(name, value);
 }
 
 bool
-Environment::set_at_or_false(std::size_t distance, const std::string& name, std::shared_ptr<Object> value)
+Environment::set_at_or_false(std::size_t distance, std::size_t slot, const Value& value)
 {
     Environment* ancestor = get_ancestor_or_null(this, distance);
     assert(ancestor != nullptr);
 
-    auto found = ancestor->values.find(name);
-    if(found != ancestor->values.end())
+    if(slot < ancestor->slots.size())
     {
-        found->second = value;
+        if(slot < ancestor->cells.size() && ancestor->cells[slot] != nullptr)
+        {
+            *ancestor->cells[slot] = value;
+        }
+        else
+        {
+            ancestor->slots[slot] = value;
+        }
         return true;
     }
     else
@@ -111,4 +201,3 @@ Environment::set_at_or_false(std::size_t distance, const std::string& name, std:
 }
 
 }
-
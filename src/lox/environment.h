@@ -1,10 +1,13 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "lox/object.h"
+#include "lox/value.h"
 
 
 namespace lox
@@ -16,15 +19,37 @@ struct ErrorHandler;
 struct Environment
 {
     std::shared_ptr<Environment> enclosing;
-    std::unordered_map<std::string, std::shared_ptr<Object>> values;
+
+    // string keyed storage, only used by the global environment where
+    // natives are registered by name
+    std::unordered_map<std::string, Value> values;
+
+    // locals live in a dense vector, the resolver assigns each declared
+    // variable a slot so resolved reads and writes are two array indexings
+    std::vector<Value> slots;
+    std::vector<std::string> slot_names;
+
+    // captured locals are boxed so closures share the cell instead of
+    // retaining this environment; indexed like slots but only grown when
+    // something is actually captured, null entries are plain locals
+    std::vector<std::shared_ptr<Value>> cells;
 
     explicit Environment(std::shared_ptr<Environment> parent);
+    ~Environment();
+
+    bool is_global() const;
+
+    void define(const std::string& name, const Value& value, bool boxed = false);
+
+    // forget all locals so the environment can be reused for another loop
+    // iteration instead of allocating a fresh one; keeps the slot capacity
+    void clear_locals();
 
-    void define(const std::string& name, std::shared_ptr<Object> value);
-    std::shared_ptr<Object> get_or_null(const std::string& name);
-    std::shared_ptr<Object> get_at_or_null(std::size_t distance, const std::string& name);
-    bool set_at_or_false(std::size_t distance, const std::string& name, std::shared_ptr<Object> value);
-    bool set_or_false(const std::string& name, std::shared_ptr<Object> value);
+    std::optional<Value> get_or_null(const std::string& name);
+    std::optional<Value> get_at_or_null(std::size_t distance, std::size_t slot);
+    std::shared_ptr<Value> get_cell_at(std::size_t distance, std::size_t slot);
+    bool set_at_or_false(std::size_t distance, std::size_t slot, const Value& value);
+    bool set_or_false(const std::string& name, const Value& value);
 };
 
 }
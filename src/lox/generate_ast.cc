@@ -15,7 +15,15 @@ using namespace fmt::literals;
 
 
 struct Var { std::string type; std::string name; };
-struct Sub { std::string name; std::vector<Var> members;};
+struct Sub
+{
+    Sub(std::string n, std::vector<Var> m, std::vector<std::string> e = {})
+        : name(std::move(n)), members(std::move(m)), extra_members(std::move(e)) {}
+
+    std::string name;
+    std::vector<Var> members;
+    std::vector<std::string> extra_members;
+};
 struct Vis { std::string name; std::string type; };
 
 constexpr std::string_view INDENT = "    ";
@@ -38,6 +46,14 @@ is_value_type(const std::string& type)
         ;
 }
 
+// ast node types are arena allocated and referenced by raw pointer,
+// everything else (including runtime Object literals) is held by value
+bool
+is_node_type(const std::string& type)
+{
+    return is_value_type(type) == false && type != "Object";
+}
+
 char ascii_to_lower(char in)
 {
     if (in <= 'Z' && in >= 'A')
@@ -90,7 +106,10 @@ define_type
         
         header << ",\n";
         source << ",\n";
-        const std::string type = is_value_type(m.type) ? m.type : fmt::format("std::shared_ptr<{}>&&", m.type);
+        const std::string type
+            = is_value_type(m.type) ? m.type
+            : is_node_type(m.type) ? fmt::format("{}*", m.type)
+            : fmt::format("std::shared_ptr<{}>&&", m.type);
         header << INDENT << INDENT << type << " " << m.name;
         source << INDENT << type << " " << "a" << m.name;
     } header << "\n"; source << "\n";
@@ -98,7 +117,9 @@ define_type
     header << "\n";
 
     source << ")\n";
-    source << INDENT << ':' << " " << base_name << "(the_offset, the_id)\n";
+    source << INDENT << ':' << " " << base_name << "("
+        << base_name << "Type::" << to_lower(sub.name) << "_" << to_lower(base_name)
+        << ", the_offset, the_id)\n";
     for(const auto& m: sub.members)
     {
         source << INDENT << ',' << " " << m.name << "(a" << m.name << ")\n";
@@ -109,17 +130,16 @@ define_type
 
     for(const auto& m: sub.members)
     {
-        const std::string type = is_value_type(m.type) ? m.type : fmt::format("std::shared_ptr<{}>", m.type);
+        const std::string type
+            = is_value_type(m.type) ? m.type
+            : is_node_type(m.type) ? fmt::format("{}*", m.type)
+            : fmt::format("std::shared_ptr<{}>", m.type);
         header << INDENT << type << " " << m.name << ";\n";
     }
-
-    header << "\n";
-    header << INDENT << base_name << "Type get_type() const override;\n";
-    source << base_name << "Type " << sub.name << base_name << "::get_type() const\n";
-    source << "{\n";
-    source << INDENT << "return " << base_name << "Type::" << to_lower(sub.name) << "_" << to_lower(base_name) << ";\n";
-    source << "}\n";
-    source << "\n\n";
+    for(const auto& extra: sub.extra_members)
+    {
+        header << INDENT << extra << "\n";
+    }
 
     // header << "\n";
     for(const auto& v: visitors)
@@ -136,6 +156,52 @@ define_type
 
     header << "};\n";
     header << "\n\n";
+
+    // arena aware factory so the parser allocates nodes without
+    // spelling out the arena plumbing at every call site
+    const auto factory_name = fmt::format("make_{}_{}", to_lower(sub.name), to_lower(base_name));
+    const auto emit_factory_signature = [&](std::ostream& out, const std::string& indent)
+    {
+        out << sub.name << base_name << "*\n";
+        out << factory_name << "\n";
+        out << "(\n";
+        out << indent << "AstArena& arena,\n";
+        out << indent << "const Offset& offset,\n";
+        out << indent << "const " << base_name << "Id& id";
+        for(const auto& m: sub.members)
+        {
+            out << ",\n";
+            const std::string type
+                = is_value_type(m.type) ? m.type
+                : is_node_type(m.type) ? fmt::format("{}*", m.type)
+                : fmt::format("std::shared_ptr<{}>", m.type);
+            out << indent << type << " " << m.name;
+        }
+        out << "\n";
+        out << ")";
+    };
+    emit_factory_signature(header, std::string(INDENT));
+    header << ";\n";
+    header << "\n\n";
+
+    emit_factory_signature(source, std::string(INDENT));
+    source << "\n";
+    source << "{\n";
+    source << INDENT << "return arena.make<" << sub.name << base_name << ">(offset, id";
+    for(const auto& m: sub.members)
+    {
+        if(is_node_type(m.type))
+        {
+            source << ", " << m.name;
+        }
+        else
+        {
+            source << ", std::move(" << m.name << ")";
+        }
+    }
+    source << ");\n";
+    source << "}\n";
+    source << "\n\n";
 }
 
 
@@ -196,20 +262,34 @@ define_ast
 
     source << "//////////////////////////////////////////////////////////////\n";
     source << "// " << base_name << " \n\n";
-    source << base_name << "::" << base_name << "(const Offset& o, const " << base_name << "Id& i) : offset(o), uid(i) {}\n";
+    source << base_name << "::" << base_name << "(" << base_name << "Type t, const Offset& o, const " << base_name << "Id& i) : type(t), offset(o), uid(i) {}\n";
     source << "\n\n\n";
 
     header << "struct " << base_name << "Id { u64 value; };\n";
     header << "\n\n";
     header << "struct " << base_name << "\n";
     header << "{\n";
-    header << INDENT << "" << base_name << "(const Offset& o, const " << base_name << "Id& i);\n";
+    header << INDENT << "" << base_name << "(" << base_name << "Type t, const Offset& o, const " << base_name << "Id& i);\n";
     header << INDENT << "virtual ~" << base_name << "() = default;\n";
     header << "\n";
-    header << INDENT << "virtual " << base_name << "Type get_type() const = 0;\n";
+    header << INDENT << "// the tag is a plain member so reading it is a load, not a\n";
+    header << INDENT << "// virtual call; dispatch() switches on it\n";
+    header << INDENT << base_name << "Type get_type() const { return type; }\n";
     header << "\n";
+    header << INDENT << base_name << "Type type;\n";
     header << INDENT << "Offset offset;\n";
     header << INDENT << base_name << "Id uid;\n";
+    if(base_name == "Expression")
+    {
+        header << "\n";
+        header << INDENT << "// written by the resolver for expressions that reference a local,\n";
+        header << INDENT << "// mutable since the interpreter only ever sees const nodes\n";
+        header << INDENT << "mutable std::optional<VarLocation> resolved_location;\n";
+        header << "\n";
+        header << INDENT << "// set instead of resolved_location when the reference crosses a\n";
+        header << INDENT << "// function boundary: the index into the running closure's upvalue cells\n";
+        header << INDENT << "mutable std::optional<std::size_t> resolved_upvalue;\n";
+    }
     header << "\n";
     for(const auto& vis: visitors)
     {
@@ -227,6 +307,41 @@ define_ast
     {
         define_type(source, header, base_name, sub, visitors);
     }
+
+    // switch-based alternative to the virtual accept: the node set is
+    // closed so the interpreter's hot loop can dispatch on the dense
+    // tag with one jump table instead of a vtable call per node
+    for(const auto& vis: visitors)
+    {
+        header << "// dispatch on the tag instead of a virtual accept call\n";
+        header << vis.type << " dispatch(const " << base_name << "& x, " << base_name << vis.name << "* vis);\n";
+        header << "\n\n";
+
+        source << vis.type << "\n";
+        source << "dispatch(const " << base_name << "& x, " << base_name << vis.name << "* vis)\n";
+        source << "{\n";
+        const std::string ret = vis.type == "void" ? "" : "return ";
+        source << INDENT << "switch(x.get_type())\n";
+        source << INDENT << "{\n";
+        for(const auto& sub: subs)
+        {
+            source << INDENT << "case " << base_name << "Type::" << to_lower(sub.name) << "_" << to_lower(base_name) << ":\n";
+            source << INDENT << INDENT << ret << "vis->" << get_fun_visit_name(sub.name, base_name)
+                << "(static_cast<const " << sub.name << base_name << "&>(x));\n";
+            if(vis.type == "void")
+            {
+                source << INDENT << INDENT << "return;\n";
+            }
+        }
+        source << INDENT << "}\n";
+        source << INDENT << "assert(false && \"unknown " << base_name << "Type in dispatch\");\n";
+        if(vis.type != "void")
+        {
+            source << INDENT << "return {};\n";
+        }
+        source << "}\n";
+        source << "\n\n";
+    }
 }
 
 
@@ -241,10 +356,13 @@ write_code
     header << "#pragma once\n";
     header << "\n";
     header << "#include <memory>\n";
+    header << "#include <optional>\n";
     header << "#include <string>\n";
     header << "\n";
+    header << "#include \"lox/ast_arena.h\"\n";
     header << "#include \"lox/token.h\"\n";
     header << "#include \"lox/object.h\"\n";
+    header << "#include \"lox/value.h\"\n";
     header << "#include \"lox/source.h\"\n";
     header << "\n\n";
     header << "namespace lox\n";
@@ -253,11 +371,40 @@ write_code
 
     source << "#include \"" << header_name << "\"\n";
     source << "\n";
+    source << "#include <cassert>\n";
+    source << "\n";
     source << "\n\n";
     source << "namespace lox\n";
     source << "{\n";
     source << "\n\n";
 
+    header << "// where a resolved local lives relative to the expression that uses it:\n";
+    header << "// how many environments up and which slot in that environment\n";
+    header << "struct VarLocation\n";
+    header << "{\n";
+    header << INDENT << "std::size_t distance;\n";
+    header << INDENT << "std::size_t slot;\n";
+    header << "};\n";
+    header << "\n\n";
+
+    header << "// where a closure finds one of its captured variables when it is created:\n";
+    header << "// either a boxed local visible from the creation site, or a cell the\n";
+    header << "// enclosing closure already captured\n";
+    header << "struct UpvalueSource\n";
+    header << "{\n";
+    header << INDENT << "bool from_enclosing_upvalue;\n";
+    header << INDENT << "std::size_t distance; // environments up from the creation site, 0 for upvalues\n";
+    header << INDENT << "std::size_t slot; // slot in that environment, or the enclosing upvalue index\n";
+    header << "};\n";
+    header << "\n\n";
+
+    header << "// type feedback for a binary operator site, see BinaryExpression::quickening\n";
+    header << "enum class BinaryQuickening\n";
+    header << "{\n";
+    header << INDENT << "none, int_int, float_float, generic\n";
+    header << "};\n";
+    header << "\n\n";
+
     define_ast
     (
         source, header, "Expression",
@@ -277,32 +424,42 @@ write_code
                     {"TokenType", "op"},
                     {"Offset", "op_offset"},
                     {"Expression", "right"}
+                },
+                {
+                    "// type feedback: once a visit observes int/int or float/float",
+                    "// operands here the site is tagged and later visits take an",
+                    "// unchecked fast path, a mismatch deopts to generic for good",
+                    "mutable BinaryQuickening quickening = BinaryQuickening::none;"
                 }
             },
             {
                 "Call",
                 {
                     {"Expression", "callee"},
-                    {"std::vector<std::shared_ptr<Expression>>", "arguments"}
+                    {"std::vector<Expression*>", "arguments"}
                 }
             },
             {
                 "Array",
                 {
-                    {"std::vector<std::shared_ptr<Expression>>", "values"}
+                    {"std::vector<Expression*>", "values"}
                 }
             },
             {
                 "Constructor",
                 {
                     {"Expression", "klass"},
-                    {"std::vector<std::shared_ptr<Expression>>", "arguments"}
+                    {"std::vector<Expression*>", "arguments"}
                 }
             },
             {
                 "SuperConstructorCall",
                 {
-                    {"std::vector<std::shared_ptr<Expression>>", "arguments"}
+                    {"std::vector<Expression*>", "arguments"}
+                },
+                {
+                    "// \"this\" as seen from a nested function, captured next to \"super\"",
+                    "mutable std::optional<std::size_t> this_upvalue;"
                 }
             },
             {
@@ -310,6 +467,12 @@ write_code
                 {
                     {"Expression", "object"},
                     {"std::string", "name"}
+                },
+                {
+                    "// interned on first access so later lookups hash an int, not the name",
+                    "mutable std::optional<Symbol> name_symbol;",
+                    "// inline cache for instance accesses through this site",
+                    "mutable PropertyCache property_cache;"
                 }
             },
             {
@@ -318,6 +481,10 @@ write_code
                     {"Expression", "object"},
                     {"std::string", "name"},
                     {"Expression", "value"}
+                },
+                {
+                    "mutable std::optional<Symbol> name_symbol;",
+                    "mutable PropertyCache property_cache;"
                 }
             },
             {
@@ -339,6 +506,11 @@ write_code
                 "Super",
                 {
                     {"std::string", "property"}
+                },
+                {
+                    "mutable std::optional<Symbol> name_symbol;",
+                    "// \"this\" as seen from a nested function, captured next to \"super\"",
+                    "mutable std::optional<std::size_t> this_upvalue;"
                 }
             },
             {
@@ -384,7 +556,7 @@ write_code
         {
             {"VoidVisitor", "void"},
             {"StringVisitor", "std::string"},
-            {"ObjectVisitor", "std::shared_ptr<Object>"}
+            {"ObjectVisitor", "Value"}
         }
     );
     
@@ -395,7 +567,13 @@ write_code
             {
                 "Block",
                 {
-                    {"std::vector<std::shared_ptr<Statement>>", "statements"}
+                    {"std::vector<Statement*>", "statements"}
+                },
+                {
+                    "// set by the resolver when a declaration directly in this block",
+                    "// is captured by a closure, loop bodies without captures reuse a",
+                    "// single environment across iterations instead of allocating",
+                    "mutable bool has_captured_declarations = false;"
                 }
             },
             {
@@ -403,9 +581,16 @@ write_code
                 {
                     {"std::string", "name"},
                     {"Expression", "parent"},
-                    {"std::vector<std::shared_ptr<VarStatement>>", "members"},
-                    {"std::vector<std::shared_ptr<FunctionStatement>>", "methods"},
-                    {"std::vector<std::shared_ptr<FunctionStatement>>", "static_methods"}
+                    {"std::vector<VarStatement*>", "members"},
+                    {"std::vector<FunctionStatement*>", "methods"},
+                    {"std::vector<FunctionStatement*>", "static_methods"}
+                },
+                {
+                    "// true when a closure captures the class through its name",
+                    "mutable bool is_captured = false;",
+                    "// true when a function nested in some method captures \"this\",",
+                    "// bind() then boxes it so the capture shares writes",
+                    "mutable bool this_is_captured = false;"
                 }
             },
             {
@@ -413,7 +598,15 @@ write_code
                 {
                     {"std::string", "name"},
                     {"std::vector<std::string>", "params"},
-                    {"std::vector<std::shared_ptr<Statement>>", "body"}
+                    {"std::vector<Statement*>", "body"}
+                },
+                {
+                    "// true when a closure captures the function through its name",
+                    "mutable bool is_captured = false;",
+                    "// per parameter: true when a nested function captures it",
+                    "mutable std::vector<bool> param_is_captured;",
+                    "// how the created closure fills its upvalue cells, in index order",
+                    "mutable std::vector<UpvalueSource> upvalue_sources;"
                 }
             },
             {
@@ -447,6 +640,11 @@ write_code
                 {
                     {"std::string", "name"},
                     {"Expression", "initializer"}
+                },
+                {
+                    "// true when a closure captures the variable, the interpreter then",
+                    "// defines it boxed in a cell so captures share writes",
+                    "mutable bool is_captured = false;"
                 }
             },
             {
@@ -1,10 +1,15 @@
 #include "lox/interpreter.h"
 
 #include <cassert>
+#include <mutex>
+#include <unordered_set>
 
 
 #include "lox/ast.h"
+#include "lox/symbol.h"
 #include "lox/errorhandler.h"
+#include "lox/printhandler.h"
+#include "lox/trace.h"
 #include "lox/program.h"
 #include "lox/environment.h"
 #include "lox/resolver.h"
@@ -15,48 +20,78 @@ namespace lox { namespace
 struct MainInterpreter;
 
 
-struct State
-{
-    std::unordered_map<u64, std::size_t> locals;
-
-    explicit State(const Resolved& resolved)
-        : locals(resolved.locals)
-    {
-    }
-};
-
 std::shared_ptr<Object>
 interpret_initial_value(MainInterpreter* inter, const VarStatement&);
 
+std::optional<Value>
+take_return_value(MainInterpreter* main);
+
+void
+consume_call_fuel(MainInterpreter* main, const std::vector<Statement*>& body);
+
+struct ScriptFunction;
+
+// a deferred call in tail position: the active script frame rebinds
+// these arguments and loops instead of recursing
+struct TailCall
+{
+    std::shared_ptr<ScriptFunction> function;
+    std::vector<std::shared_ptr<Object>> arguments;
+};
+
 void
-execute_statements_with_environment
+execute_function_body
 (
     MainInterpreter* main,
-    const std::vector<std::shared_ptr<Statement>>& statements,
+    const std::vector<Statement*>& statements,
     std::shared_ptr<Environment> environment,
-    std::shared_ptr<State> state
+    bool allow_tail_calls
 );
 
+std::optional<TailCall>
+take_tail_call(MainInterpreter* main);
 
-struct CallError
+ScriptFunction*
+exchange_current_function(MainInterpreter* main, ScriptFunction* function);
+
+void
+track_for_gc(MainInterpreter* main, const std::shared_ptr<Object>& object);
+
+// keeps the interpreter's notion of "the running script function" correct
+// while a frame executes, upvalue accesses go through it
+struct CurrentFunctionRaii
 {
-    std::string error;
-    explicit CallError(const std::string& err)
-        : error(err)
+    MainInterpreter* main;
+    ScriptFunction* previous;
+
+    CurrentFunctionRaii(MainInterpreter* m, ScriptFunction* function)
+        : main(m)
+        , previous(exchange_current_function(m, function))
+    {
+    }
+
+    ~CurrentFunctionRaii()
     {
+        exchange_current_function(main, previous);
     }
+
+    CurrentFunctionRaii(CurrentFunctionRaii&&) = delete;
+    void operator=(CurrentFunctionRaii&&) = delete;
+    CurrentFunctionRaii(const CurrentFunctionRaii&) = delete;
+    void operator=(const CurrentFunctionRaii&) = delete;
 };
 
 
-struct ReturnValue
+struct CallError
 {
-    std::shared_ptr<Object> value;
-    explicit ReturnValue(std::shared_ptr<Object> v)
-        : value(v)
+    std::string error;
+    explicit CallError(const std::string& err)
+        : error(err)
     {
     }
 };
 
+
 struct InvalidArgumentType
 {
     u64 argument_index;
@@ -85,11 +120,24 @@ struct RuntimeError
 struct ScriptFunction : Callable
 {
     MainInterpreter* interpreter;
+
+    // not the defining environment chain: just the global environment, or
+    // for methods the little "super"/"this" environments rooted in it, so
+    // a closure no longer keeps every sibling local of its creator alive
     std::shared_ptr<Environment> closure;
-    std::shared_ptr<State> state;
+
     std::string to_str;
     std::vector<std::string> params; // todo(Gustav): add types here
-    std::vector<std::shared_ptr<Statement>> body;
+    std::vector<bool> param_is_captured;
+    std::vector<Statement*> body;
+
+    // cells for the outer variables the resolver found this function
+    // using, shared with the environments (and closures) they came from
+    std::vector<std::shared_ptr<Value>> upvalues;
+
+    // only box "this" when a nested function actually captures it
+    bool box_this;
+
     bool is_initializer;
 
     ArgInfo get_arg_info(Interpreter*, Callable*) override
@@ -107,18 +155,22 @@ struct ScriptFunction : Callable
     (
         MainInterpreter* i,
         std::shared_ptr<Environment> c,
-        std::shared_ptr<State> s,
         const std::string& n,
         const std::vector<std::string>& p,
-        const std::vector<std::shared_ptr<Statement>>& b,
+        const std::vector<bool>& pc,
+        const std::vector<Statement*>& b,
+        std::vector<std::shared_ptr<Value>>&& up,
+        bool bt,
         bool ii
     )
         : interpreter(i)
         , closure(c)
-        , state(s)
         , to_str(n)
         , params(p)
+        , param_is_captured(pc)
         , body(b)
+        , upvalues(std::move(up))
+        , box_this(bt)
         , is_initializer(ii)
     {
     }
@@ -127,8 +179,31 @@ struct ScriptFunction : Callable
     bind(std::shared_ptr<Object> instance) override
     {
         auto env = std::make_shared<Environment>(closure);
-        env->define("this", instance);
-        return std::make_shared<ScriptFunction>(interpreter, env, state, to_str, params, body, is_initializer);
+        env->define("this", instance, box_this);
+
+        auto bound_upvalues = upvalues;
+        auto bound = make_tracked<ScriptFunction>
+        (
+            interpreter, env, to_str, params, param_is_captured, body,
+            std::move(bound_upvalues), box_this, is_initializer
+        );
+        track_for_gc(interpreter, bound);
+        return bound;
+    }
+
+    void visit_references(GcReferenceVisitor* visitor) override
+    {
+        visitor->on_environment(closure);
+        for(const auto& upvalue: upvalues)
+        {
+            visitor->on_cell(upvalue);
+        }
+    }
+
+    void clear_references() override
+    {
+        closure.reset();
+        upvalues.clear();
     }
 
     std::vector<std::string>
@@ -138,40 +213,65 @@ struct ScriptFunction : Callable
     }
 
     std::shared_ptr<Object>
-    call(Interpreter*, const Arguments& arguments) override
+    do_call(Interpreter*, const Arguments& arguments) override
     {
+        LOX_TRACE_FUNCTION();
         verify_number_of_arguments(arguments, params.size());
-        
-        auto environment = std::make_shared<Environment>(closure);
 
-        for(std::size_t param_index = 0; param_index < params.size(); param_index += 1)
-        {
-            environment->define(params[param_index], arguments.arguments[param_index]);
-        }
+        auto self = std::static_pointer_cast<ScriptFunction>(shared_from_this());
+        auto current_arguments = arguments.arguments;
 
-        try
-        {
-            execute_statements_with_environment(interpreter, body, environment, state);
-        }
-        catch(const ReturnValue& r)
+        auto function_raii = CurrentFunctionRaii{interpreter, self.get()};
+
+        // calls in tail position rebind into a fresh frame here instead of
+        // recursing through another call, so recursion depth stays flat
+        while(true)
         {
-            if(is_initializer)
+            consume_call_fuel(interpreter, self->body);
+            exchange_current_function(interpreter, self.get());
+            auto environment = std::make_shared<Environment>(self->closure);
+
+            for(std::size_t param_index = 0; param_index < self->params.size(); param_index += 1)
             {
-                auto ini = closure->get_at_or_null(0, "this");
-                assert(ini != nullptr);
-                return ini;
+                environment->define
+                (
+                    self->params[param_index],
+                    current_arguments[param_index],
+                    self->param_is_captured[param_index]
+                );
             }
-            return r.value;
-        }
 
-        if(is_initializer)
-        {
-            auto ini = closure->get_at_or_null(0, "this");
-            assert(ini != nullptr);
-            return ini;
-        }
+            // initializers always return "this", eliminating their tail
+            // calls would lose that
+            execute_function_body(interpreter, self->body, environment, self->is_initializer == false);
+
+            if(auto tail = take_tail_call(interpreter); tail.has_value())
+            {
+                // drop the sentinel return that unwound the body
+                take_return_value(interpreter);
+                verify_number_of_arguments({tail->arguments}, tail->function->params.size());
+                self = std::move(tail->function);
+                current_arguments = std::move(tail->arguments);
+                continue;
+            }
+
+            auto returned = take_return_value(interpreter);
+
+            if(self->is_initializer)
+            {
+                // "this" is the only variable in the environment bind() created
+                auto ini = self->closure->get_at_or_null(0, 0);
+                assert(ini.has_value());
+                return ini->as_object();
+            }
+
+            if(returned.has_value())
+            {
+                return returned->as_object();
+            }
 
-        return make_nil();
+            return make_nil();
+        }
     }
 };
 
@@ -188,11 +288,11 @@ check_single_number_operand
 (
     ErrorHandler* error_handler,
     const Offset& op_offset,
-    std::shared_ptr<Object> object,
+    const Value& object,
     const Offset& object_offset
 )
 {
-    const auto type = object->get_type();
+    const auto type = object.get_type();
     if(is_number(type)) { return; }
 
     error_handler->on_error(op_offset, "operand must be a int or a float");
@@ -206,14 +306,14 @@ check_binary_number_operand
 (
     ErrorHandler* error_handler,
     const Offset& op_offset,
-    std::shared_ptr<Object> lhs,
-    std::shared_ptr<Object> rhs,
+    const Value& lhs,
+    const Value& rhs,
     const Offset& lhs_offset,
     const Offset& rhs_offset
 )
 {
-    const auto lhs_type = lhs->get_type();
-    const auto rhs_type = rhs->get_type();
+    const auto lhs_type = lhs.get_type();
+    const auto rhs_type = rhs.get_type();
     if(is_number(lhs_type) && is_number(rhs_type)) { return; }
 
     error_handler->on_error(op_offset, "operands must be a numbers");
@@ -228,14 +328,14 @@ check_binary_number_or_string_operands
 (
     ErrorHandler* error_handler,
     const Offset& op_offset,
-    std::shared_ptr<Object> lhs,
-    std::shared_ptr<Object> rhs,
+    const Value& lhs,
+    const Value& rhs,
     const Offset& lhs_offset,
     const Offset& rhs_offset
 )
 {
-    const auto lhs_type = lhs->get_type();
-    const auto rhs_type = rhs->get_type();
+    const auto lhs_type = lhs.get_type();
+    const auto rhs_type = rhs.get_type();
     if
     (
         (is_number(lhs_type) && is_number(rhs_type))
@@ -252,14 +352,14 @@ check_binary_number_or_string_operands
 
 
 bool
-is_equal(std::shared_ptr<Object> lhs, std::shared_ptr<Object> rhs)
+is_equal(const Value& lhs, const Value& rhs)
 {
-    if(lhs->get_type() != rhs->get_type())
+    if(lhs.get_type() != rhs.get_type())
     {
         return false;
     }
-    
-    switch(lhs->get_type())
+
+    switch(lhs.get_type())
     {
     case ObjectType::nil: return true;
     case ObjectType::number_int:
@@ -275,6 +375,20 @@ is_equal(std::shared_ptr<Object> lhs, std::shared_ptr<Object> rhs)
 }
 
 
+// property names are interned once per ast node, later accesses reuse the
+// cached symbol and the property maps hash an int instead of the name
+template<typename T>
+Symbol
+get_name_symbol(const T& x, const std::string& name)
+{
+    if(x.name_symbol.has_value() == false)
+    {
+        x.name_symbol = intern_symbol(name);
+    }
+    return *x.name_symbol;
+}
+
+
 template<typename T>
 struct SharedptrRaii
 {
@@ -298,12 +412,36 @@ struct SharedptrRaii
 };
 
 
+// the shared field layout (shape) of every instance created from one
+// ScriptKlass: field name -> slot in the instance's flat value array.
+// fields are fixed at declaration time (assigning an undeclared property
+// is an error), so a single layout covers all instances of a klass and
+// each instance only pays for a vector of values
+struct FieldLayout
+{
+    std::unordered_map<Symbol, std::size_t> slots;
+
+    std::size_t get_slot_or_npos(Symbol name) const
+    {
+        if(auto found = slots.find(name); found != slots.end())
+        {
+            return found->second;
+        }
+
+        return PropertyCache::no_field_slot;
+    }
+};
+
+
 struct ScriptInstance : Instance
 {
-    std::unordered_map<std::string, std::shared_ptr<Object>> fields;
+    std::shared_ptr<FieldLayout> layout;
+    std::vector<std::shared_ptr<Object>> field_values;
 
-    explicit ScriptInstance(std::shared_ptr<Klass> o)
+    ScriptInstance(std::shared_ptr<Klass> o, std::shared_ptr<FieldLayout> lay)
         : Instance(o)
+        , layout(lay)
+        , field_values(lay->slots.size())
     {
     }
 
@@ -319,42 +457,69 @@ struct ScriptInstance : Instance
         return {fmt::format("<instance {}>", klass->klass_name)};
     }
 
-    std::shared_ptr<Object> get_field_or_null(const std::string& name) override
+    std::shared_ptr<Object> get_field_or_null(Symbol name) override
     {
-        if(auto found = fields.find(name); found != fields.end())
-        {
-            return found->second;
-        }
+        return get_field_by_slot_or_null(layout->get_slot_or_npos(name));
+    }
 
-        return nullptr;
+    bool set_field_or_false(Symbol name, std::shared_ptr<Object> value) override
+    {
+        return set_field_by_slot_or_false(layout->get_slot_or_npos(name), value);
+    }
+
+    std::size_t get_field_slot_or_npos(Symbol name) override
+    {
+        return layout->get_slot_or_npos(name);
     }
 
-    bool set_field_or_false(const std::string& name, std::shared_ptr<Object> value) override
+    std::shared_ptr<Object> get_field_by_slot_or_null(std::size_t slot) override
     {
-        if(auto found = fields.find(name); found != fields.end())
+        // stays in range for every cached slot, but clear_references
+        // empties the vector so a dying cycle can still be probed safely
+        if(slot >= field_values.size())
         {
-            found->second = value;
-            return true;
+            return nullptr;
         }
-        else
+
+        return field_values[slot];
+    }
+
+    bool set_field_by_slot_or_false(std::size_t slot, std::shared_ptr<Object> value) override
+    {
+        if(slot >= field_values.size())
         {
             return false;
         }
 
+        field_values[slot] = value;
+        return true;
     }
 
     bool add_member(const std::string& name, std::shared_ptr<Object> value)
     {
-        if(auto found = fields.find(name); found != fields.end())
+        const auto slot = layout->get_slot_or_npos(intern_symbol(name));
+        if(slot >= field_values.size() || field_values[slot] != nullptr)
         {
             return false;
         }
-        else
+
+        field_values[slot] = value;
+        return true;
+    }
+
+    void visit_references(GcReferenceVisitor* visitor) override
+    {
+        Instance::visit_references(visitor);
+        for(const auto& field: field_values)
         {
-            fields.insert({name, value});
-            return true;
+            visitor->on_object(field);
         }
+    }
 
+    void clear_references() override
+    {
+        Instance::clear_references();
+        field_values.clear();
     }
 };
 
@@ -362,19 +527,25 @@ struct ScriptInstance : Instance
 struct ScriptKlass : Klass
 {
     MainInterpreter* inter; // todo(Gustav): rename to main_inter
-    std::vector<std::shared_ptr<VarStatement>> members;
+    std::vector<VarStatement*> members;
+    std::shared_ptr<FieldLayout> layout;
 
     ScriptKlass
     (
         const std::string& nm,
         std::shared_ptr<Klass> sk,
         MainInterpreter* mi,
-        std::vector<std::shared_ptr<VarStatement>> mems
+        std::vector<VarStatement*> mems
     )
         : Klass(nm, sk)
         , inter(mi)
         , members(mems)
+        , layout(std::make_shared<FieldLayout>())
     {
+        for(const auto& m: members)
+        {
+            layout->slots.insert({intern_symbol(m->name), layout->slots.size()});
+        }
     }
 
     std::vector<std::string>
@@ -389,15 +560,17 @@ struct ScriptKlass : Klass
         auto self = shared_from_this();
         auto klass = std::static_pointer_cast<Klass>(self);
 
-        auto instance = std::make_shared<ScriptInstance>(klass);
+        auto instance = make_tracked<ScriptInstance>(klass, layout);
+        track_for_gc(inter, instance);
 
         for(const auto& m: members)
         {
-            [[maybe_unused]] const auto was_added = instance->add_member(m->name, interpret_initial_value(inter, *m.get()));
+            [[maybe_unused]] const auto was_added = instance->add_member(m->name, interpret_initial_value(inter, *m));
             assert(was_added);
         }
 
-        if (auto initializer = klass->find_method_or_null("init"); initializer != nullptr)
+        static const auto init_symbol = intern_symbol("init");
+        if (auto initializer = klass->find_method_or_null(init_symbol); initializer != nullptr)
         {
             initializer->bind(instance)->call(arg_inter, arguments);
         }
@@ -583,9 +756,9 @@ void report_error_no_indexer(Interpreter* inter, const Offset& offset, ErrorHand
 
 
 Tf
-get_number_as_float(std::shared_ptr<Object> obj)
+get_number_as_float(const Value& obj)
 {
-    const auto type = obj->get_type();
+    const auto type = obj.get_type();
     if(type == ObjectType::number_float)
     {
         return get_float_or_ub(obj);
@@ -598,172 +771,942 @@ get_number_as_float(std::shared_ptr<Object> obj)
 }
 
 
+//---------------------------------------------------------------------------------------------
+// bytecode backend
+//
+// the resolved program is compiled to a flat instruction stream that a single
+// dispatch loop in MainInterpreter::run_chunk executes, instead of recursing
+// through the ast with virtual visitors. instructions keep a pointer to the
+// node they came from so variable lookup and error reporting work exactly
+// like in the tree walking backend.
+//
+// constructs the compiler can't handle yet (classes, this and super) make
+// compilation fail and the caller falls back to tree walking.
 
-struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
+enum class Op : unsigned char
 {
-    Interpreter* interpreter;
-    ErrorHandler* error_handler;
-    std::shared_ptr<Environment> global_environment;
-    std::shared_ptr<Environment> current_environment;
-    std::shared_ptr<State> current_state;
-    std::function<void (std::string)> on_line;
-    std::unique_ptr<ObjectIntegration> integration;
-    std::unordered_map<std::size_t, std::shared_ptr<NativeKlass>> registered_klasses;
+    push_constant, pop,
+    get_var, set_var, define_var,
+    binary, unary,
+    // loop is a backward jump that doubles as the fuel check point
+    jump, loop, jump_if_false, jump_if_false_no_pop, jump_if_true_no_pop,
+    call, construct, make_array, make_function,
+    get_property, set_property, get_index, set_index,
+    push_scope, pop_scope,
+    print, return_value, return_nil
+};
 
-    //-------------------------------------------------------------------------
-    // constructor
 
-    explicit MainInterpreter
-    (
-        Interpreter* inter,
-        std::shared_ptr<Environment> ge,
-        ErrorHandler* eh,
-        const std::function<void (std::string)>& ol
-    )
-        : interpreter(inter)
-        , error_handler(eh)
-        , global_environment(ge)
-        , on_line(ol)
-        , integration(make_object_integration())
-    {
-    }
+struct Instruction
+{
+    Op op;
+    std::size_t arg;
+    const void* node;
+};
 
-    //---------------------------------------------------------------------------------------------
-    // util functions
 
-    std::string
-    get_klass_name(std::size_t klass_index)
+struct Chunk
+{
+    std::vector<Instruction> code;
+    std::vector<Value> constants;
+    std::vector<std::shared_ptr<Chunk>> functions;
+};
+
+
+std::shared_ptr<Callable>
+make_bytecode_function
+(
+    MainInterpreter* inter,
+    std::shared_ptr<Environment> closure,
+    std::shared_ptr<Chunk> chunk,
+    const FunctionStatement& x
+);
+
+
+struct BytecodeCompiler
+{
+    Chunk* chunk;
+    bool ok = true;
+
+    explicit BytecodeCompiler(Chunk* c)
+        : chunk(c)
     {
-        if(auto found = registered_klasses.find(klass_index); found != registered_klasses.end())
-        {
-            return found->second->klass_name;
-        }
-        else
-        {
-            return fmt::format("<unregistred native klass {}>", klass_index);
-        }
     }
 
-    std::string
-    invalidarg_to_string(const InvalidArgumentType& invalid_arg_error)
+    std::size_t
+    emit(Op op, std::size_t arg, const void* node)
     {
-        if(invalid_arg_error.expected_type == ObjectType::native_instance)
-        {
-            assert(invalid_arg_error.native_klass);
-            return get_klass_name(*invalid_arg_error.native_klass);
-        }
-        else
-        {
-            return std::string{objecttype_to_string(invalid_arg_error.expected_type)};
-        }
+        chunk->code.emplace_back(Instruction{op, arg, node});
+        return chunk->code.size() - 1;
     }
 
-    std::string
-    smart_object_to_type_string(std::shared_ptr<Object> obj)
+    void
+    patch_jump(std::size_t instruction_index)
     {
-        const auto type = obj->get_type();
-        if(type == ObjectType::native_instance)
-        {
-            // todo(Gustav): also include script klasses here?
-            auto native = std::static_pointer_cast<NativeInstance>(obj);
-            return native->klass->klass_name;
-        }
-        else
-        {
-            return std::string{objecttype_to_string(type)};
-        }
+        chunk->code[instruction_index].arg = chunk->code.size();
     }
 
-    std::shared_ptr<Object>
-    evaluate(std::shared_ptr<Expression> x)
+    std::size_t
+    add_constant(const Value& value)
     {
-        return x->accept(this);
+        chunk->constants.emplace_back(value);
+        return chunk->constants.size() - 1;
     }
 
     void
-    execute(std::shared_ptr<Statement> x)
+    compile(const std::vector<Statement*>& statements)
     {
-        x->accept(this);
+        for(const auto& st: statements)
+        {
+            compile(st);
+        }
     }
 
-    std::shared_ptr<Object>
-    lookup_var(Environment& environment, const std::string& name, const Expression& x)
+    void
+    compile(const Statement* statement)
     {
-        auto found = current_state->locals.find(x.uid.value);
-        if(found != current_state->locals.end())
+        switch(statement->get_type())
         {
-            auto r = environment.get_at_or_null(found->second, name);
-            assert(r != nullptr);
-            return r;
+        case StatementType::block_statement:
+        {
+            auto* x = static_cast<const BlockStatement*>(statement);
+            emit(Op::push_scope, 0, x);
+            compile(x->statements);
+            emit(Op::pop_scope, 0, x);
+            break;
         }
-        else
+        case StatementType::function_statement:
         {
-            auto r = global_environment->get_or_null(name);
-            if(r == nullptr)
+            auto* x = static_cast<const FunctionStatement*>(statement);
+            auto function_chunk = std::make_shared<Chunk>();
+            auto function_compiler = BytecodeCompiler{function_chunk.get()};
+            function_compiler.compile(x->body);
+            if(function_compiler.ok == false)
             {
-                error_handler->on_error(x.offset, fmt::format("Undefined variable {}", name));
-                throw RuntimeError{};
+                ok = false;
+                return;
             }
-            return r;
+            chunk->functions.emplace_back(std::move(function_chunk));
+            emit(Op::make_function, chunk->functions.size() - 1, x);
+            break;
         }
-    }
-
-    std::optional<std::size_t>
-    lookup_distance_for_var(const Expression& x)
-    {
-        auto found = current_state->locals.find(x.uid.value);
-        if(found != current_state->locals.end())
+        case StatementType::expression_statement:
         {
-            return found->second;
+            auto* x = static_cast<const ExpressionStatement*>(statement);
+            compile(x->expression);
+            emit(Op::pop, 0, nullptr);
+            break;
         }
-        else
+        case StatementType::if_statement:
         {
-            return std::nullopt;
+            auto* x = static_cast<const IfStatement*>(statement);
+            compile(x->condition);
+            const auto jump_to_else = emit(Op::jump_if_false, 0, nullptr);
+            compile(x->then_branch);
+            if(x->else_branch != nullptr)
+            {
+                const auto jump_over_else = emit(Op::jump, 0, nullptr);
+                patch_jump(jump_to_else);
+                compile(x->else_branch);
+                patch_jump(jump_over_else);
+            }
+            else
+            {
+                patch_jump(jump_to_else);
+            }
+            break;
         }
-    }
-
-    void
-    set_var_via_lookup(Environment& environment, const std::string& name, std::shared_ptr<Object> value, const Expression& x)
-    {
-        auto found = current_state->locals.find(x.uid.value);
-        if(found != current_state->locals.end())
+        case StatementType::print_statement:
         {
-            [[maybe_unused]] auto r = environment.set_at_or_false(found->second, name, value);
-            assert(r == true);
+            auto* x = static_cast<const PrintStatement*>(statement);
+            compile(x->expression);
+            emit(Op::print, 0, x);
+            break;
         }
-        else
+        case StatementType::return_statement:
         {
-            const auto was_set = global_environment->set_or_false(name, value);
-            if(was_set == false)
+            auto* x = static_cast<const ReturnStatement*>(statement);
+            if(x->value != nullptr)
             {
-                const bool is_in_global = global_environment.get() == current_environment.get();
-                if(is_in_global)
-                {
-                    error_handler->on_error(x.offset, fmt::format("Global variable {} was never declared", name));
-                }
-                else
-                {
-                    error_handler->on_error(x.offset, fmt::format("Variable {} was neither declared in global nor local scope", name));
-                }
-                throw RuntimeError{};
+                compile(x->value);
+                emit(Op::return_value, 0, nullptr);
+            }
+            else
+            {
+                emit(Op::return_nil, 0, nullptr);
             }
+            break;
         }
-    }
-
-    std::shared_ptr<Object>
-    get_var(Environment& environment, const std::string& name, const Offset& off)
-    {
-        auto var = environment.get_or_null(name);
-        if(var == nullptr)
+        case StatementType::var_statement:
         {
-            error_handler->on_error(off, "Undefined variable");
+            auto* x = static_cast<const VarStatement*>(statement);
+            if(x->initializer != nullptr)
+            {
+                compile(x->initializer);
+            }
+            else
+            {
+                emit(Op::push_constant, add_constant(Value{}), nullptr);
+            }
+            emit(Op::define_var, 0, x);
+            break;
+        }
+        case StatementType::while_statement:
+        {
+            auto* x = static_cast<const WhileStatement*>(statement);
+            const auto loop_start = chunk->code.size();
+            compile(x->condition);
+            const auto jump_out = emit(Op::jump_if_false, 0, nullptr);
+            compile(x->body);
+            emit(Op::loop, loop_start, x);
+            patch_jump(jump_out);
+            break;
+        }
+        case StatementType::class_statement:
+            ok = false;
+            break;
+        default:
+            assert(false && "unhandled statement type in BytecodeCompiler");
+            ok = false;
+            break;
+        }
+    }
+
+    void
+    compile(const Expression* expression)
+    {
+        switch(expression->get_type())
+        {
+        case ExpressionType::assign_expression:
+        {
+            auto* x = static_cast<const AssignExpression*>(expression);
+            if(x->resolved_upvalue.has_value())
+            {
+                // upvalue cells belong to tree walking script functions
+                ok = false;
+                break;
+            }
+            compile(x->value);
+            emit(Op::set_var, 0, x);
+            break;
+        }
+        case ExpressionType::binary_expression:
+        {
+            auto* x = static_cast<const BinaryExpression*>(expression);
+            compile(x->left);
+            compile(x->right);
+            emit(Op::binary, 0, x);
+            break;
+        }
+        case ExpressionType::call_expression:
+        {
+            auto* x = static_cast<const CallExpression*>(expression);
+            compile(x->callee);
+            for(const auto& argument: x->arguments)
+            {
+                compile(argument);
+            }
+            emit(Op::call, x->arguments.size(), x);
+            break;
+        }
+        case ExpressionType::array_expression:
+        {
+            auto* x = static_cast<const ArrayExpression*>(expression);
+            for(const auto& value: x->values)
+            {
+                compile(value);
+            }
+            emit(Op::make_array, x->values.size(), nullptr);
+            break;
+        }
+        case ExpressionType::constructor_expression:
+        {
+            auto* x = static_cast<const ConstructorExpression*>(expression);
+            compile(x->klass);
+            for(const auto& argument: x->arguments)
+            {
+                compile(argument);
+            }
+            emit(Op::construct, x->arguments.size(), x);
+            break;
+        }
+        case ExpressionType::getproperty_expression:
+        {
+            auto* x = static_cast<const GetPropertyExpression*>(expression);
+            compile(x->object);
+            emit(Op::get_property, 0, x);
+            break;
+        }
+        case ExpressionType::setproperty_expression:
+        {
+            auto* x = static_cast<const SetPropertyExpression*>(expression);
+            compile(x->object);
+            compile(x->value);
+            emit(Op::set_property, 0, x);
+            break;
+        }
+        case ExpressionType::getindex_expression:
+        {
+            auto* x = static_cast<const GetIndexExpression*>(expression);
+            compile(x->object);
+            compile(x->index);
+            emit(Op::get_index, 0, x);
+            break;
+        }
+        case ExpressionType::setindex_expression:
+        {
+            auto* x = static_cast<const SetIndexExpression*>(expression);
+            compile(x->object);
+            compile(x->index);
+            compile(x->value);
+            emit(Op::set_index, 0, x);
+            break;
+        }
+        case ExpressionType::grouping_expression:
+        {
+            auto* x = static_cast<const GroupingExpression*>(expression);
+            compile(x->expression);
+            break;
+        }
+        case ExpressionType::literal_expression:
+        {
+            auto* x = static_cast<const LiteralExpression*>(expression);
+            emit(Op::push_constant, add_constant(x->value), nullptr);
+            break;
+        }
+        case ExpressionType::logical_expression:
+        {
+            auto* x = static_cast<const LogicalExpression*>(expression);
+            compile(x->left);
+            const auto short_circuit = emit
+            (
+                x->op == TokenType::OR ? Op::jump_if_true_no_pop : Op::jump_if_false_no_pop,
+                0, nullptr
+            );
+            emit(Op::pop, 0, nullptr);
+            compile(x->right);
+            patch_jump(short_circuit);
+            break;
+        }
+        case ExpressionType::unary_expression:
+        {
+            auto* x = static_cast<const UnaryExpression*>(expression);
+            compile(x->right);
+            emit(Op::unary, 0, x);
+            break;
+        }
+        case ExpressionType::variable_expression:
+        {
+            auto* x = static_cast<const VariableExpression*>(expression);
+            if(x->resolved_upvalue.has_value())
+            {
+                // upvalue cells belong to tree walking script functions
+                ok = false;
+                break;
+            }
+            emit(Op::get_var, 0, x);
+            break;
+        }
+        case ExpressionType::superconstructorcall_expression:
+        case ExpressionType::super_expression:
+        case ExpressionType::this_expression:
+            ok = false;
+            break;
+        default:
+            assert(false && "unhandled expression type in BytecodeCompiler");
+            ok = false;
+            break;
+        }
+    }
+};
+
+
+std::shared_ptr<Chunk>
+compile_program_or_null(const Program& program)
+{
+    auto chunk = std::make_shared<Chunk>();
+    auto compiler = BytecodeCompiler{chunk.get()};
+    compiler.compile(program.statements);
+    if(compiler.ok == false)
+    {
+        return nullptr;
+    }
+    return chunk;
+}
+
+
+// ---------------------------------------------------------------------------
+// cycle collector
+//
+// script objects are owned by shared_ptr, which cannot reclaim reference
+// cycles: a doubly linked structure, an instance storing a closure over
+// "this". the collector takes the tracked candidate objects, discovers
+// everything they reference, and counts how many of each node's owners sit
+// inside that graph. a node with owners left over is held by something
+// outside it -- the global environment, a native binding, the evaluation
+// state of an active call -- and roots everything it can reach. whatever is
+// not rooted only keeps itself alive: its references are dropped so plain
+// reference counting can finish the job.
+
+
+// collect automatically once this many tracked objects are alive
+constexpr std::size_t default_gc_pressure = 1024;
+
+
+// a node in the discovered ownership graph: script objects, environments
+// and upvalue cells all participate
+struct GcNode
+{
+    std::size_t use_count = 0;
+    std::size_t internal_references = 0;
+    bool reachable = false;
+
+    // keys of the nodes this one holds strong references to, duplicates
+    // are kept since every copy counts towards the target's use count
+    std::vector<const void*> references;
+};
+
+
+struct CycleCollector : GcReferenceVisitor
+{
+    std::unordered_map<const void*, GcNode> nodes;
+
+    // keep-alive copies so nothing is reclaimed while the graph is walked
+    std::vector<std::shared_ptr<Object>> known_objects;
+    std::vector<std::shared_ptr<Environment>> known_environments;
+    std::vector<std::shared_ptr<Value>> known_cells;
+
+    std::vector<Object*> pending_objects;
+    std::vector<Environment*> pending_environments;
+
+    // the node whose references are currently being reported
+    GcNode* current = nullptr;
+
+    void discover_object(const std::shared_ptr<Object>& object)
+    {
+        const auto inserted = nodes.try_emplace(object.get()).second;
+        if(inserted == false) { return; }
+        known_objects.emplace_back(object);
+        pending_objects.emplace_back(object.get());
+    }
+
+    void on_object(const std::shared_ptr<Object>& referenced) override
+    {
+        if(referenced == nullptr) { return; }
+        current->references.emplace_back(referenced.get());
+        discover_object(referenced);
+    }
+
+    void on_environment(const std::shared_ptr<Environment>& environment) override
+    {
+        if(environment == nullptr) { return; }
+        current->references.emplace_back(environment.get());
+        const auto inserted = nodes.try_emplace(environment.get()).second;
+        if(inserted == false) { return; }
+        known_environments.emplace_back(environment);
+        pending_environments.emplace_back(environment.get());
+    }
+
+    void on_cell(const std::shared_ptr<Value>& cell) override
+    {
+        if(cell == nullptr) { return; }
+        current->references.emplace_back(cell.get());
+        auto [found, inserted] = nodes.try_emplace(cell.get());
+        if(inserted == false) { return; }
+        known_cells.emplace_back(cell);
+        if(cell->object != nullptr)
+        {
+            found->second.references.emplace_back(cell->object.get());
+            discover_object(cell->object);
+        }
+    }
+
+    void expand_environment(Environment* environment)
+    {
+        for(const auto& entry: environment->values)
+        {
+            on_object(entry.second.object);
+        }
+        for(const auto& slot: environment->slots)
+        {
+            on_object(slot.object);
+        }
+        for(const auto& cell: environment->cells)
+        {
+            on_cell(cell);
+        }
+        on_environment(environment->enclosing);
+    }
+
+    void expand_all()
+    {
+        while(pending_objects.empty() == false || pending_environments.empty() == false)
+        {
+            if(pending_objects.empty() == false)
+            {
+                Object* object = pending_objects.back();
+                pending_objects.pop_back();
+                current = &nodes[object];
+                object->visit_references(this);
+            }
+            else
+            {
+                Environment* environment = pending_environments.back();
+                pending_environments.pop_back();
+                current = &nodes[environment];
+                expand_environment(environment);
+            }
+        }
+        current = nullptr;
+    }
+
+    // use counts are sampled from the keep-alive copies only after the walk
+    // is done, temporaries created while visiting would otherwise skew them;
+    // the -1 discounts the keep-alive itself
+    void sample_use_counts()
+    {
+        for(const auto& object: known_objects)
+        {
+            nodes[object.get()].use_count = static_cast<std::size_t>(object.use_count()) - 1;
+        }
+        for(const auto& environment: known_environments)
+        {
+            nodes[environment.get()].use_count = static_cast<std::size_t>(environment.use_count()) - 1;
+        }
+        for(const auto& cell: known_cells)
+        {
+            nodes[cell.get()].use_count = static_cast<std::size_t>(cell.use_count()) - 1;
+        }
+    }
+};
+
+
+struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
+{
+    Interpreter* interpreter;
+    ErrorHandler* error_handler;
+    std::shared_ptr<Environment> global_environment;
+    std::shared_ptr<Environment> current_environment;
+    // print output is appended here and flushed to the writer in
+    // batches, reusing this one allocation
+    LineWriter* writer;
+    std::string output_buffer;
+
+    std::unique_ptr<ObjectIntegration> integration;
+    std::unordered_map<std::size_t, std::shared_ptr<NativeKlass>> registered_klasses;
+
+    // functions and classes defined by a script keep raw pointers into the
+    // program's arena, so every interpreted program stays alive with us;
+    // a set since the compile cache reruns the same program many times
+    // and it only needs to be retained once
+    std::unordered_set<std::shared_ptr<const Program>> retained_programs;
+
+    // set when a return statement executes; statement loops check it and
+    // stop so the active call unwinds without throwing an exception
+    std::optional<Value> pending_return;
+
+    // true while a non-initializer script function body runs, meaning a
+    // call directly under a return can be deferred to that frame's loop
+    bool tail_call_allowed = false;
+    std::optional<TailCall> pending_tail_call;
+
+    // the innermost script function currently executing, owner of the
+    // upvalue cells that resolved_upvalue accesses index into
+    ScriptFunction* current_function = nullptr;
+
+    // every script object that can participate in a reference cycle --
+    // instances, script functions and arrays -- tracked weakly so plain
+    // reference counted death keeps working untouched
+    std::vector<std::weak_ptr<Object>> gc_tracked;
+    std::size_t gc_pressure = default_gc_pressure;
+
+    // inline property caches that have pinned a klass, reset on collection
+    // so a cache alone can't keep a dead klass cycle alive
+    std::vector<PropertyCache*> filled_property_caches;
+
+    // retired argument vectors, calls nest so this works like a stack;
+    // reusing them keeps the capacity so a call in a hot loop doesn't
+    // allocate a fresh vector every time
+    std::vector<std::vector<std::shared_ptr<Object>>> argument_buffers;
+
+    // borrows an argument vector from the pool and hands it back on scope
+    // exit, including when a runtime error unwinds past the call
+    struct PooledArguments
+    {
+        MainInterpreter* main;
+        Arguments args;
+
+        explicit PooledArguments(MainInterpreter* m)
+            : main(m)
+        {
+            if(main->argument_buffers.empty() == false)
+            {
+                args.arguments = std::move(main->argument_buffers.back());
+                main->argument_buffers.pop_back();
+            }
+        }
+
+        ~PooledArguments()
+        {
+            args.arguments.clear();
+            main->argument_buffers.emplace_back(std::move(args.arguments));
+        }
+
+        PooledArguments(PooledArguments&&) = delete;
+        PooledArguments(const PooledArguments&) = delete;
+        void operator=(PooledArguments&&) = delete;
+        void operator=(const PooledArguments&) = delete;
+    };
+
+    //-------------------------------------------------------------------------
+    // constructor
+
+    explicit MainInterpreter
+    (
+        Interpreter* inter,
+        std::shared_ptr<Environment> ge,
+        ErrorHandler* eh,
+        LineWriter* w
+    )
+        : interpreter(inter)
+        , error_handler(eh)
+        , global_environment(ge)
+        , writer(w)
+        , integration(make_object_integration())
+    {
+    }
+
+    //-------------------------------------------------------------------------
+    // execution budget
+
+    // the sentinel is high enough that an unlimited interpreter never
+    // reaches it, so the hot path below stays a single decrement-and-
+    // branch either way; see Interpreter::set_fuel_limit
+    static constexpr u64 no_fuel_limit = std::numeric_limits<u64>::max();
+    u64 fuel_remaining = no_fuel_limit;
+
+    // checked at loop back edges and function calls only
+    void
+    consume_fuel(const Offset& where)
+    {
+        fuel_remaining -= 1;
+        if(fuel_remaining == 0)
+        {
+            // stay exhausted until the host grants a new budget
+            fuel_remaining = 1;
+            error_handler->on_error(where, "execution budget exhausted");
+            throw RuntimeError{};
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    // print output
+
+    static constexpr std::size_t output_flush_threshold = 16 * 1024;
+
+    // the common flat case appends straight into the output buffer
+    // without the vector of lines the debug to_string builds
+    void
+    print_object(Object* obj)
+    {
+        obj->write_string(&output_buffer, interpreter, nullptr, ToStringOptions::for_print());
+        output_buffer += '\n';
+        if(output_buffer.size() >= output_flush_threshold)
+        {
+            flush_output();
+        }
+    }
+
+    void
+    flush_output()
+    {
+        if(output_buffer.empty())
+        {
+            return;
+        }
+        writer->write(output_buffer);
+        output_buffer.clear();
+    }
+
+    //---------------------------------------------------------------------------------------------
+    // cycle collection
+
+    void
+    track_object_for_gc(const std::shared_ptr<Object>& object)
+    {
+        gc_tracked.emplace_back(object);
+    }
+
+    std::size_t
+    collect_cycles()
+    {
+        // drop the inline caches first, they refill on the next access
+        for(PropertyCache* cache: filled_property_caches)
+        {
+            *cache = PropertyCache{};
+        }
+        filled_property_caches.clear();
+
+        // lock every tracked object that is still alive, compacting the
+        // expired entries away while here
+        auto candidates = std::vector<std::shared_ptr<Object>>{};
+        candidates.reserve(gc_tracked.size());
+        std::size_t live_count = 0;
+        for(auto& weak: gc_tracked)
+        {
+            if(auto locked = weak.lock(); locked != nullptr)
+            {
+                gc_tracked[live_count] = std::move(weak);
+                live_count += 1;
+                candidates.emplace_back(std::move(locked));
+            }
+        }
+        gc_tracked.resize(live_count);
+
+        auto collector = CycleCollector{};
+        for(const auto& candidate: candidates)
+        {
+            collector.discover_object(candidate);
+        }
+        collector.expand_all();
+        collector.sample_use_counts();
+
+        // the candidates vector is a second collector-side reference the
+        // sampling above can't know about
+        for(const auto& candidate: candidates)
+        {
+            collector.nodes[candidate.get()].use_count -= 1;
+        }
+
+        // count the owners that sit inside the graph, nodes owned by more
+        // than that are reachable from the outside and root their subgraph
+        for(auto& entry: collector.nodes)
+        {
+            for(const void* target: entry.second.references)
+            {
+                assert(collector.nodes.find(target) != collector.nodes.end());
+                collector.nodes[target].internal_references += 1;
+            }
+        }
+
+        auto reachable = std::vector<const void*>{};
+        for(auto& entry: collector.nodes)
+        {
+            assert(entry.second.internal_references <= entry.second.use_count);
+            if(entry.second.internal_references < entry.second.use_count)
+            {
+                entry.second.reachable = true;
+                reachable.emplace_back(entry.first);
+            }
+        }
+        while(reachable.empty() == false)
+        {
+            const void* key = reachable.back();
+            reachable.pop_back();
+            for(const void* target: collector.nodes[key].references)
+            {
+                auto& node = collector.nodes[target];
+                if(node.reachable == false)
+                {
+                    node.reachable = true;
+                    reachable.emplace_back(target);
+                }
+            }
+        }
+
+        // whatever is left only keeps itself alive: break the cycles and
+        // reference counting reclaims them as the keep-alives drop
+        std::size_t collected = 0;
+        for(const auto& candidate: candidates)
+        {
+            if(collector.nodes[candidate.get()].reachable == false)
+            {
+                candidate->clear_references();
+                collected += 1;
+            }
+        }
+        return collected;
+    }
+
+    void
+    maybe_collect_cycles()
+    {
+        if(gc_tracked.size() < gc_pressure)
+        {
+            return;
+        }
+        collect_cycles();
+        gc_pressure = std::max<std::size_t>(default_gc_pressure, gc_tracked.size() * 2);
+    }
+
+    //---------------------------------------------------------------------------------------------
+    // util functions
+
+    std::string
+    get_klass_name(std::size_t klass_index)
+    {
+        if(auto found = registered_klasses.find(klass_index); found != registered_klasses.end())
+        {
+            return found->second->klass_name;
+        }
+        else
+        {
+            return fmt::format("<unregistred native klass {}>", klass_index);
+        }
+    }
+
+    std::string
+    invalidarg_to_string(const InvalidArgumentType& invalid_arg_error)
+    {
+        if(invalid_arg_error.expected_type == ObjectType::native_instance)
+        {
+            assert(invalid_arg_error.native_klass);
+            return get_klass_name(*invalid_arg_error.native_klass);
+        }
+        else
+        {
+            return std::string{objecttype_to_string(invalid_arg_error.expected_type)};
+        }
+    }
+
+    std::string
+    smart_object_to_type_string(std::shared_ptr<Object> obj)
+    {
+        const auto type = obj->get_type();
+        if(type == ObjectType::native_instance)
+        {
+            // todo(Gustav): also include script klasses here?
+            auto native = std::static_pointer_cast<NativeInstance>(obj);
+            return native->klass->klass_name;
+        }
+        else
+        {
+            return std::string{objecttype_to_string(type)};
+        }
+    }
+
+    // switch on the node tag instead of the virtual accept, see
+    // dispatch() in the generated ast
+    Value
+    evaluate(const Expression* x)
+    {
+        return dispatch(*x, this);
+    }
+
+    void
+    execute(const Statement* x)
+    {
+        dispatch(*x, this);
+    }
+
+    Value
+    lookup_var(Environment& environment, const std::string& name, const Expression& x)
+    {
+        if(x.resolved_upvalue.has_value())
+        {
+            assert(current_function != nullptr);
+            return *current_function->upvalues[*x.resolved_upvalue];
+        }
+        else if(x.resolved_location.has_value())
+        {
+            auto r = environment.get_at_or_null(x.resolved_location->distance, x.resolved_location->slot);
+            assert(r.has_value());
+            return *r;
+        }
+        else
+        {
+            auto r = global_environment->get_or_null(name);
+            if(r.has_value() == false)
+            {
+                error_handler->on_error(x.offset, fmt::format("Undefined variable {}", name));
+                throw RuntimeError{};
+            }
+            return *r;
+        }
+    }
+
+    std::optional<std::size_t>
+    lookup_distance_for_var(const Expression& x)
+    {
+        if(x.resolved_location.has_value())
+        {
+            return x.resolved_location->distance;
+        }
+        else
+        {
+            return std::nullopt;
+        }
+    }
+
+    void
+    set_var_via_lookup(Environment& environment, const std::string& name, const Value& value, const Expression& x)
+    {
+        if(x.resolved_upvalue.has_value())
+        {
+            assert(current_function != nullptr);
+            *current_function->upvalues[*x.resolved_upvalue] = value;
+        }
+        else if(x.resolved_location.has_value())
+        {
+            [[maybe_unused]] auto r = environment.set_at_or_false(x.resolved_location->distance, x.resolved_location->slot, value);
+            assert(r == true);
+        }
+        else
+        {
+            const auto was_set = global_environment->set_or_false(name, value);
+            if(was_set == false)
+            {
+                const bool is_in_global = global_environment.get() == current_environment.get();
+                if(is_in_global)
+                {
+                    error_handler->on_error(x.offset, fmt::format("Global variable {} was never declared", name));
+                }
+                else
+                {
+                    error_handler->on_error(x.offset, fmt::format("Variable {} was neither declared in global nor local scope", name));
+                }
+                throw RuntimeError{};
+            }
+        }
+    }
+
+    // fill the upvalue cells for a closure being created here: either boxed
+    // locals visible from the creation site or cells the running closure
+    // itself captured
+    std::vector<std::shared_ptr<Value>>
+    collect_upvalues(const FunctionStatement& x)
+    {
+        std::vector<std::shared_ptr<Value>> upvalues;
+        upvalues.reserve(x.upvalue_sources.size());
+        for(const auto& source: x.upvalue_sources)
+        {
+            if(source.from_enclosing_upvalue)
+            {
+                assert(current_function != nullptr);
+                upvalues.emplace_back(current_function->upvalues[source.slot]);
+            }
+            else
+            {
+                upvalues.emplace_back(current_environment->get_cell_at(source.distance, source.slot));
+            }
+        }
+        return upvalues;
+    }
+
+    Value
+    get_var(Environment& environment, const std::string& name, const Offset& off)
+    {
+        auto var = environment.get_or_null(name);
+        if(var.has_value() == false)
+        {
+            error_handler->on_error(off, "Undefined variable");
             throw RuntimeError{};
         }
-        return var;
+        return *var;
     }
 
     void
-    set_var(Environment& environment, const std::string& name, const Offset& off, std::shared_ptr<Object> object)
+    set_var(Environment& environment, const std::string& name, const Offset& off, const Value& object)
     {
         const bool was_set = environment.set_or_false(name, object);
         if(was_set == false)
@@ -783,41 +1726,41 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
         if(x.parent != nullptr)
         {
             auto parent = evaluate(x.parent);
-            if(parent != nullptr)
+            if(parent.get_type() != ObjectType::klass)
             {
-                if(parent->get_type() != ObjectType::klass)
-                {
-                    error_handler->on_error
-                    (
-                        x.parent->offset,
-                        fmt::format(
-                            "Superclass must be a class, was {}",
-                            objecttype_to_string(parent->get_type())
-                        )
-                    );
-                    throw RuntimeError{};
-                }
-                else
-                {
-                    superklass = std::static_pointer_cast<Klass>(parent);
-                }
+                error_handler->on_error
+                (
+                    x.parent->offset,
+                    fmt::format(
+                        "Superclass must be a class, was {}",
+                        objecttype_to_string(parent.get_type())
+                    )
+                );
+                throw RuntimeError{};
+            }
+            else
+            {
+                superklass = as_klass(parent);
             }
         }
 
-        auto new_klass = std::make_shared<ScriptKlass>(x.name, superklass, this, x.members);
-        current_environment->define(x.name, new_klass);
+        auto new_klass = make_tracked<ScriptKlass>(x.name, superklass, this, x.members);
+        current_environment->define(x.name, new_klass, x.is_captured);
 
         for(const auto& method: x.static_methods)
         {
-            auto function = std::make_shared<ScriptFunction>
+            auto function = make_tracked<ScriptFunction>
             (
                 this,
-                current_environment,
-                current_state,
-                fmt::format("static method {}", method->name), method->params, method->body,
+                global_environment,
+                fmt::format("static method {}", method->name),
+                method->params, method->param_is_captured, method->body,
+                collect_upvalues(*method),
+                false,
                 false
             );
 
+            track_object_for_gc(function);
             auto added = new_klass->add_static_method_or_false(method->name, std::move(function));
             if(added == false)
             {
@@ -827,26 +1770,30 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
             }
         }
 
-        std::shared_ptr<Environment> backup_environment;
+        // methods see "super" through a tiny environment of their own that
+        // sits directly on the global one, not the whole defining chain
+        std::shared_ptr<Environment> method_closure = global_environment;
         if(superklass != nullptr)
         {
-            backup_environment = current_environment;
-            current_environment = std::make_shared<Environment>(current_environment);
-            current_environment->define("super", superklass);
+            method_closure = std::make_shared<Environment>(global_environment);
+            method_closure->define("super", superklass, true);
         }
-        
+
         // std::unordered_map<std::string, std::shared_ptr<ScriptFunction>> method_list;
         for(const auto& method: x.methods)
         {
-            auto function = std::make_shared<ScriptFunction>
+            auto function = make_tracked<ScriptFunction>
             (
                 this,
-                current_environment,
-                current_state,
-                fmt::format("mtd {} ({})", method->name,method->params), method->params, method->body,
+                method_closure,
+                fmt::format("mtd {} ({})", method->name,method->params),
+                method->params, method->param_is_captured, method->body,
+                collect_upvalues(*method),
+                x.this_is_captured,
                 method->name == "init"
             );
 
+            track_object_for_gc(function);
             auto added = new_klass->add_method_or_false(method->name, std::move(function));
             if(added == false)
             {
@@ -856,10 +1803,7 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
             }
         }
 
-        if(superklass != nullptr)
-        {
-            current_environment = backup_environment;
-        }
+        new_klass->flatten_method_table();
 
         [[maybe_unused]] const auto set = current_environment->set_or_false
         (
@@ -872,14 +1816,39 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
     void
     on_return_statement(const ReturnStatement& x) override
     {
-        std::shared_ptr<Object> value;
+        if(tail_call_allowed && x.value != nullptr && x.value->get_type() == ExpressionType::call_expression)
+        {
+            const auto* call = static_cast<const CallExpression*>(x.value);
+            auto callee = evaluate(call->callee);
+            auto function = require_callable_for_call(*call, callee.as_object());
+
+            std::vector<std::shared_ptr<Object>> arguments;
+            for(auto& argument : call->arguments)
+            {
+                arguments.emplace_back(evaluate(argument).as_object());
+            }
+
+            auto script_function = std::dynamic_pointer_cast<ScriptFunction>(function);
+            if(script_function != nullptr && script_function->is_initializer == false)
+            {
+                pending_tail_call = TailCall{std::move(script_function), std::move(arguments)};
+                pending_return = Value{};
+                return;
+            }
+
+            // not a plain script function, call it here like any other site
+            pending_return = Value{call_callable_with_arguments(*call, function, Arguments{std::move(arguments)})};
+            return;
+        }
+
+        Value value;
 
         if(x.value != nullptr)
         {
             value = evaluate(x.value);
         }
 
-        throw ReturnValue{value};
+        pending_return = value;
     }
 
     void
@@ -902,58 +1871,100 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
     on_block_statement(const BlockStatement& x) override
     {
         auto block_env = std::make_shared<Environment>(current_environment);
-        execute_statements_with_environment(x.statements, block_env, current_state);
+        execute_statements_with_environment(x.statements, block_env);
     }
 
     void
     on_function_statement(const FunctionStatement& x) override
     {
         assert(current_environment);
-        assert(current_state);
-        current_environment->define
+
+        // define the name first so a recursive function can capture its
+        // own cell, then fill in the actual function
+        current_environment->define(x.name, Value{}, x.is_captured);
+
+        auto function = make_tracked<ScriptFunction>
         (
-            x.name, std::make_shared<ScriptFunction>
-            (
-                this,
-                current_environment,
-                current_state,
-                fmt::format("fn {}", x.name), x.params, x.body, false
-            )
+            this,
+            global_environment,
+            fmt::format("fn {}", x.name), x.params, x.param_is_captured, x.body,
+            collect_upvalues(x), false, false
         );
+
+        track_object_for_gc(function);
+        [[maybe_unused]] const auto was_set = current_environment->set_or_false(x.name, Value{function});
+        assert(was_set);
     }
 
     void
     execute_statements_with_environment
     (
-        const std::vector<std::shared_ptr<Statement>>& statements,
-        std::shared_ptr<Environment> environment,
-        std::shared_ptr<State> state
+        const std::vector<Statement*>& statements,
+        std::shared_ptr<Environment> environment
     )
     {
         auto env_raii = SharedptrRaii<Environment>{&current_environment, environment};
-        auto state_raii = SharedptrRaii<State>{&current_state, state};
         for(const auto& st: statements)
         {
             execute(st);
+            if(pending_return.has_value())
+            {
+                break;
+            }
         }
     }
 
     void
     on_while_statement(const WhileStatement& x) override
     {
+        // a block body whose locals are never captured can run every
+        // iteration in the same environment, cleared between laps, instead
+        // of allocating a fresh one per iteration; captured locals need a
+        // distinct cell per iteration so those bodies keep the normal path
+        const BlockStatement* reusable_body = nullptr;
+        if(x.body->get_type() == StatementType::block_statement)
+        {
+            const auto* block = static_cast<const BlockStatement*>(x.body);
+            if(block->has_captured_declarations == false)
+            {
+                reusable_body = block;
+            }
+        }
+
+        std::shared_ptr<Environment> reused_environment;
         while(is_truthy(evaluate(x.condition)))
         {
-            execute(x.body);
+            consume_fuel(x.offset);
+            if(reusable_body != nullptr)
+            {
+                if(reused_environment == nullptr)
+                {
+                    reused_environment = std::make_shared<Environment>(current_environment);
+                }
+                else
+                {
+                    reused_environment->clear_locals();
+                }
+                execute_statements_with_environment(reusable_body->statements, reused_environment);
+            }
+            else
+            {
+                execute(x.body);
+            }
+            if(pending_return.has_value())
+            {
+                break;
+            }
         }
     }
 
-    std::shared_ptr<Object>
+    Value
     create_value(const VarStatement& x)
     {
         // todo(Gustav): make usage of unitialized value an error
         return x.initializer != nullptr
             ? evaluate(x.initializer)
-            : make_nil()
+            : Value{}
             ;
     }
 
@@ -961,18 +1972,14 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
     on_var_statement(const VarStatement& x) override
     {
         auto value = create_value(x);
-        current_environment->define(x.name, value);
+        current_environment->define(x.name, value, x.is_captured);
     }
 
     void
     on_print_statement(const PrintStatement& x) override
     {
         auto value = evaluate(x.expression);
-        const auto to_print = value->to_string(interpreter, nullptr, ToStringOptions::for_print());
-        for(const auto& p: to_print)
-        {
-            on_line(p);
-        }
+        print_object(value.as_object().get());
     }
 
     void
@@ -985,22 +1992,37 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
     //---------------------------------------------------------------------------------------------
     // expressions
 
-    std::shared_ptr<Object>
+    Value
     on_array_expression(const ArrayExpression& x) override
     {
         std::vector<std::shared_ptr<Object>> values;
         for(auto& val : x.values)
-        { 
-            values.emplace_back(evaluate(val));
+        {
+            values.emplace_back(evaluate(val).as_object());
         }
-        return integration->make_array(std::move(values));
+        auto array = integration->make_array(std::move(values));
+        track_object_for_gc(array);
+        return array;
     }
 
-    std::shared_ptr<Object>
+    Value
     on_call_expression(const CallExpression& x) override
     {
         auto callee = evaluate(x.callee);
-        
+        auto function = require_callable_for_call(x, callee.as_object());
+
+        auto pooled = PooledArguments{this};
+        for(auto& argument : x.arguments)
+        {
+            pooled.args.arguments.emplace_back(evaluate(argument).as_object());
+        }
+
+        return call_callable_with_arguments(x, function, pooled.args);
+    }
+
+    std::shared_ptr<Callable>
+    require_callable_for_call(const CallExpression& x, std::shared_ptr<Object> callee)
+    {
         auto function = as_callable(callee);
         if(function == nullptr)
         {
@@ -1020,20 +2042,20 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
             throw RuntimeError{};
         }
 
-        std::vector<std::shared_ptr<Object>> arguments;
-        for(auto& argument : x.arguments)
-        { 
-            arguments.emplace_back(evaluate(argument));
-        }
+        return function;
+    }
 
+    std::shared_ptr<Object>
+    call_callable_with_arguments(const CallExpression& x, std::shared_ptr<Callable> function, const Arguments& arguments)
+    {
         try
         {
-            auto return_value = function->call(interpreter, {arguments});
+            auto return_value = function->call(interpreter, arguments);
             return return_value;
         }
         catch(const InvalidArgumentType& invalid_arg_error)
         {
-            auto invalid_arg_value = arguments[invalid_arg_error.argument_index];
+            auto invalid_arg_value = arguments.arguments[invalid_arg_error.argument_index];
             // special case for nil, no need to write the value of nil
             const auto actual_type = invalid_arg_value->get_type();
             if(actual_type == ObjectType::nil)
@@ -1076,9 +2098,9 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
                     fmt::format(
                         "argument {} evaluated to {}: ",
                         argument_index + 1,
-                        objecttype_to_string(arguments[argument_index]->get_type())
+                        objecttype_to_string(arguments.arguments[argument_index]->get_type())
                     ),
-                    arguments[argument_index]
+                    arguments.arguments[argument_index]
                 );
             }
             throw RuntimeError{};
@@ -1095,40 +2117,69 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
     }
 
 
-    std::shared_ptr<Object>
-    on_superconstructorcall_expression(const SuperConstructorCallExpression& x) override
-    {
-        auto op_distance = lookup_distance_for_var(x);
-        assert(op_distance);
-        auto distance = *op_distance;
-        assert(distance > 0);
+    Value
+    on_superconstructorcall_expression(const SuperConstructorCallExpression& x) override
+    {
+        std::optional<Value> base_super;
+        std::optional<Value> base_object;
+
+        if(x.resolved_upvalue.has_value())
+        {
+            // inside a nested function both "super" and "this" come from cells
+            assert(current_function != nullptr);
+            assert(x.this_upvalue.has_value());
+            base_super = *current_function->upvalues[*x.resolved_upvalue];
+            base_object = *current_function->upvalues[*x.this_upvalue];
+        }
+        else
+        {
+            auto op_distance = lookup_distance_for_var(x);
+            assert(op_distance);
+            auto distance = *op_distance;
+            assert(distance > 0);
+
+            // "super" and "this" are both alone in their synthetic scopes, slot 0
+            base_super = current_environment->get_at_or_null(distance, 0);
+            base_object = current_environment->get_at_or_null(distance-1, 0);
+        }
 
-        auto base_super = current_environment->get_at_or_null(distance, "super");
-        assert(base_super != nullptr);
+        assert(base_super.has_value());
         assert(base_super->get_type() == ObjectType::klass);
-        auto superklass = std::static_pointer_cast<Klass>(base_super);
+        auto superklass = std::static_pointer_cast<Klass>(base_super->object);
 
-        auto base_object = current_environment->get_at_or_null(distance-1, "this");
-        assert(base_object != nullptr);
+        assert(base_object.has_value());
         assert(base_object->get_type() == ObjectType::instance);
 
-        auto base_instance = std::static_pointer_cast<Instance>(base_object);
+        auto base_instance = std::static_pointer_cast<Instance>(base_object->object);
 
-        std::vector<std::shared_ptr<Object>> arguments;
+        auto pooled = PooledArguments{this};
         for(auto& argument : x.arguments)
-        { 
-            arguments.emplace_back(evaluate(argument));
+        {
+            pooled.args.arguments.emplace_back(evaluate(argument).as_object());
         }
-        
-        base_instance->parent = superklass->constructor(interpreter, {arguments});
+
+        base_instance->parent = superklass->constructor(interpreter, pooled.args);
         return base_instance->parent;
     }
 
-    std::shared_ptr<Object>
+    Value
     on_constructor_expression(const ConstructorExpression& x) override
     {
         auto klass_object = evaluate(x.klass);
-        
+        auto klass = require_klass_for_construction(x, klass_object.as_object());
+
+        auto pooled = PooledArguments{this};
+        for(auto& argument : x.arguments)
+        {
+            pooled.args.arguments.emplace_back(evaluate(argument).as_object());
+        }
+
+        return construct_with_arguments(x, klass, pooled.args);
+    }
+
+    std::shared_ptr<Klass>
+    require_klass_for_construction(const ConstructorExpression& x, std::shared_ptr<Object> klass_object)
+    {
         auto klass = as_klass(klass_object);
         if(klass == nullptr)
         {
@@ -1145,20 +2196,20 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
             throw RuntimeError{};
         }
 
-        std::vector<std::shared_ptr<Object>> arguments;
-        for(auto& argument : x.arguments)
-        { 
-            arguments.emplace_back(evaluate(argument));
-        }
+        return klass;
+    }
 
+    std::shared_ptr<Object>
+    construct_with_arguments(const ConstructorExpression& x, std::shared_ptr<Klass> klass, const Arguments& arguments)
+    {
         try
         {
-            auto return_value = klass->constructor(interpreter, {arguments});
+            auto return_value = klass->constructor(interpreter, arguments);
             return return_value;
         }
         catch(const InvalidArgumentType& invalid_arg_error)
         {
-            auto invalid_arg_value = arguments[invalid_arg_error.argument_index];
+            auto invalid_arg_value = arguments.arguments[invalid_arg_error.argument_index];
             // special case for nil, no need to write the value of nil
             const auto actual_type = invalid_arg_value->get_type();
             if(actual_type == ObjectType::nil)
@@ -1200,9 +2251,9 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
                     fmt::format(
                         "argument {} evaluated to {}: ",
                         argument_index + 1,
-                        objecttype_to_string(arguments[argument_index]->get_type())
+                        objecttype_to_string(arguments.arguments[argument_index]->get_type())
                     ),
-                    arguments[argument_index]
+                    arguments.arguments[argument_index]
                 );
             }
             throw RuntimeError{};
@@ -1218,13 +2269,35 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
         }
     }
 
-    std::shared_ptr<Object>
+    Value
     on_getproperty_expression(const GetPropertyExpression& x) override
     {
         auto object = evaluate(x.object);
+        return get_property_from_evaluated(x, object.as_object());
+    }
+
+    std::shared_ptr<Object>
+    get_property_from_evaluated(const GetPropertyExpression& x, std::shared_ptr<Object> object)
+    {
         if(object->has_properties())
         {
-            auto r = object->get_property_or_null(x.name);
+            // script instances go through the call-site inline cache,
+            // everything else (and frozen shared programs, whose nodes
+            // must never be written) takes the regular virtual lookup
+            const bool use_cache = object->get_type() == ObjectType::instance && x.property_cache.frozen == false;
+            const bool cache_was_empty = x.property_cache.seen_klass == nullptr;
+            auto r = use_cache
+                ? std::static_pointer_cast<Instance>(object)->get_property_or_null(get_name_symbol(x, x.name), x.property_cache)
+                : object->get_property_or_null(get_name_symbol(x, x.name));
+
+            if(use_cache && cache_was_empty)
+            {
+                LOX_TRACE(property_cache_miss);
+                if(x.property_cache.seen_klass != nullptr)
+                {
+                    filled_property_caches.emplace_back(&x.property_cache);
+                }
+            }
 
             if(r == nullptr)
             {
@@ -1247,12 +2320,17 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
         throw RuntimeError{};
     }
 
-    std::shared_ptr<Object>
+    Value
     on_setproperty_expression(const SetPropertyExpression& x) override
     {
         auto object = evaluate(x.object);
         auto value = evaluate(x.value);
+        return set_property_on_evaluated(x, object.as_object(), value.as_object());
+    }
 
+    std::shared_ptr<Object>
+    set_property_on_evaluated(const SetPropertyExpression& x, std::shared_ptr<Object> object, std::shared_ptr<Object> value)
+    {
         if(object->has_properties() == false)
         {
             report_error_no_properties(interpreter, x.offset, error_handler, object);
@@ -1261,7 +2339,20 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
 
         try
         {
-            const auto was_set = object->set_property_or_false(x.name, value);
+            const bool use_cache = object->get_type() == ObjectType::instance && x.property_cache.frozen == false;
+            const bool cache_was_empty = x.property_cache.seen_klass == nullptr;
+            const auto was_set = use_cache
+                ? std::static_pointer_cast<Instance>(object)->set_property_or_false(get_name_symbol(x, x.name), value, x.property_cache)
+                : object->set_property_or_false(get_name_symbol(x, x.name), value);
+
+            if(use_cache && cache_was_empty)
+            {
+                LOX_TRACE(property_cache_miss);
+                if(x.property_cache.seen_klass != nullptr)
+                {
+                    filled_property_caches.emplace_back(&x.property_cache);
+                }
+            }
 
             if(was_set == false)
             {
@@ -1315,12 +2406,17 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
         return value;
     }
 
-    std::shared_ptr<Object>
+    Value
     on_getindex_expression(const GetIndexExpression& x) override
     {
         auto object = evaluate(x.object);
         auto index = evaluate(x.index);
-        
+        return get_index_from_evaluated(x, object.as_object(), index.as_object());
+    }
+
+    std::shared_ptr<Object>
+    get_index_from_evaluated(const GetIndexExpression& x, std::shared_ptr<Object> object, std::shared_ptr<Object> index)
+    {
         if(object->has_index())
         {
             try
@@ -1342,7 +2438,7 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
             }
             catch(const NativeError& err)
             {
-                error_handler->on_error(x.offset, err.message);
+                error_handler->on_error(x.offset, err.build_message());
                 report_note_object
                 (
                     interpreter, error_handler, x.object->offset, "object evaluated to ", object
@@ -1360,13 +2456,18 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
         throw RuntimeError{};
     }
 
-    std::shared_ptr<Object>
+    Value
     on_setindex_expression(const SetIndexExpression& x) override
     {
         auto object = evaluate(x.object);
         auto index = evaluate(x.index);
         auto value = evaluate(x.value);
+        return set_index_on_evaluated(x, object.as_object(), index.as_object(), value.as_object());
+    }
 
+    std::shared_ptr<Object>
+    set_index_on_evaluated(const SetIndexExpression& x, std::shared_ptr<Object> object, std::shared_ptr<Object> index, std::shared_ptr<Object> value)
+    {
         if(object->has_index() == false)
         {
             report_error_no_indexer(interpreter, x.offset, error_handler, object);
@@ -1391,7 +2492,7 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
         }
         catch(const NativeError& err)
         {
-            error_handler->on_error(x.offset, err.message);
+            error_handler->on_error(x.offset, err.build_message());
             report_note_object
             (
                 interpreter, error_handler, x.object->offset, "object evaluated to ", object
@@ -1450,19 +2551,33 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
         return value;
     }
 
-    std::shared_ptr<Object>
+    Value
     on_super_expression(const SuperExpression& x) override
     {
-        auto op_distance = lookup_distance_for_var(x);
-        assert(op_distance);
-        auto distance = *op_distance;
-        assert(distance > 0);
+        std::optional<Value> base_object;
+
+        if(x.resolved_upvalue.has_value())
+        {
+            // inside a nested function "this" comes from a captured cell
+            assert(current_function != nullptr);
+            assert(x.this_upvalue.has_value());
+            base_object = *current_function->upvalues[*x.this_upvalue];
+        }
+        else
+        {
+            auto op_distance = lookup_distance_for_var(x);
+            assert(op_distance);
+            auto distance = *op_distance;
+            assert(distance > 0);
+
+            // "this" is alone in the synthetic scope bind() created, slot 0
+            base_object = current_environment->get_at_or_null(distance-1, 0);
+        }
 
-        auto base_object = current_environment->get_at_or_null(distance-1, "this");
-        assert(base_object != nullptr);
+        assert(base_object.has_value());
         assert(base_object->get_type() == ObjectType::instance);
 
-        auto base_instance = std::static_pointer_cast<Instance>(base_object);
+        auto base_instance = std::static_pointer_cast<Instance>(base_object->object);
         auto object = base_instance->parent;
         if(object == nullptr)
         {
@@ -1474,16 +2589,16 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
             throw RuntimeError{};
         }
 
-        return object->get_property_or_null(x.property);
+        return object->get_property_or_null(get_name_symbol(x, x.property));
     }
     
-    std::shared_ptr<Object>
+    Value
     on_this_expression(const ThisExpression& x) override
     {
         return lookup_var(*current_environment, "this", x);
     }
 
-    std::shared_ptr<Object>
+    Value
     on_logical_expression(const LogicalExpression& x) override
     {
         auto left = evaluate(x.left);
@@ -1510,149 +2625,693 @@ struct MainInterpreter : ExpressionObjectVisitor, StatementVoidVisitor
         return evaluate(x.right);
     }
 
-    std::shared_ptr<Object>
+    Value
     on_assign_expression(const AssignExpression& x) override
     {
+        // templating scripts build output with `s = s + part`; when the
+        // target is also the left operand of the + that string can grow
+        // in place instead of being copied whole, which makes the loop
+        // linear instead of quadratic
+        if(x.value->get_type() == ExpressionType::binary_expression)
+        {
+            const auto& add = *static_cast<const BinaryExpression*>(x.value);
+            if(add.op == TokenType::PLUS && add.left->get_type() == ExpressionType::variable_expression)
+            {
+                const auto& source = *static_cast<const VariableExpression*>(add.left);
+                if(source.name == x.name && refers_to_same_variable(x, source))
+                {
+                    return append_to_self_assignment(x, add, source);
+                }
+            }
+        }
+
         auto value = evaluate(x.value);
 
         set_var_via_lookup(*current_environment, x.name, value, x);
         return value;
     }
 
-    std::shared_ptr<Object>
+    // true when the assignment target and the variable read resolve to
+    // the same storage, not just the same spelling
+    static bool
+    refers_to_same_variable(const AssignExpression& a, const VariableExpression& v)
+    {
+        if(a.resolved_upvalue.has_value() || v.resolved_upvalue.has_value())
+        {
+            return a.resolved_upvalue == v.resolved_upvalue;
+        }
+        if(a.resolved_location.has_value() != v.resolved_location.has_value())
+        {
+            return false;
+        }
+        if(a.resolved_location.has_value())
+        {
+            return a.resolved_location->distance == v.resolved_location->distance
+                && a.resolved_location->slot == v.resolved_location->slot;
+        }
+        // both unresolved means both are globals looked up by name
+        return true;
+    }
+
+    Value
+    append_to_self_assignment(const AssignExpression& x, const BinaryExpression& add, const VariableExpression& source)
+    {
+        // same evaluation order as the generic visit: the left variable
+        // read first (it can throw on an undefined name), then the right
+        auto current = lookup_var(*current_environment, source.name, source);
+        auto right = evaluate(add.right);
+
+        if(current.get_type() == ObjectType::string && right.get_type() == ObjectType::string)
+        {
+            // the right side may have rebound or aliased the variable;
+            // appending is only safe while the slot still holds this
+            // exact string and the three handles here are its only users
+            const auto latest = lookup_var(*current_environment, source.name, source);
+            if(latest.object == current.object && current.object.use_count() == 3)
+            {
+                string_append_in_place(current.object.get(), get_string_or_ub(right));
+                return current;
+            }
+        }
+
+        // everything else goes through the generic operator without
+        // re-evaluating either side
+        auto value = evaluate_binary_operation(add, current, right);
+        set_var_via_lookup(*current_environment, x.name, value, x);
+        return value;
+    }
+
+    Value
     on_variable_expression(const VariableExpression& x) override
     {
         return lookup_var(*current_environment, x.name, x);
         // return get_var(*current_environment, x.name, x.offset);
     }
 
-    std::shared_ptr<Object>
+    Value
     on_binary_expression(const BinaryExpression& x) override
     {
-        // todo(Gustav): make binary operators more flexible string*int should duplicate string
-        // todo(Gustav): string + (other) should stringify other?
         auto left = evaluate(x.left);
         auto right = evaluate(x.right);
+        return evaluate_binary_operation(x, left, right);
+    }
+
+    // unchecked fast path for a site quickened to int/int operands; results
+    // mirror the generic visit exactly, so comparisons go through the same
+    // float conversion and keep their behaviour on huge ints
+    Value
+    evaluate_int_int_operation(const BinaryExpression& x, Ti lhs, Ti rhs)
+    {
+        switch(x.op)
+        {
+        case TokenType::MINUS: return Value::from_int(lhs - rhs);
+        case TokenType::PLUS: return Value::from_int(lhs + rhs);
+        case TokenType::SLASH: return Value::from_float(static_cast<Tf>(lhs) / static_cast<Tf>(rhs));
+        case TokenType::STAR: return Value::from_float(static_cast<Tf>(lhs) * static_cast<Tf>(rhs));
+        case TokenType::LESS: return Value::from_bool(static_cast<Tf>(lhs) < static_cast<Tf>(rhs));
+        case TokenType::LESS_EQUAL: return Value::from_bool(static_cast<Tf>(lhs) <= static_cast<Tf>(rhs));
+        case TokenType::GREATER: return Value::from_bool(static_cast<Tf>(lhs) > static_cast<Tf>(rhs));
+        case TokenType::GREATER_EQUAL: return Value::from_bool(static_cast<Tf>(lhs) >= static_cast<Tf>(rhs));
+        case TokenType::BANG_EQUAL: return Value::from_bool(lhs != rhs);
+        case TokenType::EQUAL_EQUAL: return Value::from_bool(lhs == rhs);
+        default:
+            assert(false && "unhandled token in evaluate_int_int_operation(...)");
+            return Value{};
+        }
+    }
+
+    // unchecked fast path for a site quickened to float/float operands;
+    // equality never quickens here so the generic visit keeps defining it
+    Value
+    evaluate_float_float_operation(const BinaryExpression& x, Tf lhs, Tf rhs)
+    {
+        switch(x.op)
+        {
+        case TokenType::MINUS: return Value::from_float(lhs - rhs);
+        case TokenType::PLUS: return Value::from_float(lhs + rhs);
+        case TokenType::SLASH: return Value::from_float(lhs / rhs);
+        case TokenType::STAR: return Value::from_float(lhs * rhs);
+        case TokenType::LESS: return Value::from_bool(lhs < rhs);
+        case TokenType::LESS_EQUAL: return Value::from_bool(lhs <= rhs);
+        case TokenType::GREATER: return Value::from_bool(lhs > rhs);
+        case TokenType::GREATER_EQUAL: return Value::from_bool(lhs >= rhs);
+        default:
+            assert(false && "unhandled token in evaluate_float_float_operation(...)");
+            return Value{};
+        }
+    }
+
+    // what a site that just ran generically should be tagged as next time
+    static BinaryQuickening
+    quickening_for(TokenType op, const Value& left, const Value& right)
+    {
+        const auto left_type = left.get_type();
+        const auto right_type = right.get_type();
+        if(left_type == ObjectType::number_int && right_type == ObjectType::number_int)
+        {
+            return BinaryQuickening::int_int;
+        }
+        if(left_type == ObjectType::number_float && right_type == ObjectType::number_float)
+        {
+            if(x_op_is_equality(op))
+            {
+                return BinaryQuickening::generic;
+            }
+            return BinaryQuickening::float_float;
+        }
+        return BinaryQuickening::generic;
+    }
+
+    static bool
+    x_op_is_equality(TokenType op)
+    {
+        return op == TokenType::BANG_EQUAL || op == TokenType::EQUAL_EQUAL;
+    }
+
+    Value
+    evaluate_binary_operation(const BinaryExpression& x, const Value& left, const Value& right)
+    {
+        switch(x.quickening)
+        {
+        case BinaryQuickening::int_int:
+            if(left.get_type() == ObjectType::number_int && right.get_type() == ObjectType::number_int)
+            {
+                return evaluate_int_int_operation(x, get_int_or_ub(left), get_int_or_ub(right));
+            }
+            // the site isn't monomorphic after all, deopt for good
+            x.quickening = BinaryQuickening::generic;
+            break;
+        case BinaryQuickening::float_float:
+            if(left.get_type() == ObjectType::number_float && right.get_type() == ObjectType::number_float)
+            {
+                return evaluate_float_float_operation(x, get_float_or_ub(left), get_float_or_ub(right));
+            }
+            x.quickening = BinaryQuickening::generic;
+            break;
+        case BinaryQuickening::none:
+            x.quickening = quickening_for(x.op, left, right);
+            break;
+        case BinaryQuickening::generic:
+            break;
+        }
 
+        // todo(Gustav): make binary operators more flexible string*int should duplicate string
+        // todo(Gustav): string + (other) should stringify other?
         switch(x.op)
         {
         case TokenType::MINUS:
             check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
-            if(left->get_type() == ObjectType::number_float || right->get_type() == ObjectType::number_float)
+            if(left.get_type() == ObjectType::number_float || right.get_type() == ObjectType::number_float)
             {
-                return make_number_float( get_number_as_float(left) - get_number_as_float(right) );
+                return Value::from_float( get_number_as_float(left) - get_number_as_float(right) );
             }
             else
             {
-                return make_number_int( get_int_or_ub(left) - get_int_or_ub(right) );
+                return Value::from_int( get_int_or_ub(left) - get_int_or_ub(right) );
             }
         case TokenType::SLASH:
             check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
-            return make_number_float( get_number_as_float(left) / get_number_as_float(right) );
+            return Value::from_float( get_number_as_float(left) / get_number_as_float(right) );
         case TokenType::STAR:
             check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
-            return make_number_float( get_number_as_float(left) * get_number_as_float(right) );
+            return Value::from_float( get_number_as_float(left) * get_number_as_float(right) );
         case TokenType::PLUS:
             check_binary_number_or_string_operands(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
-            if(is_number(left->get_type()) && is_number(right->get_type()))
+            if(is_number(left.get_type()) && is_number(right.get_type()))
+            {
+                if(left.get_type() == ObjectType::number_float || right.get_type() == ObjectType::number_float)
+                {
+                    return Value::from_float( get_number_as_float(left) + get_number_as_float(right) );
+                }
+                else
+                {
+                    return Value::from_int( get_int_or_ub(left) + get_int_or_ub(right) );
+                }
+            }
+            else if(left.get_type() == ObjectType::string && right.get_type() == ObjectType::string)
+            {
+                return make_string( get_string_or_ub(left) + get_string_or_ub(right) );
+            }
+            else
+            {
+                assert(false && "interpreter error");
+                return Value{};
+            }
+        case TokenType::LESS:
+            check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
+            return Value::from_bool( get_number_as_float(left) < get_number_as_float(right) );
+        case TokenType::LESS_EQUAL:
+            check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
+            return Value::from_bool( get_number_as_float(left) <= get_number_as_float(right) );
+        case TokenType::GREATER:
+            check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
+            return Value::from_bool( get_number_as_float(left) > get_number_as_float(right) );
+        case TokenType::GREATER_EQUAL:
+            check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
+            return Value::from_bool( get_number_as_float(left) >= get_number_as_float(right) );
+        case TokenType::BANG_EQUAL:
+            return Value::from_bool( !is_equal(left, right) );
+        case TokenType::EQUAL_EQUAL:
+            return Value::from_bool( is_equal(left, right) );
+        default:
+            assert(false && "unhandled token in Interpreter::on_binary_expression(...)");
+            return Value{};
+        }
+    }
+
+    Value
+    on_grouping_expression(const GroupingExpression& x) override
+    {
+        return evaluate(x.expression);
+    }
+
+    Value
+    on_literal_expression(const LiteralExpression& x) override
+    {
+        return x.value;
+    }
+
+    Value
+    on_unary_expression(const UnaryExpression& x) override
+    {
+        auto right = evaluate(x.right);
+        return evaluate_unary_operation(x, right);
+    }
+
+    Value
+    evaluate_unary_operation(const UnaryExpression& x, const Value& right)
+    {
+        switch(x.op)
+        {
+        case TokenType::BANG:
+            return Value::from_bool(!is_truthy(right));
+        case TokenType::MINUS:
+            check_single_number_operand(error_handler, x.op_offset, right, x.right->offset);
+            if(right.get_type() == ObjectType::number_float)
+            {
+                return Value::from_float(-get_float_or_ub(right));
+            }
+            else
+            {
+                assert(right.get_type() == ObjectType::number_int);
+                return Value::from_int(-get_int_or_ub(right));
+            }
+        default:
+            assert(false && "unreachable");
+            return Value{};
+        }
+    }
+
+
+    //---------------------------------------------------------------------------------------------
+    // bytecode dispatch loop
+
+    Value
+    run_chunk
+    (
+        const Chunk& chunk,
+        std::shared_ptr<Environment> environment
+    )
+    {
+        auto env_raii = SharedptrRaii<Environment>{&current_environment, environment};
+
+        // block environments parked between iterations of a loop, keyed by
+        // the block so the matching push_scope picks its own back up
+        std::unordered_map<const BlockStatement*, std::shared_ptr<Environment>> scope_pool;
+
+        std::vector<Value> stack;
+        const auto pop = [&stack]() -> Value
+        {
+            assert(stack.empty() == false);
+            auto r = std::move(stack.back());
+            stack.pop_back();
+            return r;
+        };
+
+        std::size_t ip = 0;
+        while(ip < chunk.code.size())
+        {
+            const Instruction& in = chunk.code[ip];
+            ip += 1;
+
+            switch(in.op)
+            {
+            case Op::push_constant:
+                stack.emplace_back(chunk.constants[in.arg]);
+                break;
+            case Op::pop:
+                pop();
+                break;
+            case Op::get_var:
+            {
+                const auto* x = static_cast<const VariableExpression*>(in.node);
+                stack.emplace_back(lookup_var(*current_environment, x->name, *x));
+                break;
+            }
+            case Op::set_var:
+            {
+                const auto* x = static_cast<const AssignExpression*>(in.node);
+                set_var_via_lookup(*current_environment, x->name, stack.back(), *x);
+                break;
+            }
+            case Op::define_var:
+            {
+                const auto* x = static_cast<const VarStatement*>(in.node);
+                current_environment->define(x->name, pop(), x->is_captured);
+                break;
+            }
+            case Op::binary:
+            {
+                const auto* x = static_cast<const BinaryExpression*>(in.node);
+                auto right = pop();
+                auto left = pop();
+                stack.emplace_back(evaluate_binary_operation(*x, left, right));
+                break;
+            }
+            case Op::unary:
+            {
+                const auto* x = static_cast<const UnaryExpression*>(in.node);
+                auto right = pop();
+                stack.emplace_back(evaluate_unary_operation(*x, right));
+                break;
+            }
+            case Op::jump:
+                ip = in.arg;
+                break;
+            case Op::loop:
+                consume_fuel(static_cast<const Statement*>(in.node)->offset);
+                ip = in.arg;
+                break;
+            case Op::jump_if_false:
+                if(is_truthy(pop()) == false)
+                {
+                    ip = in.arg;
+                }
+                break;
+            case Op::jump_if_false_no_pop:
+                if(is_truthy(stack.back()) == false)
+                {
+                    ip = in.arg;
+                }
+                break;
+            case Op::jump_if_true_no_pop:
+                if(is_truthy(stack.back()))
+                {
+                    ip = in.arg;
+                }
+                break;
+            case Op::call:
+            {
+                const auto* x = static_cast<const CallExpression*>(in.node);
+                auto pooled = PooledArguments{this};
+                pooled.args.arguments.resize(in.arg);
+                for(std::size_t argument_index = in.arg; argument_index > 0; argument_index -= 1)
+                {
+                    pooled.args.arguments[argument_index - 1] = pop().as_object();
+                }
+                auto function = require_callable_for_call(*x, pop().as_object());
+                stack.emplace_back(call_callable_with_arguments(*x, function, pooled.args));
+                break;
+            }
+            case Op::construct:
+            {
+                const auto* x = static_cast<const ConstructorExpression*>(in.node);
+                auto pooled = PooledArguments{this};
+                pooled.args.arguments.resize(in.arg);
+                for(std::size_t argument_index = in.arg; argument_index > 0; argument_index -= 1)
+                {
+                    pooled.args.arguments[argument_index - 1] = pop().as_object();
+                }
+                auto klass = require_klass_for_construction(*x, pop().as_object());
+                stack.emplace_back(construct_with_arguments(*x, klass, pooled.args));
+                break;
+            }
+            case Op::make_array:
+            {
+                std::vector<std::shared_ptr<Object>> values(in.arg);
+                for(std::size_t value_index = in.arg; value_index > 0; value_index -= 1)
+                {
+                    values[value_index - 1] = pop().as_object();
+                }
+                auto array = integration->make_array(std::move(values));
+                track_object_for_gc(array);
+                stack.emplace_back(std::move(array));
+                break;
+            }
+            case Op::make_function:
+            {
+                const auto* x = static_cast<const FunctionStatement*>(in.node);
+                current_environment->define
+                (
+                    x->name,
+                    make_bytecode_function(this, current_environment, chunk.functions[in.arg], *x),
+                    x->is_captured
+                );
+                break;
+            }
+            case Op::get_property:
+            {
+                const auto* x = static_cast<const GetPropertyExpression*>(in.node);
+                auto object = pop();
+                stack.emplace_back(get_property_from_evaluated(*x, object.as_object()));
+                break;
+            }
+            case Op::set_property:
+            {
+                const auto* x = static_cast<const SetPropertyExpression*>(in.node);
+                auto value = pop();
+                auto object = pop();
+                stack.emplace_back(set_property_on_evaluated(*x, object.as_object(), value.as_object()));
+                break;
+            }
+            case Op::get_index:
+            {
+                const auto* x = static_cast<const GetIndexExpression*>(in.node);
+                auto index = pop();
+                auto object = pop();
+                stack.emplace_back(get_index_from_evaluated(*x, object.as_object(), index.as_object()));
+                break;
+            }
+            case Op::set_index:
+            {
+                const auto* x = static_cast<const SetIndexExpression*>(in.node);
+                auto value = pop();
+                auto index = pop();
+                auto object = pop();
+                stack.emplace_back(set_index_on_evaluated(*x, object.as_object(), index.as_object(), value.as_object()));
+                break;
+            }
+            case Op::push_scope:
             {
-                if(left->get_type() == ObjectType::number_float || right->get_type() == ObjectType::number_float)
+                const auto* block = static_cast<const BlockStatement*>(in.node);
+                if(auto found = scope_pool.find(block); found != scope_pool.end() && found->second != nullptr)
                 {
-                    return make_number_float( get_number_as_float(left) + get_number_as_float(right) );
+                    auto pooled = std::move(found->second);
+                    pooled->enclosing = current_environment;
+                    current_environment = std::move(pooled);
                 }
                 else
                 {
-                    return make_number_int( get_int_or_ub(left) + get_int_or_ub(right) );
+                    current_environment = std::make_shared<Environment>(current_environment);
                 }
+                break;
             }
-            else if(left->get_type() == ObjectType::string && right->get_type() == ObjectType::string)
+            case Op::pop_scope:
             {
-                return make_string( get_string_or_ub(left) + get_string_or_ub(right) );
+                const auto* block = static_cast<const BlockStatement*>(in.node);
+                auto dropped = std::move(current_environment);
+                current_environment = dropped->enclosing;
+
+                // a loop body hits the same push_scope again next iteration,
+                // so park the environment for reuse when nothing else (a
+                // bytecode function retaining its defining chain) kept it
+                if(block->has_captured_declarations == false && dropped.use_count() == 1)
+                {
+                    dropped->enclosing.reset();
+                    dropped->clear_locals();
+                    scope_pool[block] = std::move(dropped);
+                }
+                break;
             }
-            else
+            case Op::print:
             {
-                assert(false && "interpreter error");
-                return nullptr;
+                auto value = pop();
+                print_object(value.as_object().get());
+                break;
+            }
+            case Op::return_value:
+                return pop();
+            case Op::return_nil:
+                return Value{};
+            default:
+                assert(false && "unhandled op in MainInterpreter::run_chunk");
+                break;
             }
-        case TokenType::LESS:
-            check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
-            return make_bool( get_number_as_float(left) < get_number_as_float(right) );
-        case TokenType::LESS_EQUAL:
-            check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
-            return make_bool( get_number_as_float(left) <= get_number_as_float(right) );
-        case TokenType::GREATER:
-            check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
-            return make_bool( get_number_as_float(left) > get_number_as_float(right) );
-        case TokenType::GREATER_EQUAL:
-            check_binary_number_operand(error_handler, x.op_offset, left, right, x.left->offset, x.right->offset);
-            return make_bool( get_number_as_float(left) >= get_number_as_float(right) );
-        case TokenType::BANG_EQUAL:
-            return make_bool( !is_equal(left, right) );
-        case TokenType::EQUAL_EQUAL:
-            return make_bool( is_equal(left, right) );
-        default:
-            assert(false && "unhandled token in Interpreter::on_binary_expression(...)");
-            return nullptr;
         }
+
+        return Value{};
     }
+};
 
-    std::shared_ptr<Object>
-    on_grouping_expression(const GroupingExpression& x) override
+
+std::optional<Value>
+take_return_value(MainInterpreter* main)
+{
+    auto r = std::move(main->pending_return);
+    main->pending_return.reset();
+    return r;
+}
+
+void
+execute_function_body
+(
+    MainInterpreter* main,
+    const std::vector<Statement*>& statements,
+    std::shared_ptr<Environment> environment,
+    bool allow_tail_calls
+)
+{
+    const auto previous = main->tail_call_allowed;
+    main->tail_call_allowed = allow_tail_calls;
+    main->execute_statements_with_environment(statements, environment);
+    main->tail_call_allowed = previous;
+}
+
+void
+consume_call_fuel(MainInterpreter* main, const std::vector<Statement*>& body)
+{
+    // an empty body can't loop or recurse, so it gets a free pass
+    // rather than inventing an offset to report against
+    if(body.empty())
     {
-        return evaluate(x.expression);
+        return;
     }
+    main->consume_fuel(body[0]->offset);
+}
 
-    std::shared_ptr<Object>
-    on_literal_expression(const LiteralExpression& x) override
+
+std::optional<TailCall>
+take_tail_call(MainInterpreter* main)
+{
+    auto r = std::move(main->pending_tail_call);
+    main->pending_tail_call.reset();
+    return r;
+}
+
+ScriptFunction*
+exchange_current_function(MainInterpreter* main, ScriptFunction* function)
+{
+    auto* previous = main->current_function;
+    main->current_function = function;
+    return previous;
+}
+
+void
+track_for_gc(MainInterpreter* main, const std::shared_ptr<Object>& object)
+{
+    main->track_object_for_gc(object);
+}
+
+std::shared_ptr<Object>
+interpret_initial_value(MainInterpreter* inter, const VarStatement& v)
+{
+    return inter->create_value(v).as_object();
+}
+
+
+struct BytecodeFunction : Callable
+{
+    MainInterpreter* interpreter;
+    std::shared_ptr<Environment> closure;
+    std::shared_ptr<Chunk> chunk;
+    std::string to_str;
+    std::vector<std::string> params;
+
+    explicit BytecodeFunction
+    (
+        MainInterpreter* i,
+        std::shared_ptr<Environment> c,
+        std::shared_ptr<Chunk> ch,
+        const std::string& n,
+        const std::vector<std::string>& p
+    )
+        : interpreter(i)
+        , closure(c)
+        , chunk(ch)
+        , to_str(n)
+        , params(p)
     {
-        return x.value;
     }
 
-    std::shared_ptr<Object>
-    on_unary_expression(const UnaryExpression& x) override
+    ArgInfo get_arg_info(Interpreter*, Callable*) override
     {
-        auto right = evaluate(x.right);
-        switch(x.op)
+        auto r = ArgInfo{};
+        r.arguments.reserve(params.size());
+        for(const auto& n: params)
         {
-        case TokenType::BANG:
-            return make_bool(!is_truthy(right));
-        case TokenType::MINUS:
-            check_single_number_operand(error_handler, x.op_offset, right, x.right->offset);
-            if(right->get_type() == ObjectType::number_float)
-            {
-                return make_number_float(-get_float_or_ub(right));
-            }
-            else
-            {
-                assert(right->get_type() == ObjectType::number_int);
-                return make_number_int(-get_int_or_ub(right));
-            }
-        default:
-            assert(false && "unreachable");
-            return make_nil();
+            r.arguments.emplace_back(SingleArg{n, nullptr});
         }
+        return r;
     }
 
+    std::shared_ptr<Callable>
+    bind(std::shared_ptr<Object> instance) override
+    {
+        auto env = std::make_shared<Environment>(closure);
+        env->define("this", instance);
+        auto bound = make_tracked<BytecodeFunction>(interpreter, env, chunk, to_str, params);
+        track_for_gc(interpreter, bound);
+        return bound;
+    }
+
+    void visit_references(GcReferenceVisitor* visitor) override
+    {
+        visitor->on_environment(closure);
+    }
+
+    void clear_references() override
+    {
+        closure.reset();
+    }
+
+    std::vector<std::string>
+    to_string(Interpreter*, Callable*, const ToStringOptions&) override
+    {
+        return {fmt::format("<{}>", to_str)};
+    }
+
+    std::shared_ptr<Object>
+    do_call(Interpreter*, const Arguments& arguments) override
+    {
+        verify_number_of_arguments(arguments, params.size());
+
+        auto environment = std::make_shared<Environment>(closure);
 
+        for(std::size_t param_index = 0; param_index < params.size(); param_index += 1)
+        {
+            environment->define(params[param_index], arguments.arguments[param_index]);
+        }
+
+        return interpreter->run_chunk(*chunk, environment).as_object();
+    }
 };
 
 
-void
-execute_statements_with_environment
+std::shared_ptr<Callable>
+make_bytecode_function
 (
-    MainInterpreter* main,
-    const std::vector<std::shared_ptr<Statement>>& statements,
-    std::shared_ptr<Environment> environment,
-    std::shared_ptr<State> state
+    MainInterpreter* inter,
+    std::shared_ptr<Environment> closure,
+    std::shared_ptr<Chunk> chunk,
+    const FunctionStatement& x
 )
 {
-    main->execute_statements_with_environment(statements, environment, state);
-}
-
-std::shared_ptr<Object>
-interpret_initial_value(MainInterpreter* inter, const VarStatement& v)
-{
-    return inter->create_value(v);
+    auto function = make_tracked<BytecodeFunction>
+    (
+        inter, closure, chunk, fmt::format("fn {}", x.name), x.params
+    );
+    track_for_gc(inter, function);
+    return function;
 }
 
 struct SimpleType : Type
@@ -1675,11 +3334,48 @@ struct SimpleType : Type
     }
 };
 
+// bridges the per line callback api onto the writer interface
+struct CallbackLineWriter : LineWriter
+{
+    std::function<void (std::string)> on_line;
+
+    explicit CallbackLineWriter(std::function<void (std::string)> ol)
+        : on_line(std::move(ol))
+    {
+    }
+
+    void
+    write(std::string_view batch) override
+    {
+        for_each_line(batch, [this](std::string_view line) { on_line(std::string(line)); });
+    }
+};
+
+
 struct PublicInterpreter : Interpreter
 {
     ErrorHandler* error_handler;
     std::shared_ptr<Environment> global_environment;
+
+    // set when constructed from the callback api, then the writer the
+    // interpreter flushes into is this adapter
+    std::unique_ptr<CallbackLineWriter> callback_writer;
+
     MainInterpreter interpreter;
+    InterpreterBackend backend;
+
+    // allocated while profiling is enabled, see set_profiling_enabled
+    std::unique_ptr<CallProfiler> profiler;
+
+    // callbacks handed over by enqueue_call, possibly from other
+    // threads, waiting for the next run_enqueued_calls
+    struct EnqueuedCall
+    {
+        std::shared_ptr<Callable> callback;
+        std::vector<std::shared_ptr<Object>> arguments;
+    };
+    std::mutex enqueued_mutex;
+    std::vector<EnqueuedCall> enqueued_calls;
 
     std::shared_ptr<Type> type_instance = std::make_shared<SimpleType>("instance");
     std::shared_ptr<Type> type_object = std::make_shared<SimpleType>("object");
@@ -1709,10 +3405,20 @@ struct PublicInterpreter : Interpreter
     std::shared_ptr<Type> get_callable_type() override { return type_callable; }
     std::shared_ptr<Type> get_array_type() override { return type_array; }
 
-    PublicInterpreter(ErrorHandler* eh, const std::function<void (std::string)>& on_line)
+    PublicInterpreter(ErrorHandler* eh, const std::function<void (std::string)>& on_line, InterpreterBackend the_backend)
+        : error_handler(eh)
+        , global_environment(std::make_shared<Environment>(nullptr))
+        , callback_writer(std::make_unique<CallbackLineWriter>(on_line))
+        , interpreter(this, global_environment, error_handler, callback_writer.get())
+        , backend(the_backend)
+    {
+    }
+
+    PublicInterpreter(ErrorHandler* eh, LineWriter* writer, InterpreterBackend the_backend)
         : error_handler(eh)
         , global_environment(std::make_shared<Environment>(nullptr))
-        , interpreter(this, global_environment, error_handler, on_line)
+        , interpreter(this, global_environment, error_handler, writer)
+        , backend(the_backend)
     {
     }
 
@@ -1727,21 +3433,150 @@ struct PublicInterpreter : Interpreter
     }
 
     bool
-    interpret(Program& program, const Resolved& resolved) override
+    interpret(std::shared_ptr<Program> program, const Resolved&) override
     {
+        interpreter.retained_programs.insert(program);
+
+        // a stray top level return must not leak into the next interpret
+        interpreter.pending_return.reset();
+        bool ok = true;
         try
         {
-            auto state = std::make_shared<State>(resolved);
-            interpreter.execute_statements_with_environment
-            (
-                program.statements, global_environment, state
-            );
-            return true;
+            const std::shared_ptr<Chunk> chunk = backend == InterpreterBackend::bytecode
+                ? compile_program_or_null(*program)
+                : nullptr
+                ;
+            if(chunk != nullptr)
+            {
+                interpreter.run_chunk(*chunk, global_environment);
+            }
+            else
+            {
+                interpreter.execute_statements_with_environment
+                (
+                    program->statements, global_environment
+                );
+            }
         }
         catch (const RuntimeError&)
         {
-            return false;
+            ok = false;
+        }
+
+        // whatever a failed run printed should still reach the writer
+        interpreter.flush_output();
+
+        interpreter.maybe_collect_cycles();
+        return ok;
+    }
+
+    std::size_t
+    collect_garbage() override
+    {
+        return interpreter.collect_cycles();
+    }
+
+    void
+    set_fuel_limit(std::optional<u64> steps) override
+    {
+        // +1 because the counter errors when it reaches zero, so a
+        // budget of N allows exactly N checked steps
+        interpreter.fuel_remaining = steps.has_value()
+            ? *steps + 1
+            : MainInterpreter::no_fuel_limit;
+    }
+
+    void
+    enqueue_call(std::shared_ptr<Callable> callback, std::vector<std::shared_ptr<Object>> arguments) override
+    {
+        assert(callback != nullptr);
+        const auto lock = std::scoped_lock{enqueued_mutex};
+        enqueued_calls.emplace_back(EnqueuedCall{std::move(callback), std::move(arguments)});
+    }
+
+    std::size_t
+    run_enqueued_calls() override
+    {
+        // take the batch out under the lock and run it without, so a
+        // callback can enqueue follow-up work for the next pump
+        auto batch = std::vector<EnqueuedCall>{};
+        {
+            const auto lock = std::scoped_lock{enqueued_mutex};
+            batch.swap(enqueued_calls);
+        }
+
+        for(auto& enqueued: batch)
+        {
+            auto args = Arguments{std::move(enqueued.arguments)};
+            try
+            {
+                enqueued.callback->call(this, args);
+            }
+            catch(const RuntimeError&)
+            {
+                // already reported, the remaining callbacks still run
+            }
+            catch(const CallError& err)
+            {
+                // there is no call site in any script to point at, so
+                // synthesize one for the report
+                const auto where = Offset{std::make_shared<Source>(std::string{"<enqueued call>"}), 0};
+                error_handler->on_error(where, err.error);
+            }
+        }
+
+        if(batch.empty() == false)
+        {
+            interpreter.flush_output();
+            interpreter.maybe_collect_cycles();
+        }
+        return batch.size();
+    }
+
+    void
+    set_profiling_enabled(bool enabled) override
+    {
+        profiler = enabled ? std::make_unique<CallProfiler>() : nullptr;
+    }
+
+    CallProfiler*
+    get_call_profiler_or_null() override
+    {
+        return profiler.get();
+    }
+
+    std::vector<FunctionProfile>
+    get_profile() override
+    {
+        std::vector<FunctionProfile> ret;
+        if(profiler == nullptr)
+        {
+            return ret;
+        }
+
+        ret.reserve(profiler->counters.size());
+        for(const auto& entry: profiler->counters)
+        {
+            const CallProfiler::Counters& counters = entry.second;
+            const auto lines = counters.callable->to_string(this, counters.callable.get(), ToStringOptions{});
+            ret.emplace_back(FunctionProfile
+            {
+                lines.empty() ? std::string{"<unknown>"} : lines[0],
+                counters.call_count,
+                counters.total_ns,
+                counters.total_ns - counters.child_ns
+            });
         }
+
+        std::sort
+        (
+            ret.begin(), ret.end(),
+            [](const FunctionProfile& lhs, const FunctionProfile& rhs)
+            {
+                return lhs.self_ns > rhs.self_ns;
+            }
+        );
+        return ret;
     }
     
     std::shared_ptr<NativeKlass>
@@ -1772,14 +3607,80 @@ namespace lox
 {
 
 
+HeapStats
+Interpreter::get_heap_stats() const
+{
+    return lox::get_heap_stats();
+}
+
+
+std::shared_ptr<Interpreter>
+make_interpreter
+(
+    ErrorHandler* error_handler,
+    const std::function<void (std::string)>& on_line,
+    InterpreterBackend backend
+)
+{
+    return std::make_shared<PublicInterpreter>(error_handler, on_line, backend);
+}
+
+
 std::shared_ptr<Interpreter>
 make_interpreter
 (
+    ErrorHandler* error_handler,
+    LineWriter* writer,
+    InterpreterBackend backend
+)
+{
+    return std::make_shared<PublicInterpreter>(error_handler, writer, backend);
+}
+
+
+std::shared_ptr<Interpreter>
+fork_interpreter
+(
+    Interpreter* snapshot,
     ErrorHandler* error_handler,
     const std::function<void (std::string)>& on_line
 )
 {
-    return std::make_shared<PublicInterpreter>(error_handler, on_line);
+    // every Interpreter comes out of make_interpreter, so this cast is
+    // safe within this translation unit
+    auto* source = static_cast<PublicInterpreter*>(snapshot);
+
+    auto forked = std::make_shared<PublicInterpreter>(error_handler, on_line, source->backend);
+
+    // copy the bindings, share what they point at
+    forked->global_environment->values = source->global_environment->values;
+    forked->interpreter.registered_klasses = source->interpreter.registered_klasses;
+
+    // functions copied above keep raw pointers into their defining
+    // programs, the fork has to keep those alive on its own
+    forked->interpreter.retained_programs = source->interpreter.retained_programs;
+
+    return forked;
+}
+
+
+void
+print_profile(const std::vector<FunctionProfile>& profile, PrintHandler* to)
+{
+    constexpr double ns_per_ms = 1000.0 * 1000.0;
+
+    to->on_line(fmt::format("{:>10}  {:>12}  {:>12}  {}", "calls", "total ms", "self ms", "function"));
+    for(const auto& function: profile)
+    {
+        to->on_line(fmt::format
+        (
+            "{:>10}  {:>12.3f}  {:>12.3f}  {}",
+            function.call_count,
+            static_cast<double>(function.total_ns) / ns_per_ms,
+            static_cast<double>(function.self_ns) / ns_per_ms,
+            function.name
+        ));
+    }
 }
 
 
@@ -12,12 +12,61 @@ namespace lox
 struct ErrorHandler;
 struct Program;
 struct Resolved;
+struct PrintHandler;
+struct LineWriter;
+
+
+// accumulated cost of one callable while profiling was enabled, see
+// Interpreter::get_profile
+struct FunctionProfile
+{
+    std::string name;
+    u64 call_count = 0;
+
+    // wall time spent inside the callable, including its callees
+    u64 total_ns = 0;
+
+    // total_ns minus the time spent in callees
+    u64 self_ns = 0;
+};
+
+
+// live counters while profiling is enabled, written by Callable::call
+struct CallProfiler
+{
+    struct Counters
+    {
+        // keeps the profiled object alive so get_profile can name it
+        std::shared_ptr<Callable> callable;
+        u64 call_count = 0;
+        u64 total_ns = 0;
+        u64 child_ns = 0;
+    };
+
+    std::unordered_map<const Callable*, Counters> counters;
+
+    // completed callee time below each active call, the top entry is
+    // owned by the innermost running Callable::call
+    std::vector<u64> child_ns_stack;
+};
 
 
 // runtime errors are sent to the error handler
 // return false on runtime error
 
 
+// how the interpreter executes a resolved program
+enum class InterpreterBackend
+{
+    // walk the ast directly with virtual visitors
+    tree_walking,
+
+    // compile to a flat bytecode stream executed in a dispatch loop,
+    // programs the compiler can't handle yet fall back to tree walking
+    bytecode
+};
+
+
 struct Interpreter
 {
     Interpreter() = default;
@@ -29,12 +78,56 @@ struct Interpreter
     virtual bool
     interpret
     (
-        Program& expression, const Resolved& resolved
+        std::shared_ptr<Program> program, const Resolved& resolved
     ) = 0;
 
     virtual std::shared_ptr<NativeKlass> get_native_klass_or_null(std::size_t id) = 0;
     virtual void register_native_klass(std::size_t id, std::shared_ptr<NativeKlass> klass) = 0;
 
+    // per function call counts and self/total time; enabling resets any
+    // earlier measurements, when disabled each call pays one branch
+    virtual void set_profiling_enabled(bool enabled) = 0;
+
+    // non-null while profiling is enabled, only Callable::call needs it
+    virtual CallProfiler* get_call_profiler_or_null() = 0;
+
+    // what was measured since profiling was enabled, biggest self time
+    // first
+    virtual std::vector<FunctionProfile> get_profile() = 0;
+
+    // cap how many steps scripts may run before they stop with a
+    // regular runtime error through the error handler: loop back edges
+    // and function calls each cost one step, so a budget of N million
+    // bounds every runaway loop without a watchdog. The remaining
+    // budget carries across interpret calls until set again; nullopt
+    // removes the cap. The check is one decrement-and-branch
+    virtual void set_fuel_limit(std::optional<u64> steps) = 0;
+
+    // schedule a script callback to run on the next run_enqueued_calls;
+    // safe to call from any thread, so an I/O native can start its work,
+    // return immediately and hand the result to a callback when it
+    // arrives instead of blocking the interpreter thread
+    virtual void enqueue_call(std::shared_ptr<Callable> callback, std::vector<std::shared_ptr<Object>> arguments) = 0;
+
+    // run every callback enqueued so far on the calling thread and
+    // return how many ran; a runtime error in one callback is reported
+    // and doesn't stop the others. The host's event loop pumps this for
+    // each session that has work, which multiplexes many sessions over
+    // a small thread pool as long as one session stays on one thread at
+    // a time
+    virtual std::size_t run_enqueued_calls() = 0;
+
+    // shared_ptr ownership can't reclaim reference cycles (a doubly linked
+    // list, an instance storing a closure over "this"), this runs the cycle
+    // collector and returns how many unreachable objects had their cycles
+    // broken; it also runs on its own when enough objects have been created
+    virtual std::size_t collect_garbage() = 0;
+
+    // snapshot of the script heap counters, for alerting on memory
+    // growth before the process does; the counters are process wide so
+    // forked sessions that share objects read the same numbers
+    HeapStats get_heap_stats() const;
+
     // todo(Gustav): replace with smarter types
     virtual std::shared_ptr<Type> get_instance_type() = 0;
     virtual std::shared_ptr<Type> get_object_type() = 0;
@@ -52,11 +145,45 @@ struct Interpreter
 std::shared_ptr<Interpreter>
 make_interpreter
 (
+    ErrorHandler* error_handler,
+    const std::function<void (std::string)>& on_line,
+    InterpreterBackend backend = InterpreterBackend::tree_walking
+);
+
+
+// like above but print output is appended into one reused buffer and
+// flushed to the writer in batches instead of one callback per line;
+// the writer must outlive the interpreter
+std::shared_ptr<Interpreter>
+make_interpreter
+(
+    ErrorHandler* error_handler,
+    LineWriter* writer,
+    InterpreterBackend backend = InterpreterBackend::tree_walking
+);
+
+
+// start a new interpreter from a fully initialized one: the global
+// bindings and the native klass registry are copied so the fork can
+// define or overwrite globals without touching the snapshot, while the
+// natives, classes and functions behind those bindings stay shared.
+// Copying is by binding, not by object -- mutating the inside of a
+// shared object (an array element, an instance field) is visible in
+// every fork, so treat pre-fork script state as read-only
+std::shared_ptr<Interpreter>
+fork_interpreter
+(
+    Interpreter* snapshot,
     ErrorHandler* error_handler,
     const std::function<void (std::string)>& on_line
 );
 
 
+// dump a profile as a table, one line per callable
+void
+print_profile(const std::vector<FunctionProfile>& profile, PrintHandler* to);
+
+
 void
 verify_number_of_arguments(const Arguments& args, u64 arity);
 
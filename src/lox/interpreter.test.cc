@@ -5,6 +5,7 @@
 #include "lox/scanner.h"
 #include "lox/ast.h"
 #include "lox/parser.h"
+#include "lox/optimize.h"
 #include "lox/interpreter.h"
 #include "lox/resolver.h"
 
@@ -25,6 +26,8 @@ namespace
             return false;
         }
 
+        lox::optimize(*program.program);
+
         auto resolved = lox::resolve(*program.program, interpreter->get_error_handler());
 
         if(resolved.has_value() == false)
@@ -32,11 +35,39 @@ namespace
             return false;
         }
 
-        return interpreter->interpret(*program.program, *resolved);
+        return interpreter->interpret(program.program, *resolved);
     }
 }
 
 
+TEST_CASE("interpret writer sink", "[interpret]")
+{
+    std::vector<ReportedError> error_list;
+    auto printer = AddErrorErrors{&error_list};
+
+    struct CollectBatches : lox::LineWriter
+    {
+        std::vector<std::string> batches;
+
+        void
+        write(std::string_view batch) override
+        {
+            batches.emplace_back(batch);
+        }
+    };
+    auto writer = CollectBatches{};
+    auto lx = lox::make_interpreter(&printer, &writer);
+
+    const auto run_ok = run_string(lx, "print 1; print 2; print 3;");
+    CHECK(run_ok);
+    CHECK(ErrorEq(error_list, {}));
+
+    // everything fit in the buffer, so the run flushed a single batch
+    REQUIRE(writer.batches.size() == 1);
+    CHECK(writer.batches[0] == "1\n2\n3\n");
+}
+
+
 TEST_CASE("interpret fail", "[interpret]")
 {
     std::vector<std::string> console_out;
@@ -200,6 +231,36 @@ TEST_CASE("interpret fail", "[interpret]")
         }));
     }
 
+    SECTION("cached property set before parent chain is built")
+    {
+        // warm the set site on a fully constructed instance, then run it
+        // against one whose implicit super constructor hasn't executed
+        // yet; the cached path walks the parent chain and must fall back
+        // to the plain error when the chain runs out
+        const auto run_ok = run_string
+        (lx, R"lox(
+            fun poke(o) { o.x = 42; }
+            class Base { var x; }
+            class Derived : Base
+            {
+                fun init(warm)
+                {
+                    if(warm) { poke(this); }
+                }
+            }
+            var d = new Derived(false);
+            poke(d);
+            new Derived(true);
+        )lox");
+        CHECK_FALSE(run_ok);
+        CHECK(StringEq(console_out,{}));
+        CHECK(ErrorEq(error_list, {
+            {error, 29, 30, {"<instance Derived> doesn't have a property named x"}},
+            {note, 200, 210, {"called from here"}},
+            {note, 319, 336, {"called from here"}},
+        }));
+    }
+
     SECTION("can't declare 2 members with the same same")
     {
         const auto run_ok = run_string
@@ -1539,6 +1600,63 @@ TEST_CASE("interpret ok", "[interpret]")
         }));
     }
 
+    SECTION("append to self stays correct when aliased")
+    {
+        const auto run_ok = run_string
+        (lx, R"lox(
+            var s = "";
+            var i = 0;
+            while(i < 3)
+            {
+                s = s + "ab";
+                i = i + 1;
+            }
+            print s;
+
+            // an alias must keep the old value, the in-place append
+            // only fires when nothing else holds the string
+            var kept = s;
+            s = s + "!";
+            print s;
+            print kept;
+
+            // the right side rebinding the variable wins, like the
+            // generic evaluation order
+            fun hijack() { s = "other"; return "?"; }
+            s = s + hijack();
+            print s;
+        )lox");
+        CHECK(run_ok);
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out,{
+            "ababab",
+            "ababab!",
+            "ababab",
+            "ababab!?"
+        }));
+    }
+
+    SECTION("array map filter reduce")
+    {
+        const auto run_ok = run_string
+        (lx, R"lox(
+            var arr = [1, 2, 3, 4];
+            fun twice(x) { return x + x; }
+            fun big(x) { return x > 2; }
+            fun add(a, b) { return a + b; }
+            print arr.map(twice);
+            print arr.filter(big);
+            print arr.reduce(add, 0);
+        )lox");
+        CHECK(run_ok);
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out,{
+            "[2, 4, 6, 8]",
+            "[3, 4]",
+            "10"
+        }));
+    }
+
     SECTION("index get and set")
     {
         const auto run_ok = run_string
@@ -1683,3 +1801,207 @@ TEST_CASE("interpret ok", "[interpret]")
     }
 }
 
+
+
+TEST_CASE("interpret garbage collection", "[interpret]")
+{
+    std::vector<std::string> console_out;
+    std::vector<std::string> error_list;
+    auto printer = AddStringErrors{&error_list};
+    auto lx = lox::make_interpreter(&printer, [&](const std::string& s){ console_out.emplace_back(s); });
+
+    SECTION("instance field cycle is collected")
+    {
+        const auto run_ok = run_string
+        (lx, R"lox(
+            class Node { var other; }
+
+            fun make_cycle()
+            {
+                var a = new Node();
+                var b = new Node();
+                a.other = b;
+                b.other = a;
+            }
+
+            make_cycle();
+        )lox");
+        CHECK(run_ok);
+        REQUIRE(StringEq(error_list, {}));
+
+        // both nodes only keep each other alive
+        CHECK(lx->collect_garbage() == 2);
+        CHECK(lx->collect_garbage() == 0);
+    }
+
+    SECTION("closure over this stored on the instance is collected")
+    {
+        const auto run_ok = run_string
+        (lx, R"lox(
+            class Widget
+            {
+                var callback;
+
+                fun init()
+                {
+                    fun remember()
+                    {
+                        return this;
+                    }
+                    this.callback = remember;
+                }
+            }
+
+            fun make_widget()
+            {
+                new Widget();
+            }
+
+            make_widget();
+        )lox");
+        CHECK(run_ok);
+        REQUIRE(StringEq(error_list, {}));
+
+        // the widget and the closure that captured it
+        CHECK(lx->collect_garbage() == 2);
+    }
+
+    SECTION("self referencing array is collected")
+    {
+        const auto run_ok = run_string
+        (lx, R"lox(
+            fun make_ring()
+            {
+                var arr = [1, 2, 3];
+                arr.push(arr);
+            }
+
+            make_ring();
+        )lox");
+        CHECK(run_ok);
+        REQUIRE(StringEq(error_list, {}));
+
+        CHECK(lx->collect_garbage() == 1);
+    }
+
+    SECTION("cycles reachable from a global survive")
+    {
+        const auto run_ok = run_string
+        (lx, R"lox(
+            class Node { var other; }
+
+            var keep = new Node();
+            keep.other = keep;
+        )lox");
+        CHECK(run_ok);
+        REQUIRE(StringEq(error_list, {}));
+
+        CHECK(lx->collect_garbage() == 0);
+
+        const auto still_ok = run_string
+        (lx, R"lox(
+            print keep.other;
+        )lox");
+        CHECK(still_ok);
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out,{
+            "<instance Node>"
+        }));
+    }
+}
+
+
+
+TEST_CASE("interpret bytecode backend", "[interpret]")
+{
+    std::vector<std::string> console_out;
+    std::vector<ReportedError> error_list;
+    auto printer = AddErrorErrors{&error_list};
+    auto lx = lox::make_interpreter
+    (
+        &printer,
+        [&](const std::string& s){ console_out.emplace_back(s); },
+        lox::InterpreterBackend::bytecode
+    );
+
+    SECTION("recursive function")
+    {
+        const auto run_ok = run_string
+        (lx, R"lox(
+            fun fib(n)
+            {
+                if (n < 2) { return n; }
+                return fib(n - 1) + fib(n - 2);
+            }
+            print fib(10);
+        )lox");
+        CHECK(run_ok);
+        REQUIRE(ErrorEq(error_list, {}));
+        CHECK(StringEq(console_out,{
+            "55"
+        }));
+    }
+
+    SECTION("loops scopes and arrays")
+    {
+        const auto run_ok = run_string
+        (lx, R"lox(
+            var sum = 0;
+            var arr = [1, 2, 3];
+            arr.push(4);
+            var i = 0;
+            while (i < arr.len())
+            {
+                var x = arr[i];
+                if (x == 2 or x == 3)
+                {
+                    sum = sum + 10 * x;
+                }
+                else
+                {
+                    sum = sum + x;
+                }
+                i = i + 1;
+            }
+            print sum;
+        )lox");
+        CHECK(run_ok);
+        REQUIRE(ErrorEq(error_list, {}));
+        CHECK(StringEq(console_out,{
+            "55"
+        }));
+    }
+
+    SECTION("classes fall back to tree walking")
+    {
+        const auto run_ok = run_string
+        (lx, R"lox(
+            class Greeter
+            {
+                fun say()
+                {
+                    print "hello";
+                }
+            }
+            new Greeter().say();
+        )lox");
+        CHECK(run_ok);
+        REQUIRE(ErrorEq(error_list, {}));
+        CHECK(StringEq(console_out,{
+            "hello"
+        }));
+    }
+
+    SECTION("runtime errors are still reported")
+    {
+        const auto run_ok = run_string
+        (lx, R"lox(
+            print missing;
+        )lox");
+        CHECK_FALSE(run_ok);
+        CHECK(ErrorEq(error_list, {
+            {ReportedError::Type::error, 19, 26, {"Undefined variable missing"}}
+        }));
+        CHECK(StringEq(console_out,{}));
+    }
+}
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 
+using u32 = std::uint32_t;
 using u64 = std::uint64_t;
 using i64 = std::int64_t;
 
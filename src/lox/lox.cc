@@ -4,21 +4,70 @@
 #include "lox/scanner.h"
 #include "lox/ast.h"
 #include "lox/parser.h"
+#include "lox/optimize.h"
 #include "lox/interpreter.h"
 #include "lox/resolver.h"
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 
 namespace lox
 {
 
+// a successfully compiled and resolved program, the source is kept so a
+// hash collision can be told apart from a real cache hit
+struct CachedProgram
+{
+    std::shared_ptr<Source> source;
+    std::shared_ptr<Program> program;
+};
+
+
 struct LoxImpl
 {
     std::unique_ptr<ErrorHandler> error_handler;
     std::shared_ptr<Interpreter> interpreter;
 
+    // compiled programs keyed by a hash of their text, resolution is
+    // written straight into the ast so a cached program can be handed
+    // back to the interpreter without rerunning scan/parse/resolve
+    std::unordered_map<std::uint64_t, CachedProgram> compile_cache;
+
+    // recycled across run calls so a small snippet against a long lived
+    // session doesn't reallocate the resolver's scratch state
+    std::shared_ptr<ResolverSession> resolver_session = make_resolver_session();
+
     LoxImpl(std::unique_ptr<ErrorHandler> eh, std::function<void (const std::string&)> on_line)
         : error_handler(std::move(eh))
         , interpreter(lox::make_interpreter(error_handler.get(), std::move(on_line)))
+    {
+        // heap counters for scripts, so a watchdog script can alert on
+        // memory growth; lazily built so sessions that never look at it
+        // only pay for the empty package shell
+        register_native_package
+        (
+            interpreter.get(), "debug",
+            [](Scope& scope)
+            {
+                scope
+                    .add_native_getter("live_objects", []() { return make_number_int(static_cast<Ti>(get_heap_stats().live_objects)); })
+                    .add_native_getter("live_bytes", []() { return make_number_int(static_cast<Ti>(get_heap_stats().live_bytes)); })
+                    .add_native_getter("total_objects", []() { return make_number_int(static_cast<Ti>(get_heap_stats().total_objects)); })
+                    .add_native_getter("total_bytes", []() { return make_number_int(static_cast<Ti>(get_heap_stats().total_bytes)); })
+                    .add_native_getter("peak_live_objects", []() { return make_number_int(static_cast<Ti>(get_heap_stats().peak_live_objects)); })
+                    .add_native_getter("peak_live_bytes", []() { return make_number_int(static_cast<Ti>(get_heap_stats().peak_live_bytes)); })
+                    .add_native_getter("live_environments", []() { return make_number_int(static_cast<Ti>(get_heap_stats().live_environments)); })
+                    ;
+            }
+        );
+    }
+
+    // the fork constructor, see Lox::fork
+    LoxImpl(std::unique_ptr<ErrorHandler> eh, std::function<void (const std::string&)> on_line, Interpreter* fork_from)
+        : error_handler(std::move(eh))
+        , interpreter(lox::fork_interpreter(fork_from, error_handler.get(), std::move(on_line)))
     {
     }
 };
@@ -29,28 +78,194 @@ Lox::Lox(std::unique_ptr<ErrorHandler> eh, std::function<void (const std::string
 {
 }
 
+Lox::Lox(std::unique_ptr<LoxImpl> i)
+    : impl(std::move(i))
+{
+}
+
 Lox::~Lox() = default;
 
 
+std::unique_ptr<Lox>
+Lox::fork(std::unique_ptr<ErrorHandler> error_handler, std::function<void (const std::string&)> on_line)
+{
+    return std::make_unique<Lox>(std::make_unique<LoxImpl>
+    (
+        std::move(error_handler), std::move(on_line), impl->interpreter.get()
+    ));
+}
+
+
+namespace
+{
+    // scan/parse/optimize/resolve, null when any stage failed; safe to
+    // run on several threads at once as long as each call gets its own
+    // source and the error handler tolerates concurrent reports
+    std::shared_ptr<Program>
+    compile_source(std::shared_ptr<Source> source, ErrorHandler* error_handler, ResolverSession* session)
+    {
+        auto tokens = TokenStream{std::move(source), error_handler};
+        auto program = lox::parse_program(tokens, error_handler);
+
+        if(tokens.get_error_count() > 0 || program.errors > 0)
+        {
+            return nullptr;
+        }
+
+        lox::optimize(*program.program);
+
+        auto resolved = lox::resolve(*program.program, error_handler, session);
+
+        if(resolved.has_value() == false)
+        {
+            return nullptr;
+        }
+
+        return program.program;
+    }
+
+    // funnels error reports from the compile workers onto the session's
+    // handler one at a time
+    struct LockedErrorHandler : ErrorHandler
+    {
+        ErrorHandler* wrapped;
+        std::mutex mutex;
+
+        explicit LockedErrorHandler(ErrorHandler* w)
+            : wrapped(w)
+        {
+        }
+
+        void on_errors(const Offset& where, const std::vector<std::string>& messages) override
+        {
+            const auto lock = std::scoped_lock{mutex};
+            wrapped->on_errors(where, messages);
+        }
+
+        void on_notes(const Offset& where, const std::vector<std::string>& messages) override
+        {
+            const auto lock = std::scoped_lock{mutex};
+            wrapped->on_notes(where, messages);
+        }
+    };
+
+    // fnv-1a, only used to key the compile cache
+    std::uint64_t
+    hash_source(std::string_view text)
+    {
+        std::uint64_t hash = 0xcbf29ce484222325;
+        for(const char c: text)
+        {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+        }
+        return hash;
+    }
+
+    bool
+    run_source(LoxImpl* impl, std::shared_ptr<Source> source)
+    {
+        const auto key = hash_source(source->source);
+        if(const auto found = impl->compile_cache.find(key);
+           found != impl->compile_cache.end() && found->second.source->source == source->source)
+        {
+            return impl->interpreter->interpret(found->second.program, Resolved{});
+        }
+
+        auto program = compile_source(source, impl->interpreter->get_error_handler(), impl->resolver_session.get());
+
+        if(program == nullptr)
+        {
+            return false;
+        }
+
+        impl->compile_cache.insert({key, CachedProgram{std::move(source), program}});
+        return impl->interpreter->interpret(program, Resolved{});
+    }
+}
+
+
 bool
 Lox::run_string(const std::string& source)
 {
-    auto tokens = lox::scan_tokens(source, impl->interpreter->get_error_handler());
-    auto program = lox::parse_program(tokens.tokens, impl->interpreter->get_error_handler());
-    
-    if(tokens.errors > 0 || program.errors > 0)
+    return run_source(impl.get(), std::make_shared<Source>(source));
+}
+
+
+bool
+Lox::run_file(const std::string& path)
+{
+    auto file = std::make_shared<MappedFile>(path);
+    if(file->is_open() == false)
     {
         return false;
     }
 
-    auto resolved = lox::resolve(*program.program, impl->interpreter->get_error_handler());
+    // the source holds on to the mapping, so offsets in functions that
+    // outlive this run can still print their lines
+    return run_source(impl.get(), std::make_shared<Source>(std::move(file)));
+}
+
+
+std::vector<CompiledScript>
+Lox::compile_many(const std::vector<std::string>& sources)
+{
+    auto errors = LockedErrorHandler{impl->interpreter->get_error_handler()};
+    auto compiled = std::vector<CompiledScript>(sources.size());
+    std::atomic<std::size_t> next_index{0};
+
+    const auto worker = [&]()
+    {
+        while(true)
+        {
+            const auto index = next_index.fetch_add(1);
+            if(index >= sources.size())
+            {
+                return;
+            }
+
+            // no resolver session, its scratch state isn't shareable
+            // between threads
+            compiled[index].program = compile_source
+            (
+                std::make_shared<Source>(sources[index]), &errors, nullptr
+            );
+        }
+    };
+
+    const auto hardware = static_cast<std::size_t>(std::max(1u, std::thread::hardware_concurrency()));
+    const auto worker_count = std::min(sources.size(), hardware);
+
+    if(worker_count <= 1)
+    {
+        worker();
+        return compiled;
+    }
+
+    auto threads = std::vector<std::thread>{};
+    threads.reserve(worker_count);
+    for(std::size_t thread_index = 0; thread_index < worker_count; thread_index += 1)
+    {
+        threads.emplace_back(worker);
+    }
+    for(auto& thread: threads)
+    {
+        thread.join();
+    }
+
+    return compiled;
+}
+
 
-    if(resolved.has_value() == false)
+bool
+Lox::run_compiled(const CompiledScript& script)
+{
+    if(script.program == nullptr)
     {
         return false;
     }
 
-    return impl->interpreter->interpret(*program.program, *resolved);
+    // resolution was already written into the ast by compile_many
+    return impl->interpreter->interpret(script.program, Resolved{});
 }
 
 
@@ -68,6 +283,13 @@ Lox::in_package(const std::string& package_path)
 }
 
 
+void
+Lox::register_package(const std::string& package_path, std::function<void (Scope&)> init)
+{
+    register_native_package(impl->interpreter.get(), package_path, std::move(init));
+}
+
+
 Environment&
 Lox::get_global_environment()
 {
@@ -7,17 +7,55 @@ namespace lox
 
 struct LoxImpl;
 struct Interpreter;
+struct Program;
+
+// a script that has been through the front end and is ready to hand to
+// the interpreter, program is null when compilation failed; run
+// freeze_for_sharing on the program first if several sessions will
+// execute it concurrently
+struct CompiledScript
+{
+    std::shared_ptr<Program> program;
+};
 
 struct Lox
 {
     Lox(std::unique_ptr<ErrorHandler> error_handler, std::function<void (const std::string&)> on_line);
+    explicit Lox(std::unique_ptr<LoxImpl> i);
     ~Lox();
 
+    // cheap per-request fork of a fully initialized session: the fork
+    // starts with the current globals and native registrations and can
+    // redefine them without affecting this instance. Bindings are
+    // copied, the natives, classes and functions behind them are
+    // shared, so treat pre-fork script state as read-only; the compile
+    // cache is not shared, each fork compiles its own scripts
+    std::unique_ptr<Lox> fork(std::unique_ptr<ErrorHandler> error_handler, std::function<void (const std::string&)> on_line);
+
     bool run_string(const std::string& source);
 
+    // memory maps the file and runs it without copying the text, tokens
+    // and error reports point straight into the mapping; returns false
+    // when the file can't be read
+    bool run_file(const std::string& path);
+
+    // runs scan/parse/resolve for many independent sources on worker
+    // threads and returns one entry per source in the same order; the
+    // caller executes them with run_compiled in whatever order the
+    // scripts require
+    std::vector<CompiledScript> compile_many(const std::vector<std::string>& sources);
+
+    // execute a script compiled earlier, returns false when it failed
+    // to compile or hits a runtime error
+    bool run_compiled(const CompiledScript& script);
+
     std::shared_ptr<Scope> in_global_scope();
     std::shared_ptr<Scope> in_package(const std::string& name);
 
+    // like in_package but the bindings are only built when a script
+    // first looks inside the package, see register_native_package
+    void register_package(const std::string& name, std::function<void (Scope&)> init);
+
     Environment& get_global_environment();
 
     std::shared_ptr<NativeKlass> get_native_klass_or_null(std::size_t id);
@@ -27,7 +65,7 @@ struct Lox
     {
         auto klass = get_native_klass_or_null(detail::get_unique_id<T>());
         assert(klass != nullptr && "klass not registered!");
-        return std::make_shared<detail::NativeInstanceT<T>>(std::move(t), klass);
+        return make_tracked<detail::NativeInstanceT<T>>(std::move(t), klass);
     }
 
     Interpreter* get_interpreter();
@@ -1,8 +1,14 @@
 #include "catch.hpp"
 #include "catchy/stringeq.h"
 
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
 #include "lox/lox.h"
 #include "lox/environment.h"
+#include "lox/interpreter.h"
+#include "lox/program.h"
 
 #include "test.h"
 
@@ -173,6 +179,304 @@ TEST_CASE("lox binding" "[lox]")
         }));
     }
 
+    SECTION("run file")
+    {
+        const auto path = std::string{"lox_run_file_test.tmp"};
+        {
+            std::ofstream handle{path};
+            handle << "print \"from file\";";
+        }
+
+        const auto run_ok = lox.run_file(path);
+        std::remove(path.c_str());
+
+        CHECK(run_ok);
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out, {"from file"}));
+
+        CHECK_FALSE(lox.run_file("lox_no_such_file.tmp"));
+    }
+
+    SECTION("session keeps state between runs")
+    {
+        // globals and functions from earlier snippets stay visible, only
+        // the new statements are compiled and resolved
+        CHECK(lox.run_string("var counter = 0; fun bump() { counter = counter + 1; return counter; }"));
+        CHECK(lox.run_string("print bump();"));
+        CHECK(lox.run_string("print bump();"));
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out, {"1", "2"}));
+    }
+
+    SECTION("profiling")
+    {
+        auto* interpreter = lox.get_interpreter();
+        interpreter->set_profiling_enabled(true);
+        REQUIRE(lox.run_string("fun work() { return 1 + 2; } work(); work(); work();"));
+        const auto profile = interpreter->get_profile();
+        interpreter->set_profiling_enabled(false);
+
+        REQUIRE(profile.size() == 1);
+        CHECK(profile[0].name == "<fn work>");
+        CHECK(profile[0].call_count == 3);
+        CHECK(profile[0].total_ns >= profile[0].self_ns);
+
+        // disabled means no counters at all
+        REQUIRE(lox.run_string("work();"));
+        CHECK(interpreter->get_profile().empty());
+    }
+
+    SECTION("compile many")
+    {
+        // the front end runs on worker threads, execution stays on this
+        // one and happens in the order the caller picks
+        const auto compiled = lox.compile_many
+        ({
+            "fun greet() { print \"hello\"; }",
+            "greet(); print 1 + 2;",
+            "this won't parse ("
+        });
+        REQUIRE(compiled.size() == 3);
+        CHECK(compiled[0].program != nullptr);
+        CHECK(compiled[1].program != nullptr);
+        CHECK(compiled[2].program == nullptr);
+
+        CHECK(lox.run_compiled(compiled[0]));
+        CHECK(lox.run_compiled(compiled[1]));
+        CHECK_FALSE(lox.run_compiled(compiled[2]));
+
+        CHECK(StringEq(console_out, {"hello", "3"}));
+    }
+
+    SECTION("compile cache")
+    {
+        // the second run reuses the compiled program and must behave
+        // exactly like a fresh compile
+        const auto script = std::string{"var x = 1 + 2; print x;"};
+        CHECK(lox.run_string(script));
+        CHECK(lox.run_string(script));
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out, {"3", "3"}));
+    }
+
+    SECTION("fork isolates globals")
+    {
+        lox.in_global_scope()->define_native_function
+        (
+            "nat",
+            [](lox::Callable*, lox::ArgumentHelper& helper)
+            {
+                if(helper.complete()) return lox::make_nil();
+                return lox::make_string("hello world");
+            }
+        );
+        REQUIRE(lox.run_string("var mode = \"base\";"));
+
+        std::vector<std::string> fork_out;
+        std::vector<std::string> fork_errors;
+        auto forked = lox.fork(std::make_unique<AddStringErrors>(&fork_errors), [&](const std::string& s){ fork_out.emplace_back(s); });
+
+        // the fork sees everything registered and run before the fork
+        CHECK(forked->run_string("print nat(); print mode;"));
+
+        // redefining a global in the fork doesn't leak back
+        CHECK(forked->run_string("mode = \"fork\"; print mode;"));
+        CHECK(lox.run_string("print mode;"));
+
+        REQUIRE(StringEq(error_list, {}));
+        REQUIRE(StringEq(fork_errors, {}));
+        CHECK(StringEq(fork_out, {"hello world", "base", "fork"}));
+        CHECK(StringEq(console_out, {"base"}));
+    }
+
+    SECTION("frozen program shared between sessions")
+    {
+        auto compiled = lox.compile_many({"fun add(a, b) { return a + b; } print add(1, 2);"});
+        REQUIRE(compiled.size() == 1);
+        REQUIRE(compiled[0].program != nullptr);
+
+        // after freezing the tree is immutable, so concurrent runs in
+        // independent sessions never race on the node caches
+        lox::freeze_for_sharing(*compiled[0].program);
+
+        std::vector<std::string> fork_out;
+        std::vector<std::string> fork_errors;
+        auto forked = lox.fork(std::make_unique<AddStringErrors>(&fork_errors), [&](const std::string& s){ fork_out.emplace_back(s); });
+
+        auto in_base = std::thread{[&]{ CHECK(lox.run_compiled(compiled[0])); }};
+        auto in_fork = std::thread{[&]{ CHECK(forked->run_compiled(compiled[0])); }};
+        in_base.join();
+        in_fork.join();
+
+        REQUIRE(StringEq(error_list, {}));
+        REQUIRE(StringEq(fork_errors, {}));
+        CHECK(StringEq(console_out, {"3"}));
+        CHECK(StringEq(fork_out, {"3"}));
+    }
+
+    SECTION("async native with enqueued callback")
+    {
+        // the native starts the work and returns immediately, the host
+        // hands the result to the callback once it has it
+        std::shared_ptr<lox::Callable> pending_callback;
+        lox.in_global_scope()->define_native_function
+        (
+            "fetch",
+            [&](lox::Callable*, lox::ArgumentHelper& helper) -> std::shared_ptr<lox::Object>
+            {
+                auto callback = helper.require_callable("on_done");
+                if(helper.complete()) return lox::make_nil();
+                pending_callback = callback;
+                return lox::make_nil();
+            }
+        );
+
+        REQUIRE(lox.run_string("fun on_data(result) { print result; } fetch(on_data);"));
+        REQUIRE(pending_callback != nullptr);
+        CHECK(StringEq(console_out, {}));
+
+        auto* interpreter = lox.get_interpreter();
+
+        // nothing to do until the host delivers a result
+        CHECK(interpreter->run_enqueued_calls() == 0);
+
+        // enqueue_call is safe from the thread the I/O completed on
+        auto io_thread = std::thread{[&]
+        {
+            interpreter->enqueue_call(pending_callback, {lox::make_string("payload")});
+        }};
+        io_thread.join();
+
+        CHECK(interpreter->run_enqueued_calls() == 1);
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out, {"payload"}));
+    }
+
+    SECTION("fuel limit")
+    {
+        auto* interpreter = lox.get_interpreter();
+
+        // a runaway loop stops with a regular runtime error instead of
+        // hanging the thread
+        interpreter->set_fuel_limit(100);
+        CHECK_FALSE(lox.run_string("while(true) {}"));
+        CHECK(error_list.empty() == false);
+        error_list.clear();
+
+        // calls are charged too, so tail recursion can't dodge the cap
+        interpreter->set_fuel_limit(100);
+        CHECK_FALSE(lox.run_string("fun spin() { return spin(); } spin();"));
+        CHECK(error_list.empty() == false);
+        error_list.clear();
+
+        // a fresh budget lets a well behaved script run as usual
+        interpreter->set_fuel_limit(1000);
+        CHECK(lox.run_string("var total = 0; var i = 0; while(i < 10) { total = total + i; i = i + 1; } print total;"));
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out, {"45"}));
+    }
+
+    SECTION("lazy package registration")
+    {
+        bool built = false;
+        lox.register_package("heavy.pkg", [&](lox::Scope& scope)
+        {
+            built = true;
+            scope.define_native_function
+            (
+                "answer",
+                [](lox::Callable*, lox::ArgumentHelper& helper)
+                {
+                    if(helper.complete()) return lox::make_nil();
+                    return lox::make_number_int(42);
+                }
+            );
+        });
+
+        // registration only creates an empty shell
+        CHECK_FALSE(built);
+        REQUIRE(lox.run_string("print heavy;"));
+        CHECK_FALSE(built);
+
+        // the first lookup into the package builds the bindings
+        REQUIRE(lox.run_string("print heavy.pkg.answer();"));
+        CHECK(built);
+
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out, {"<native pkg heavy>", "42"}));
+    }
+
+    SECTION("heap statistics")
+    {
+        const auto before = lox.get_interpreter()->get_heap_stats();
+
+        // scripts read the counters through getters on the builtin
+        // debug package
+        REQUIRE(lox.run_string(R"lox(
+            var greeting = "hello" + " world";
+            var numbers = [1, 2, 3];
+            print debug.live_objects > 0;
+        )lox"));
+
+        const auto after = lox.get_interpreter()->get_heap_stats();
+        CHECK(after.of(lox::ObjectType::string).total_count > before.of(lox::ObjectType::string).total_count);
+        CHECK(after.of(lox::ObjectType::array).total_count > before.of(lox::ObjectType::array).total_count);
+        CHECK(after.total_objects > before.total_objects);
+        CHECK(after.total_bytes > before.total_bytes);
+        CHECK(after.peak_live_objects >= after.live_objects);
+        CHECK(after.total_environments > 0);
+
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out, {"true"}));
+    }
+
+    SECTION("typed arrays")
+    {
+        auto integration = lox::make_object_integration();
+        lox.in_global_scope()->define_native_function
+        (
+            "telemetry",
+            [&](lox::Callable*, lox::ArgumentHelper& ah) -> std::shared_ptr<lox::Object>
+            {
+                if(ah.complete()) return lox::make_nil();
+                return integration->make_int_array({10, 20, 30});
+            }
+        );
+        lox.in_global_scope()->define_native_function
+        (
+            "samples",
+            [&](lox::Callable*, lox::ArgumentHelper& ah) -> std::shared_ptr<lox::Object>
+            {
+                if(ah.complete()) return lox::make_nil();
+                return integration->make_float_array({0.5, 1.5});
+            }
+        );
+
+        const auto run_ok = lox.run_string
+        (R"lox(
+            var ints = telemetry();
+            print ints.len();
+            print ints[1];
+            ints[1] = ints[1] + 2;
+            ints.push(40);
+            print ints;
+
+            var floats = samples();
+            floats.push(3);
+            print floats[0] + floats[1];
+            print floats;
+        )lox");
+        CHECK(run_ok);
+        REQUIRE(StringEq(error_list, {}));
+        CHECK(StringEq(console_out,{
+            "3",
+            "20",
+            "[10, 22, 30, 40]",
+            "2",
+            "[0.5, 1.5, 3]"
+        }));
+    }
+
     SECTION("cpp -> lox binding")
     {
         const auto run_ok = lox.run_string
@@ -187,9 +491,9 @@ TEST_CASE("lox binding" "[lox]")
         CHECK(StringEq(console_out,{}));
 
         auto function_object = lox.get_global_environment().get_or_null("hello");
-        REQUIRE(function_object != nullptr);
+        REQUIRE(function_object.has_value());
 
-        auto callable = lox::as_callable(function_object);
+        auto callable = lox::as_callable(*function_object);
         REQUIRE(callable != nullptr);
         
         auto res = callable->call(lox.get_interpreter(), {{lox::make_string("world")} });
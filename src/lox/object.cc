@@ -1,9 +1,12 @@
 #include "lox/object.h"
 
+#include <atomic>
+#include <chrono>
 #include <sstream>
 
 #include "lox/interpreter.h"
 #include "lox/scanner.h"
+#include "lox/trace.h"
 
 #include <fmt/format.h>
 
@@ -13,28 +16,41 @@ namespace lox
 
 struct ObjectIntegrationImpl : ObjectIntegration
 {
-    std::unordered_map<std::string, std::shared_ptr<Callable>> array_methods;
-    
+    std::unordered_map<Symbol, std::shared_ptr<Callable>> array_methods;
+    std::unordered_map<Symbol, std::shared_ptr<Callable>> int_array_methods;
+    std::unordered_map<Symbol, std::shared_ptr<Callable>> float_array_methods;
+
     ObjectIntegrationImpl()
     {
         register_functions();
     }
 
+    void add_method
+    (
+        std::unordered_map<Symbol, std::shared_ptr<Callable>>* methods,
+        const std::string& name,
+        NativeFunction&& func
+    )
+    {
+        const auto symbol = intern_symbol(name);
+        assert(methods->find(symbol) == methods->end());
+        methods->insert({symbol, make_native_function(name, std::move(func))});
+    }
+
     void add_array_method
     (
         const std::string& name,
         NativeFunction&& func
     )
     {
-        assert(array_methods.find(name) == array_methods.end());
-        array_methods.insert({name, make_native_function(name, std::move(func))});
+        add_method(&array_methods, name, std::move(func));
     }
 
-    std::shared_ptr<Callable>
-    find_array_method_or_null(const std::string& name)
+    static std::shared_ptr<Callable>
+    find_method_or_null(std::unordered_map<Symbol, std::shared_ptr<Callable>>& methods, Symbol name)
     {
-        auto found = array_methods.find(name);
-        if(found == array_methods.end())
+        auto found = methods.find(name);
+        if(found == methods.end())
         {
             return nullptr;
         }
@@ -42,10 +58,34 @@ struct ObjectIntegrationImpl : ObjectIntegration
         return found->second;
     }
 
+    std::shared_ptr<Callable>
+    find_array_method_or_null(Symbol name)
+    {
+        return find_method_or_null(array_methods, name);
+    }
+
+    std::shared_ptr<Callable>
+    find_int_array_method_or_null(Symbol name)
+    {
+        return find_method_or_null(int_array_methods, name);
+    }
+
+    std::shared_ptr<Callable>
+    find_float_array_method_or_null(Symbol name)
+    {
+        return find_method_or_null(float_array_methods, name);
+    }
+
     void register_functions();
 
     std::shared_ptr<Object>
     make_array(std::vector<std::shared_ptr<Object>>&& values) override;
+
+    std::shared_ptr<Object>
+    make_int_array(std::vector<Ti>&& values) override;
+
+    std::shared_ptr<Object>
+    make_float_array(std::vector<Tf>&& values) override;
 };
 
 
@@ -58,33 +98,39 @@ namespace lox { namespace
 
 // ----------------------------------------------------------------------------
 
-std::string quote_string(const std::string& str)
+void append_quoted(std::string* out, const std::string& str)
 {
-    std::ostringstream ss;
-    ss << '\"';
+    *out += '\"';
     for(const auto c: str)
     {
         switch(c)
         {
         case '\r':
-            ss << "\\r";
+            *out += "\\r";
             break;
         case '\t':
-            ss << "\\t";
+            *out += "\\t";
             break;
         case '\n':
-            ss << "\\n";
+            *out += "\\n";
             break;
         case '"':
-            ss << "\\\"";
+            *out += "\\\"";
             break;
         default:
-            ss << c;
+            *out += c;
             break;
         }
     }
-    ss << '\"';
-    return ss.str();
+    *out += '\"';
+}
+
+std::string quote_string(const std::string& str)
+{
+    std::string quoted;
+    quoted.reserve(str.size() + 2);
+    append_quoted(&quoted, str);
+    return quoted;
 }
 
 
@@ -110,6 +156,7 @@ struct String : public Object
 
     ObjectType get_type() const override;
     std::vector<std::string> to_string(Interpreter*, Callable* c, const ToStringOptions&) override;
+    void write_string(std::string* out, Interpreter*, Callable* c, const ToStringOptions&) override;
     bool is_callable() const override { return false; }
 };
 
@@ -137,6 +184,7 @@ struct NumberInt : public Object
 
     ObjectType get_type() const override;
     std::vector<std::string> to_string(Interpreter*, Callable* c, const ToStringOptions&) override;
+    void write_string(std::string* out, Interpreter*, Callable* c, const ToStringOptions&) override;
     bool is_callable() const override { return false; }
 };
 
@@ -149,6 +197,7 @@ struct NumberFloat : public Object
 
     ObjectType get_type() const override;
     std::vector<std::string> to_string(Interpreter*, Callable* c, const ToStringOptions&) override;
+    void write_string(std::string* out, Interpreter*, Callable* c, const ToStringOptions&) override;
     bool is_callable() const override { return false; }
 };
 
@@ -171,6 +220,10 @@ struct NativeFunctionObject : Callable
     std::string name;
     NativeFunction func;
 
+    // the argument metadata never changes, the introspection pass runs
+    // once and later to_string/error formatting reuses the result
+    std::optional<ArgInfo> cached_arg_info;
+
     NativeFunctionObject
     (
         const std::string& n,
@@ -201,13 +254,17 @@ struct NativeFunctionObject : Callable
 
     ArgInfo get_arg_info(Interpreter* inter, Callable* callable) override
     {
-        ArgumentHelper helper{inter, nullptr};
-        auto ret = func(callable, helper);
-        return {helper.arguments_requested};
+        if(cached_arg_info.has_value() == false)
+        {
+            ArgumentHelper helper{inter, nullptr};
+            func(callable, helper);
+            cached_arg_info = ArgInfo{helper.arguments_requested};
+        }
+        return *cached_arg_info;
     }
 
     std::shared_ptr<Object>
-    call(Interpreter* inter, const Arguments& arguments) override
+    do_call(Interpreter* inter, const Arguments& arguments) override
     {
         return perform_call(inter, this, arguments);
     }
@@ -216,7 +273,7 @@ struct NativeFunctionObject : Callable
     bind(std::shared_ptr<Object> bound) override
     {
         auto self = std::static_pointer_cast<NativeFunctionObject>(shared_from_this());
-        return std::make_shared<BoundCallable>(bound, self);
+        return make_tracked<BoundCallable>(bound, self);
     }
 };
 
@@ -265,6 +322,19 @@ String::to_string(Interpreter*, Callable*, const ToStringOptions& tso)
     }
 }
 
+void
+String::write_string(std::string* out, Interpreter*, Callable*, const ToStringOptions& tso)
+{
+    if(tso.quote_string)
+    {
+        append_quoted(out, value);
+    }
+    else
+    {
+        *out += value;
+    }
+}
+
 
 
 // ----------------------------------------------------------------------------
@@ -356,9 +426,49 @@ Array::to_string(Interpreter* inter, Callable* c, const ToStringOptions& tsoa)
 }
 
 
+void
+Array::write_string(std::string* out, Interpreter* inter, Callable* c, const ToStringOptions& tsoa)
+{
+    const auto tso = tsoa.with_quote_string(true);
+
+    // append the flat form directly, bail to the pretty printing
+    // to_string if a child turned out multi-line or it got too long
+    const auto start = out->size();
+    *out += "[";
+    bool first = true;
+    bool flat = true;
+    for(const auto& v: values)
+    {
+        if(first) { first = false; }
+        else { *out += ", "; }
+
+        v->write_string(out, inter, c, tso);
+        if(out->size() - start >= tso.max_length || out->find('\n', start) != std::string::npos)
+        {
+            flat = false;
+            break;
+        }
+    }
+    if(flat)
+    {
+        *out += "]";
+        return;
+    }
+    out->resize(start);
+
+    first = true;
+    for(const auto& line: to_string(inter, c, tsoa))
+    {
+        if(first) { first = false; }
+        else { *out += '\n'; }
+        *out += line;
+    }
+}
+
+
 
 std::shared_ptr<Object>
-Array::get_property_or_null(const std::string& name)
+Array::get_property_or_null(Symbol name)
 {
     if(auto method = integration->find_array_method_or_null(name); method != nullptr)
     {
@@ -372,11 +482,274 @@ Array::get_property_or_null(const std::string& name)
 
 
 bool
-Array::set_property_or_false(const std::string&, std::shared_ptr<Object>)
+Array::set_property_or_false(Symbol, std::shared_ptr<Object>)
+{
+    return false;
+}
+
+
+void
+Array::visit_references(GcReferenceVisitor* visitor)
+{
+    for(const auto& value: values)
+    {
+        visitor->on_object(value);
+    }
+}
+
+
+void
+Array::clear_references()
+{
+    values.clear();
+}
+
+
+
+// ----------------------------------------------------------------------------
+
+
+namespace
+{
+    Ti as_int_array_element(std::shared_ptr<Object> o)
+    {
+        const auto i = as_int(o);
+        if(i.has_value() == false)
+        {
+            const auto seen = o->get_type();
+            throw NativeError{[seen]{ return fmt::format("int array can only store ints, was {}", objecttype_to_string(seen)); }};
+        }
+        return *i;
+    }
+
+    Tf as_float_array_element(std::shared_ptr<Object> o)
+    {
+        if(const auto f = as_float(o); f.has_value())
+        {
+            return *f;
+        }
+        if(const auto i = as_int(o); i.has_value())
+        {
+            return static_cast<Tf>(*i);
+        }
+        const auto seen = o->get_type();
+        throw NativeError{[seen]{ return fmt::format("float array can only store numbers, was {}", objecttype_to_string(seen)); }};
+    }
+
+    template <typename TArray>
+    void typed_array_write_string(std::string* out, const TArray& array)
+    {
+        *out += "[";
+        bool first = true;
+        for(const auto v: array.values)
+        {
+            if(first) { first = false; }
+            else { *out += ", "; }
+            fmt::format_to(std::back_inserter(*out), "{}", v);
+        }
+        *out += "]";
+    }
+
+    template <typename TArray>
+    std::vector<std::string> typed_array_to_string(const TArray& array)
+    {
+        std::string flat;
+        typed_array_write_string(&flat, array);
+        return {std::move(flat)};
+    }
+
+    template <typename TArray>
+    std::size_t typed_array_bounds_checked_get(const TArray& array, std::shared_ptr<Object> index_object)
+    {
+        const auto index = Array::as_array_index(index_object);
+        if(index >= array.values.size())
+        {
+            const auto length = array.values.size();
+            throw NativeError{[index, length]{ return fmt::format("array index {} out of range, needs to be lower than {}", index, length); }};
+        }
+        return index;
+    }
+
+    template <typename TArray>
+    std::size_t typed_array_bounds_checked_set(const TArray& array, std::shared_ptr<Object> index_object)
+    {
+        const auto index = Array::as_array_index(index_object);
+        if(index >= array.values.size())
+        {
+            const auto length = array.values.size();
+            throw NativeError{[index, length]{ return fmt::format("array index {} is out of range, needs to be lower than {}", index, length); }};
+        }
+        return index;
+    }
+
+    Ti typed_array_length(std::size_t length)
+    {
+        if(static_cast<std::size_t>(std::numeric_limits<Ti>::max()) < length)
+        {
+            throw NativeError { "array length too big for script numbers" };
+        }
+        return static_cast<Ti>(length);
+    }
+
+    template <typename TArray>
+    std::shared_ptr<TArray> get_bound_typed_array(Callable* callable, ObjectType expected)
+    {
+        assert(callable->is_bound());
+        BoundCallable* bound = static_cast<BoundCallable*>(callable);
+        assert(bound->bound != nullptr);
+        assert(bound->bound->get_type() == expected);
+        (void) expected;
+        auto array = std::static_pointer_cast<TArray>(bound->bound);
+        assert(array != nullptr);
+        return array;
+    }
+}
+
+
+IntArray::IntArray(ObjectIntegrationImpl* i, std::vector<Ti>&& v)
+    : integration(i)
+    , values(v)
+{
+}
+
+ObjectType
+IntArray::get_type() const
+{
+    return ObjectType::int_array;
+}
+
+std::vector<std::string>
+IntArray::to_string(Interpreter*, Callable*, const ToStringOptions&)
+{
+    return typed_array_to_string(*this);
+}
+
+void
+IntArray::write_string(std::string* out, Interpreter*, Callable*, const ToStringOptions&)
+{
+    typed_array_write_string(out, *this);
+}
+
+bool
+IntArray::is_callable() const
+{
+    return false;
+}
+
+bool
+IntArray::has_properties()
+{
+    return true;
+}
+
+std::shared_ptr<Object>
+IntArray::get_property_or_null(Symbol name)
+{
+    if(auto method = integration->find_int_array_method_or_null(name); method != nullptr)
+    {
+        auto self = shared_from_this();
+        assert(self != nullptr);
+        return method->bind(self);
+    }
+
+    return nullptr;
+}
+
+bool
+IntArray::has_index() const
+{
+    return true;
+}
+
+std::shared_ptr<Object>
+IntArray::get_index_or_null(std::shared_ptr<Object> index_object)
+{
+    const auto index = typed_array_bounds_checked_get(*this, index_object);
+    return make_number_int(values[index]);
+}
+
+bool
+IntArray::set_index_or_false(std::shared_ptr<Object> index_object, std::shared_ptr<Object> new_value)
+{
+    const auto index = typed_array_bounds_checked_set(*this, index_object);
+    values[index] = as_int_array_element(new_value);
+    return true;
+}
+
+
+// ----------------------------------------------------------------------------
+
+
+FloatArray::FloatArray(ObjectIntegrationImpl* i, std::vector<Tf>&& v)
+    : integration(i)
+    , values(v)
+{
+}
+
+ObjectType
+FloatArray::get_type() const
+{
+    return ObjectType::float_array;
+}
+
+std::vector<std::string>
+FloatArray::to_string(Interpreter*, Callable*, const ToStringOptions&)
+{
+    return typed_array_to_string(*this);
+}
+
+void
+FloatArray::write_string(std::string* out, Interpreter*, Callable*, const ToStringOptions&)
+{
+    typed_array_write_string(out, *this);
+}
+
+bool
+FloatArray::is_callable() const
 {
     return false;
 }
 
+bool
+FloatArray::has_properties()
+{
+    return true;
+}
+
+std::shared_ptr<Object>
+FloatArray::get_property_or_null(Symbol name)
+{
+    if(auto method = integration->find_float_array_method_or_null(name); method != nullptr)
+    {
+        auto self = shared_from_this();
+        assert(self != nullptr);
+        return method->bind(self);
+    }
+
+    return nullptr;
+}
+
+bool
+FloatArray::has_index() const
+{
+    return true;
+}
+
+std::shared_ptr<Object>
+FloatArray::get_index_or_null(std::shared_ptr<Object> index_object)
+{
+    const auto index = typed_array_bounds_checked_get(*this, index_object);
+    return make_number_float(values[index]);
+}
+
+bool
+FloatArray::set_index_or_false(std::shared_ptr<Object> index_object, std::shared_ptr<Object> new_value)
+{
+    const auto index = typed_array_bounds_checked_set(*this, index_object);
+    values[index] = as_float_array_element(new_value);
+    return true;
+}
+
 
 
 // ----------------------------------------------------------------------------
@@ -385,6 +758,96 @@ Array::set_property_or_false(const std::string&, std::shared_ptr<Object>)
 void
 ObjectIntegrationImpl::register_functions()
 {
+    add_method(&int_array_methods, "len", [](Callable* callable, ArgumentHelper& arguments) -> std::shared_ptr<Object>
+    {
+        auto array = get_bound_typed_array<IntArray>(callable, ObjectType::int_array);
+
+        if(arguments.complete())
+        {
+            return make_nil();
+        }
+
+        return make_number_int(typed_array_length(array->values.size()));
+    });
+
+    add_method(&int_array_methods, "push", [](Callable* callable, ArgumentHelper& arguments) -> std::shared_ptr<Object>
+    {
+        auto array = get_bound_typed_array<IntArray>(callable, ObjectType::int_array);
+
+        auto to_add = arguments.require_object("to_add");
+        if(arguments.complete())
+        {
+            return make_nil();
+        }
+
+        array->values.emplace_back(as_int_array_element(to_add));
+
+        return make_nil();
+    });
+
+    add_method(&int_array_methods, "remove_front", [](Callable* callable, ArgumentHelper& arguments) -> std::shared_ptr<Object>
+    {
+        auto array = get_bound_typed_array<IntArray>(callable, ObjectType::int_array);
+
+        if(arguments.complete())
+        {
+            return make_nil();
+        }
+
+        if(array->values.empty())
+        {
+            throw NativeError{{"Can't remove item from empty array"}};
+        }
+        array->values.erase(array->values.begin());
+
+        return make_nil();
+    });
+
+    add_method(&float_array_methods, "len", [](Callable* callable, ArgumentHelper& arguments) -> std::shared_ptr<Object>
+    {
+        auto array = get_bound_typed_array<FloatArray>(callable, ObjectType::float_array);
+
+        if(arguments.complete())
+        {
+            return make_nil();
+        }
+
+        return make_number_int(typed_array_length(array->values.size()));
+    });
+
+    add_method(&float_array_methods, "push", [](Callable* callable, ArgumentHelper& arguments) -> std::shared_ptr<Object>
+    {
+        auto array = get_bound_typed_array<FloatArray>(callable, ObjectType::float_array);
+
+        auto to_add = arguments.require_object("to_add");
+        if(arguments.complete())
+        {
+            return make_nil();
+        }
+
+        array->values.emplace_back(as_float_array_element(to_add));
+
+        return make_nil();
+    });
+
+    add_method(&float_array_methods, "remove_front", [](Callable* callable, ArgumentHelper& arguments) -> std::shared_ptr<Object>
+    {
+        auto array = get_bound_typed_array<FloatArray>(callable, ObjectType::float_array);
+
+        if(arguments.complete())
+        {
+            return make_nil();
+        }
+
+        if(array->values.empty())
+        {
+            throw NativeError{{"Can't remove item from empty array"}};
+        }
+        array->values.erase(array->values.begin());
+
+        return make_nil();
+    });
+
     add_array_method("len", [](Callable* callable, ArgumentHelper& arguments) -> std::shared_ptr<Object>
     {
         // todo(Gustav): move to a more clean place?
@@ -453,6 +916,72 @@ ObjectIntegrationImpl::register_functions()
 
         return make_nil();
     });
+
+    // the combinators run on the calling thread: the interpreter mutates
+    // environments, inline caches and gc bookkeeping without locks, so
+    // handing script callables to worker threads is not an option; the win
+    // over a script loop is skipping the per-element statement dispatch
+
+    add_array_method("map", [](Callable* callable, ArgumentHelper& arguments) -> std::shared_ptr<Object>
+    {
+        auto array = get_bound_typed_array<Array>(callable, ObjectType::array);
+
+        auto func = arguments.require_callable("func");
+        if(arguments.complete())
+        {
+            return make_nil();
+        }
+
+        std::vector<std::shared_ptr<Object>> mapped;
+        mapped.reserve(array->values.size());
+        for(auto& value: array->values)
+        {
+            mapped.emplace_back(func->call(arguments.inter, {{value}}));
+        }
+
+        return array->integration->make_array(std::move(mapped));
+    });
+
+    add_array_method("filter", [](Callable* callable, ArgumentHelper& arguments) -> std::shared_ptr<Object>
+    {
+        auto array = get_bound_typed_array<Array>(callable, ObjectType::array);
+
+        auto func = arguments.require_callable("func");
+        if(arguments.complete())
+        {
+            return make_nil();
+        }
+
+        std::vector<std::shared_ptr<Object>> kept;
+        for(auto& value: array->values)
+        {
+            if(is_truthy(func->call(arguments.inter, {{value}})))
+            {
+                kept.emplace_back(value);
+            }
+        }
+
+        return array->integration->make_array(std::move(kept));
+    });
+
+    add_array_method("reduce", [](Callable* callable, ArgumentHelper& arguments) -> std::shared_ptr<Object>
+    {
+        auto array = get_bound_typed_array<Array>(callable, ObjectType::array);
+
+        auto func = arguments.require_callable("func");
+        auto accumulator = arguments.require_object("initial");
+        if(arguments.complete())
+        {
+            return make_nil();
+        }
+
+        for(auto& value: array->values)
+        {
+            accumulator = func->call(arguments.inter, {{accumulator, value}});
+        }
+
+        return accumulator;
+    });
 }
 
 
@@ -472,46 +1001,177 @@ NumberInt::get_type() const
     return ObjectType::number_int;
 }
 
-std::vector<std::string>
-NumberInt::to_string(Interpreter*, Callable*, const ToStringOptions&)
-{
-    return {fmt::format("{0}", value)};
-}
+std::vector<std::string>
+NumberInt::to_string(Interpreter*, Callable*, const ToStringOptions&)
+{
+    return {fmt::format("{0}", value)};
+}
+
+void
+NumberInt::write_string(std::string* out, Interpreter*, Callable*, const ToStringOptions&)
+{
+    fmt::format_to(std::back_inserter(*out), "{0}", value);
+}
+
+
+// ----------------------------------------------------------------------------
+
+
+
+NumberFloat::NumberFloat(Tf f)
+    : value(f)
+{
+}
+
+ObjectType
+NumberFloat::get_type() const
+{
+    return ObjectType::number_float;
+}
+
+std::vector<std::string>
+NumberFloat::to_string(Interpreter*, Callable*, const ToStringOptions&)
+{
+    return {fmt::format("{0}", value)};
+}
+
+void
+NumberFloat::write_string(std::string* out, Interpreter*, Callable*, const ToStringOptions&)
+{
+    fmt::format_to(std::back_inserter(*out), "{0}", value);
+}
+
+
+
+// ----------------------------------------------------------------------------
+
+// the live heap counters, always on and process wide; everything is
+// relaxed since the numbers only feed monitoring, the peaks can lag a
+// concurrent burst by a few objects but never go backwards
+namespace
+{
+    struct AtomicPerType
+    {
+        std::atomic<u64> live_count{0};
+        std::atomic<u64> live_bytes{0};
+        std::atomic<u64> total_count{0};
+        std::atomic<u64> total_bytes{0};
+    };
+
+    AtomicPerType counted_types[HeapStats::type_count];
+
+    std::atomic<u64> counted_live_objects{0};
+    std::atomic<u64> counted_live_bytes{0};
+    std::atomic<u64> counted_peak_live_objects{0};
+    std::atomic<u64> counted_peak_live_bytes{0};
+
+    std::atomic<u64> counted_live_environments{0};
+    std::atomic<u64> counted_total_environments{0};
+    std::atomic<u64> counted_peak_live_environments{0};
+
+    void raise_peak(std::atomic<u64>& peak, u64 seen)
+    {
+        auto current = peak.load(std::memory_order_relaxed);
+        while(current < seen && peak.compare_exchange_weak(current, seen, std::memory_order_relaxed) == false)
+        {
+        }
+    }
+}
+
 
+void
+count_object_created(Object* object, std::size_t bytes)
+{
+    const auto type = object->get_type();
+    object->counted_type = type;
+    object->counted_bytes = static_cast<u32>(bytes);
 
-// ----------------------------------------------------------------------------
+    auto& counter = counted_types[static_cast<std::size_t>(type)];
+    counter.live_count.fetch_add(1, std::memory_order_relaxed);
+    counter.live_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counter.total_count.fetch_add(1, std::memory_order_relaxed);
+    counter.total_bytes.fetch_add(bytes, std::memory_order_relaxed);
 
+    const auto live = counted_live_objects.fetch_add(1, std::memory_order_relaxed) + 1;
+    const auto live_bytes = counted_live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    raise_peak(counted_peak_live_objects, live);
+    raise_peak(counted_peak_live_bytes, live_bytes);
+}
 
 
-NumberFloat::NumberFloat(Tf f)
-    : value(f)
+void
+count_environment_created()
 {
+    counted_total_environments.fetch_add(1, std::memory_order_relaxed);
+    const auto live = counted_live_environments.fetch_add(1, std::memory_order_relaxed) + 1;
+    raise_peak(counted_peak_live_environments, live);
 }
 
-ObjectType
-NumberFloat::get_type() const
+
+void
+count_environment_destroyed()
 {
-    return ObjectType::number_float;
+    counted_live_environments.fetch_sub(1, std::memory_order_relaxed);
 }
 
-std::vector<std::string>
-NumberFloat::to_string(Interpreter*, Callable*, const ToStringOptions&)
+
+HeapStats
+get_heap_stats()
 {
-    return {fmt::format("{0}", value)};
+    HeapStats r;
+    for(std::size_t type_index = 0; type_index < HeapStats::type_count; type_index += 1)
+    {
+        const auto& counter = counted_types[type_index];
+        auto& snapshot = r.types[type_index];
+        snapshot.live_count = counter.live_count.load(std::memory_order_relaxed);
+        snapshot.live_bytes = counter.live_bytes.load(std::memory_order_relaxed);
+        snapshot.total_count = counter.total_count.load(std::memory_order_relaxed);
+        snapshot.total_bytes = counter.total_bytes.load(std::memory_order_relaxed);
+        r.total_objects += snapshot.total_count;
+        r.total_bytes += snapshot.total_bytes;
+    }
+    r.live_objects = counted_live_objects.load(std::memory_order_relaxed);
+    r.live_bytes = counted_live_bytes.load(std::memory_order_relaxed);
+    r.peak_live_objects = counted_peak_live_objects.load(std::memory_order_relaxed);
+    r.peak_live_bytes = counted_peak_live_bytes.load(std::memory_order_relaxed);
+    r.live_environments = counted_live_environments.load(std::memory_order_relaxed);
+    r.total_environments = counted_total_environments.load(std::memory_order_relaxed);
+    r.peak_live_environments = counted_peak_live_environments.load(std::memory_order_relaxed);
+    return r;
 }
 
 
-
 // ----------------------------------------------------------------------------
 
 
+Object::~Object()
+{
+    if(counted_bytes == 0)
+    {
+        return;
+    }
+
+    auto& counter = counted_types[static_cast<std::size_t>(counted_type)];
+    counter.live_count.fetch_sub(1, std::memory_order_relaxed);
+    counter.live_bytes.fetch_sub(counted_bytes, std::memory_order_relaxed);
+    counted_live_objects.fetch_sub(1, std::memory_order_relaxed);
+    counted_live_bytes.fetch_sub(counted_bytes, std::memory_order_relaxed);
+}
+
+
 std::string
 Object::to_flat_string(Interpreter* inter, Callable* c, const ToStringOptions& tso)
 {
+    std::string flat;
+    write_string(&flat, inter, c, tso);
+    if(flat.find('\n') == std::string::npos)
+    {
+        return flat;
+    }
+
     std::ostringstream ss;
     const auto arr = to_string(inter, c, tso);
-    const auto many = arr.size() > 1;
-    if(many) { ss << "["; }
+    ss << "[";
 
     bool first = true;
     for(const auto& a: arr)
@@ -521,11 +1181,24 @@ Object::to_flat_string(Interpreter* inter, Callable* c, const ToStringOptions& t
         ss << a;
     }
 
-    if(many) { ss << "]"; }
+    ss << "]";
     return ss.str();
 }
 
 
+void
+Object::write_string(std::string* out, Interpreter* inter, Callable* c, const ToStringOptions& tso)
+{
+    bool first = true;
+    for(const auto& line: to_string(inter, c, tso))
+    {
+        if(first) { first = false; }
+        else { *out += '\n'; }
+        *out += line;
+    }
+}
+
+
 bool
 Object::has_properties()
 {
@@ -533,13 +1206,13 @@ Object::has_properties()
 }
 
 std::shared_ptr<Object>
-Object::get_property_or_null(const std::string&)
+Object::get_property_or_null(Symbol)
 {
     return nullptr;
 }
 
 bool
-Object::set_property_or_false(const std::string&, std::shared_ptr<Object>)
+Object::set_property_or_false(Symbol, std::shared_ptr<Object>)
 {
     return false;
 }
@@ -565,11 +1238,90 @@ Object::set_index_or_false(std::shared_ptr<Object>, std::shared_ptr<Object>)
 }
 
 
+void
+Object::visit_references(GcReferenceVisitor*)
+{
+}
+
+
+void
+Object::clear_references()
+{
+}
+
+
 
 // ----------------------------------------------------------------------------
 
 
 
+namespace
+{
+    // updates the profiler when a call completes, a destructor so
+    // runtime errors unwinding through the call are still counted
+    struct ProfiledCall
+    {
+        CallProfiler* profiler;
+        Callable* callable;
+        std::chrono::steady_clock::time_point start;
+
+        ProfiledCall(CallProfiler* p, Callable* c)
+            : profiler(p)
+            , callable(c)
+            , start(std::chrono::steady_clock::now())
+        {
+            profiler->child_ns_stack.emplace_back(0);
+        }
+
+        ~ProfiledCall()
+        {
+            const auto duration = static_cast<u64>
+            (
+                std::chrono::duration_cast<std::chrono::nanoseconds>
+                (
+                    std::chrono::steady_clock::now() - start
+                ).count()
+            );
+            const auto child_ns = profiler->child_ns_stack.back();
+            profiler->child_ns_stack.pop_back();
+
+            auto& counters = profiler->counters[callable];
+            if(counters.callable == nullptr)
+            {
+                counters.callable = std::static_pointer_cast<Callable>(callable->shared_from_this());
+            }
+            counters.call_count += 1;
+            counters.total_ns += duration;
+            counters.child_ns += child_ns;
+
+            // the whole duration is callee time from the caller's view
+            if(profiler->child_ns_stack.empty() == false)
+            {
+                profiler->child_ns_stack.back() += duration;
+            }
+        }
+
+        ProfiledCall(const ProfiledCall&) = delete;
+        ProfiledCall(ProfiledCall&&) = delete;
+        void operator=(const ProfiledCall&) = delete;
+        void operator=(ProfiledCall&&) = delete;
+    };
+}
+
+
+std::shared_ptr<Object> Callable::call(Interpreter* inter, const Arguments& arguments)
+{
+    auto* profiler = inter->get_call_profiler_or_null();
+    if(profiler == nullptr)
+    {
+        return do_call(inter, arguments);
+    }
+
+    const auto profiled = ProfiledCall{profiler, this};
+    return do_call(inter, arguments);
+}
+
+
 ObjectType Callable::get_type() const
 {
     return ObjectType::callable;
@@ -609,7 +1361,7 @@ BoundCallable::to_string(Interpreter* inter, Callable*, const ToStringOptions&)
 }
 
 std::shared_ptr<Object>
-BoundCallable::call(Interpreter* inter, const Arguments& arguments)
+BoundCallable::do_call(Interpreter* inter, const Arguments& arguments)
 {
     return callable->perform_call(inter, this, arguments);
 }
@@ -631,6 +1383,13 @@ ArgInfo BoundCallable::get_arg_info(Interpreter* inter, Callable*)
     return callable->get_arg_info(inter, this);
 }
 
+void
+BoundCallable::visit_references(GcReferenceVisitor* visitor)
+{
+    visitor->on_object(bound);
+    visitor->on_object(callable);
+}
+
 
 
 // ----------------------------------------------------------------------------
@@ -662,9 +1421,12 @@ Klass::is_callable() const
 bool
 Klass::add_method_or_false(const std::string& name, std::shared_ptr<Callable> method)
 {
-    if(methods.find(name) == methods.end())
+    const auto symbol = intern_symbol(name);
+    if(methods.find(symbol) == methods.end())
     {
-        methods.insert({name, method});
+        // own methods always win over anything merged from a superklass
+        flat_methods[symbol] = FlatMethod{method, 0};
+        methods.insert({symbol, method});
         return true;
     }
     else
@@ -674,7 +1436,7 @@ Klass::add_method_or_false(const std::string& name, std::shared_ptr<Callable> me
 }
 
 std::shared_ptr<Callable>
-Klass::find_method_or_null(const std::string& method_name)
+Klass::find_method_or_null(Symbol method_name)
 {
     if(auto found = methods.find(method_name); found != methods.end())
     {
@@ -685,13 +1447,53 @@ Klass::find_method_or_null(const std::string& method_name)
 }
 
 
+void
+Klass::flatten_method_table()
+{
+    if(methods_flattened)
+    {
+        return;
+    }
+    methods_flattened = true;
+
+    if(superklass == nullptr)
+    {
+        return;
+    }
+
+    superklass->flatten_method_table();
+    for(const auto& method: superklass->flat_methods)
+    {
+        auto entry = method.second;
+        entry.parent_depth += 1;
+
+        // insert does not overwrite overrides that are already in place
+        flat_methods.insert({method.first, entry});
+    }
+}
+
+
+const FlatMethod*
+Klass::find_flat_method_or_null(Symbol name)
+{
+    flatten_method_table();
+
+    if(auto found = flat_methods.find(name); found != flat_methods.end())
+    {
+        return &found->second;
+    }
+
+    return nullptr;
+}
+
+
 bool
 Klass::add_static_method_or_false(const std::string& name, std::shared_ptr<Callable> method)
 {
-    if(static_methods.find(name) == static_methods.end())
+    const auto symbol = intern_symbol(name);
+    if(static_methods.find(symbol) == static_methods.end())
     {
-        // static_methods.insert({name, method});
-        static_methods.insert({name, std::move(method)});
+        static_methods.insert({symbol, std::move(method)});
         return true;
     }
     else
@@ -709,7 +1511,7 @@ Klass::has_properties()
 
 
 std::shared_ptr<Object>
-Klass::get_property_or_null(const std::string& method_name)
+Klass::get_property_or_null(Symbol method_name)
 {
     if(auto found = static_methods.find(method_name); found != static_methods.end())
     {
@@ -721,12 +1523,33 @@ Klass::get_property_or_null(const std::string& method_name)
 
 
 bool
-Klass::set_property_or_false(const std::string&, std::shared_ptr<Object>)
+Klass::set_property_or_false(Symbol, std::shared_ptr<Object>)
 {
     return false;
 }
 
 
+void
+Klass::visit_references(GcReferenceVisitor* visitor)
+{
+    visitor->on_object(superklass);
+    for(const auto& method: methods)
+    {
+        visitor->on_object(method.second);
+    }
+    for(const auto& method: static_methods)
+    {
+        visitor->on_object(method.second);
+    }
+
+    // the flattened table holds its own references to the same callables
+    for(const auto& method: flat_methods)
+    {
+        visitor->on_object(method.second.method);
+    }
+}
+
+
 
 // ----------------------------------------------------------------------------
 
@@ -748,29 +1571,60 @@ Instance::has_properties()
     return true;
 }
 
-std::shared_ptr<Object> Instance::get_property_or_null(const std::string& name)
+std::shared_ptr<Object> Instance::get_property_or_null(Symbol name)
 {
-    if(auto found = get_field_or_null(name); found != nullptr)
+    // one probe in the flattened table finds the method no matter how
+    // deep the hierarchy is; fields at the same or a shallower level
+    // still shadow it, so probe the field maps up to where it lives
+    const auto* flat = klass->find_flat_method_or_null(name);
+
+    Instance* method_home = nullptr;
+    std::size_t depth = 0;
+    for(auto* in = this; in != nullptr; in = in->parent.get(), depth += 1)
     {
-        return found;
+        if(flat != nullptr && depth == flat->parent_depth)
+        {
+            method_home = in;
+        }
+        if(flat != nullptr && depth > flat->parent_depth)
+        {
+            break;
+        }
+        if(auto found = in->get_field_or_null(name); found != nullptr)
+        {
+            return found;
+        }
     }
 
-    if(auto method = klass->find_method_or_null(name); method != nullptr)
+    if(method_home != nullptr)
     {
-        auto self = shared_from_this();
+        auto self = method_home->shared_from_this();
         assert(self != nullptr);
-        return method->bind(self);
+        return flat->method->bind(self);
     }
 
-    if(parent == nullptr)
-    {
-        return nullptr;
-    }
+    return nullptr;
+}
+
+std::size_t
+Instance::get_field_slot_or_npos(Symbol)
+{
+    return PropertyCache::no_field_slot;
+}
+
+std::shared_ptr<Object>
+Instance::get_field_by_slot_or_null(std::size_t)
+{
+    return nullptr;
+}
 
-    return parent->get_property_or_null(name);
+bool
+Instance::set_field_by_slot_or_false(std::size_t, std::shared_ptr<Object>)
+{
+    return false;
 }
 
-bool Instance::set_property_or_false(const std::string& name, std::shared_ptr<Object> value)
+bool Instance::set_property_or_false(Symbol name, std::shared_ptr<Object> value)
 {
     auto was_set = set_field_or_false(name, value);
     if(was_set == false && parent != nullptr)
@@ -780,12 +1634,103 @@ bool Instance::set_property_or_false(const std::string& name, std::shared_ptr<Ob
     return was_set;
 }
 
+std::shared_ptr<Object>
+Instance::get_property_or_null(Symbol name, PropertyCache& cache)
+{
+    if(cache.seen_klass.get() == klass.get())
+    {
+        auto* in = this;
+        for(std::size_t step = 0; step < cache.parent_depth; step += 1)
+        {
+            in = in->parent.get();
+            if(in == nullptr)
+            {
+                // parent chain not built yet on this instance
+                return nullptr;
+            }
+        }
+        if(cache.method != nullptr)
+        {
+            return cache.method->bind(in->shared_from_this());
+        }
+        if(cache.field_slot != PropertyCache::no_field_slot)
+        {
+            return in->get_field_by_slot_or_null(cache.field_slot);
+        }
+        return in->get_field_or_null(name);
+    }
+
+    const auto* flat = klass->find_flat_method_or_null(name);
+
+    Instance* method_home = nullptr;
+    std::size_t depth = 0;
+    for(auto* in = this; in != nullptr; in = in->parent.get(), depth += 1)
+    {
+        if(flat != nullptr && depth == flat->parent_depth)
+        {
+            method_home = in;
+        }
+        if(flat != nullptr && depth > flat->parent_depth)
+        {
+            break;
+        }
+        if(auto found = in->get_field_or_null(name); found != nullptr)
+        {
+            cache = PropertyCache{klass, depth, nullptr, in->get_field_slot_or_npos(name)};
+            return found;
+        }
+    }
+
+    if(method_home != nullptr)
+    {
+        cache = PropertyCache{klass, flat->parent_depth, flat->method};
+        return flat->method->bind(method_home->shared_from_this());
+    }
+
+    return nullptr;
+}
+
+bool
+Instance::set_property_or_false(Symbol name, std::shared_ptr<Object> value, PropertyCache& cache)
+{
+    if(cache.seen_klass.get() == klass.get() && cache.method == nullptr)
+    {
+        auto* in = this;
+        for(std::size_t step = 0; step < cache.parent_depth; step += 1)
+        {
+            in = in->parent.get();
+            if(in == nullptr)
+            {
+                // parent chain not built yet on this instance
+                return false;
+            }
+        }
+        if(cache.field_slot != PropertyCache::no_field_slot)
+        {
+            return in->set_field_by_slot_or_false(cache.field_slot, value);
+        }
+        return in->set_field_or_false(name, value);
+    }
+
+    if(set_field_or_false(name, value))
+    {
+        cache = PropertyCache{klass, 0, nullptr, get_field_slot_or_npos(name)};
+        return true;
+    }
+    if(parent != nullptr && parent->set_field_or_false(name, value))
+    {
+        cache = PropertyCache{klass, 1, nullptr, parent->get_field_slot_or_npos(name)};
+        return true;
+    }
+    return false;
+}
+
 
 // use this to call member functions on instance
 std::shared_ptr<Callable>
 Instance::get_bound_method_or_null(const std::string& name)
 {
-    auto prop = get_property_or_null(name);
+    auto prop = get_property_or_null(intern_symbol(name));
     if(prop == nullptr) { return nullptr;}
 
     if(prop->is_callable() == false) { return nullptr; }
@@ -793,6 +1738,24 @@ Instance::get_bound_method_or_null(const std::string& name)
 }
 
 
+void
+Instance::visit_references(GcReferenceVisitor* visitor)
+{
+    visitor->on_object(parent);
+    visitor->on_object(klass);
+}
+
+
+void
+Instance::clear_references()
+{
+    // the klass link stays so to_string keeps working on a collected
+    // instance, cycles that run through the klass are broken at its
+    // methods instead
+    parent.reset();
+}
+
+
 // ----------------------------------------------------------------------------
 
 
@@ -812,8 +1775,9 @@ NativeKlass::to_string(Interpreter*, Callable*, const ToStringOptions&)
 void
 NativeKlass::add_property(const std::string& name, std::unique_ptr<Property> prop)
 {
-    assert(properties.find(name) == properties.end());
-    properties.insert({name, std::move(prop)});
+    const auto symbol = intern_symbol(name);
+    assert(properties.find(symbol) == properties.end());
+    properties.insert({symbol, std::move(prop)});
 }
 
 
@@ -836,7 +1800,7 @@ NativeInstance::to_string(Interpreter*, Callable*, const ToStringOptions&)
 
 
 std::shared_ptr<Object>
-NativeInstance::get_field_or_null(const std::string& name)
+NativeInstance::get_field_or_null(Symbol name)
 {
     NativeKlass* nk = static_cast<NativeKlass*>(klass.get());
     if(auto found = nk->properties.find(name); found != nk->properties.end())
@@ -850,7 +1814,7 @@ NativeInstance::get_field_or_null(const std::string& name)
 }
 
 bool
-NativeInstance::set_field_or_false(const std::string& name, std::shared_ptr<Object> value)
+NativeInstance::set_field_or_false(Symbol name, std::shared_ptr<Object> value)
 {
     NativeKlass* nk = static_cast<NativeKlass*>(klass.get());
     if(auto found = nk->properties.find(name); found != nk->properties.end())
@@ -886,12 +1850,14 @@ std::size_t Array::as_array_index(std::shared_ptr<Object> o)
     if(index.has_value() == false)
     {
         // todo(Gustav): allow multiple rows to include object to_string
-        throw NativeError{fmt::format("array index needs to be a int, was {}", objecttype_to_string(o->get_type()) ) };
+        const auto seen = o->get_type();
+        throw NativeError{[seen]{ return fmt::format("array index needs to be a int, was {}", objecttype_to_string(seen)); }};
     }
 
     if(*index < 0)
     {
-        throw NativeError{fmt::format("array index needs to be positive, was {}", *index) };
+        const auto seen = *index;
+        throw NativeError{[seen]{ return fmt::format("array index needs to be positive, was {}", seen); }};
     }
 
     return static_cast<std::size_t>(*index);
@@ -907,7 +1873,8 @@ std::shared_ptr<Object> Array::get_index_or_null(std::shared_ptr<Object> index_o
     const auto index = as_array_index(index_object);
     if(index >= values.size())
     {
-        throw NativeError{fmt::format("array index {} out of range, needs to be lower than {}", index, values.size()) };
+        const auto length = values.size();
+        throw NativeError{[index, length]{ return fmt::format("array index {} out of range, needs to be lower than {}", index, length); }};
     }
 
     return values[index];
@@ -918,7 +1885,8 @@ bool Array::set_index_or_false(std::shared_ptr<Object> index_object, std::shared
     const auto index = as_array_index(index_object);
     if(index >= values.size())
     {
-        throw NativeError{fmt::format("array index {} is out of range, needs to be lower than {}", index, values.size()) };
+        const auto length = values.size();
+        throw NativeError{[index, length]{ return fmt::format("array index {} is out of range, needs to be lower than {}", index, length); }};
     }
 
     values[index] = new_value;
@@ -934,28 +1902,57 @@ bool Array::set_index_or_false(std::shared_ptr<Object> index_object, std::shared
 std::shared_ptr<Object>
 make_nil()
 {
-    return std::make_shared<Nil>();
+    // nil, booleans and small integers are immutable, so every user can
+    // share the same object instead of allocating per value
+    static const auto nil = std::make_shared<Nil>();
+    return nil;
 }
 
 
 std::shared_ptr<Object>
 make_string(const std::string& str)
 {
-    return std::make_shared<String>(str);
+    LOX_TRACE(object_allocated);
+    return make_tracked<String>(str);
+}
+
+
+void
+string_append_in_place(Object* string_object, std::string_view tail)
+{
+    assert(string_object->get_type() == ObjectType::string);
+    static_cast<String*>(string_object)->value += tail;
 }
 
 
 std::shared_ptr<Object>
 make_bool(bool b)
 {
-    return std::make_shared<Bool>(b);
+    static const auto true_object = std::make_shared<Bool>(true);
+    static const auto false_object = std::make_shared<Bool>(false);
+    return b ? true_object : false_object;
 }
 
 
 std::shared_ptr<Object>
 ObjectIntegrationImpl::make_array(std::vector<std::shared_ptr<Object>>&& values)
 {
-    return std::make_shared<Array>(this, std::move(values));
+    LOX_TRACE(object_allocated);
+    return make_tracked<Array>(this, std::move(values));
+}
+
+std::shared_ptr<Object>
+ObjectIntegrationImpl::make_int_array(std::vector<Ti>&& values)
+{
+    LOX_TRACE(object_allocated);
+    return make_tracked<IntArray>(this, std::move(values));
+}
+
+std::shared_ptr<Object>
+ObjectIntegrationImpl::make_float_array(std::vector<Tf>&& values)
+{
+    LOX_TRACE(object_allocated);
+    return make_tracked<FloatArray>(this, std::move(values));
 }
 
 std::unique_ptr<ObjectIntegration> make_object_integration()
@@ -964,16 +1961,41 @@ std::unique_ptr<ObjectIntegration> make_object_integration()
 }
 
 
+namespace
+{
+    // loop counters and comparison results live in this range most of
+    // the time, keep those preallocated
+    constexpr Ti small_int_min = -128;
+    constexpr Ti small_int_max = 1024;
+}
+
 std::shared_ptr<Object>
 make_number_int(Ti f)
 {
-    return std::make_shared<NumberInt>(f);
+    if(f >= small_int_min && f <= small_int_max)
+    {
+        static const auto small_ints = []
+        {
+            std::vector<std::shared_ptr<Object>> r;
+            r.reserve(static_cast<std::size_t>(small_int_max - small_int_min + 1));
+            for(Ti i = small_int_min; i <= small_int_max; i += 1)
+            {
+                r.emplace_back(make_tracked<NumberInt>(i));
+            }
+            return r;
+        }();
+        return small_ints[static_cast<std::size_t>(f - small_int_min)];
+    }
+
+    LOX_TRACE(object_allocated);
+    return make_tracked<NumberInt>(f);
 }
 
 std::shared_ptr<Object>
 make_number_float(Tf f)
 {
-    return std::make_shared<NumberFloat>(f);
+    LOX_TRACE(object_allocated);
+    return make_tracked<NumberFloat>(f);
 }
 
 
@@ -984,7 +2006,7 @@ make_native_function
     NativeFunction&& func
 )
 {
-    return std::make_shared<NativeFunctionObject>(name, func);
+    return make_tracked<NativeFunctionObject>(name, func);
 }
 
 
@@ -1049,6 +2071,22 @@ as_array(std::shared_ptr<Object> o)
     return std::static_pointer_cast<Array>(o);
 }
 
+std::shared_ptr<IntArray>
+as_int_array(std::shared_ptr<Object> o)
+{
+    assert(o != nullptr);
+    if(o->get_type() != ObjectType::int_array) { return nullptr; }
+    return std::static_pointer_cast<IntArray>(o);
+}
+
+std::shared_ptr<FloatArray>
+as_float_array(std::shared_ptr<Object> o)
+{
+    assert(o != nullptr);
+    if(o->get_type() != ObjectType::float_array) { return nullptr; }
+    return std::static_pointer_cast<FloatArray>(o);
+}
+
 std::shared_ptr<Instance>
 as_instance(std::shared_ptr<Object> o)
 {
@@ -1157,11 +2195,11 @@ ArgumentHelper::complete()
 }
 
 std::shared_ptr<Instance>
-ArgumentHelper::require_instance(const std::string& name)
+ArgumentHelper::require_instance(std::string_view name)
 {
     if(args == nullptr)
     {
-        arguments_requested.emplace_back(SingleArg{name, inter->get_instance_type()});
+        arguments_requested.emplace_back(SingleArg{std::string{name}, inter->get_instance_type()});
         return nullptr;
     }
     const auto argument_index = next_argument++;
@@ -1170,11 +2208,11 @@ ArgumentHelper::require_instance(const std::string& name)
 }
 
 std::shared_ptr<Object>
-ArgumentHelper::require_object(const std::string& name)
+ArgumentHelper::require_object(std::string_view name)
 {
     if(args == nullptr)
     {
-        arguments_requested.emplace_back(SingleArg{name, inter->get_object_type()});
+        arguments_requested.emplace_back(SingleArg{std::string{name}, inter->get_object_type()});
         return nullptr;
     }
     const auto argument_index = next_argument++;
@@ -1183,11 +2221,11 @@ ArgumentHelper::require_object(const std::string& name)
 }
 
 std::string
-ArgumentHelper::require_string(const std::string& name)
+ArgumentHelper::require_string(std::string_view name)
 {
     if(args == nullptr)
     {
-        arguments_requested.emplace_back(SingleArg{name, inter->get_string_type()});
+        arguments_requested.emplace_back(SingleArg{std::string{name}, inter->get_string_type()});
         return "";
     }
     const auto argument_index = next_argument++;
@@ -1196,11 +2234,11 @@ ArgumentHelper::require_string(const std::string& name)
 }
 
 bool
-ArgumentHelper::require_bool(const std::string& name)
+ArgumentHelper::require_bool(std::string_view name)
 {
     if(args == nullptr)
     {
-        arguments_requested.emplace_back(SingleArg{name, inter->get_bool_type()});
+        arguments_requested.emplace_back(SingleArg{std::string{name}, inter->get_bool_type()});
         return false;
     }
     const auto argument_index = next_argument++;
@@ -1209,11 +2247,11 @@ ArgumentHelper::require_bool(const std::string& name)
 }
 
 Ti
-ArgumentHelper::require_int(const std::string& name)
+ArgumentHelper::require_int(std::string_view name)
 {
     if(args == nullptr)
     {
-        arguments_requested.emplace_back(SingleArg{name, inter->get_int_type()});
+        arguments_requested.emplace_back(SingleArg{std::string{name}, inter->get_int_type()});
         return 0;
     }
     const auto argument_index = next_argument++;
@@ -1222,11 +2260,11 @@ ArgumentHelper::require_int(const std::string& name)
 }
 
 Tf
-ArgumentHelper::require_float(const std::string& name)
+ArgumentHelper::require_float(std::string_view name)
 {
     if(args == nullptr)
     {
-        arguments_requested.emplace_back(SingleArg{name, inter->get_float_type()});
+        arguments_requested.emplace_back(SingleArg{std::string{name}, inter->get_float_type()});
         return 0.0;
     }
     const auto argument_index = next_argument++;
@@ -1235,11 +2273,11 @@ ArgumentHelper::require_float(const std::string& name)
 }
 
 std::shared_ptr<Callable>
-ArgumentHelper::require_callable(const std::string& name)
+ArgumentHelper::require_callable(std::string_view name)
 {
     if(args == nullptr)
     {
-        arguments_requested.emplace_back(SingleArg{name, inter->get_callable_type()});
+        arguments_requested.emplace_back(SingleArg{std::string{name}, inter->get_callable_type()});
         return nullptr;
     }
     const auto argument_index = next_argument++;
@@ -1248,11 +2286,11 @@ ArgumentHelper::require_callable(const std::string& name)
 }
 
 std::shared_ptr<Array>
-ArgumentHelper::require_array(const std::string& name)
+ArgumentHelper::require_array(std::string_view name)
 {
     if(args == nullptr)
     {
-        arguments_requested.emplace_back(SingleArg{name, inter->get_array_type()});
+        arguments_requested.emplace_back(SingleArg{std::string{name}, inter->get_array_type()});
         return nullptr;
     }
     const auto argument_index = next_argument++;
@@ -1261,11 +2299,11 @@ ArgumentHelper::require_array(const std::string& name)
 }
 
 std::shared_ptr<NativeInstance>
-ArgumentHelper::impl_require_native_instance(const std::string& name, std::size_t klass)
+ArgumentHelper::impl_require_native_instance(std::string_view name, std::size_t klass)
 {
     if(args == nullptr)
     {
-        arguments_requested.emplace_back(SingleArg{name, inter->get_native_instance_type(klass)});
+        arguments_requested.emplace_back(SingleArg{std::string{name}, inter->get_native_instance_type(klass)});
         return nullptr;
     }
     const auto argument_index = next_argument++;
@@ -1277,7 +2315,12 @@ ArgumentHelper::impl_require_native_instance(const std::string& name, std::size_
 
 void raise_error(const std::string& message)
 {
-    throw NativeError { message };
+    throw NativeError{message};
+}
+
+void raise_error(std::function<std::string ()>&& build_message)
+{
+    throw NativeError{std::move(build_message)};
 }
 
 // ----------------------------------------------------------------------------
@@ -1352,8 +2395,12 @@ struct NativeKlassImpl : NativeKlass
 struct NativePackage : Object, Scope
 {
     std::string package_name;
-    std::unordered_map<std::string, std::shared_ptr<Object>> members;
-    std::unordered_map<std::string, ObjectGenerator> properties;
+    std::unordered_map<Symbol, std::shared_ptr<Object>> members;
+    std::unordered_map<Symbol, ObjectGenerator> properties;
+
+    // set by register_native_package, run on the first member lookup so
+    // packages nothing imports never build their bindings
+    std::function<void (Scope&)> deferred_init;
 
     NativePackage(Interpreter* inter, const std::string& name)
         : Scope(inter)
@@ -1385,9 +2432,23 @@ struct NativePackage : Object, Scope
         return true;
     }
 
+    void
+    materialize_if_deferred()
+    {
+        if(deferred_init == nullptr)
+        {
+            return;
+        }
+        // moved out first so a lookup from inside the init can't recurse
+        auto init = std::move(deferred_init);
+        deferred_init = nullptr;
+        init(*this);
+    }
+
     std::shared_ptr<Object>
-    get_property_or_null(const std::string& name) override
+    get_property_or_null(Symbol name) override
     {
+        materialize_if_deferred();
         if(auto found_member = members.find(name); found_member != members.end())
         {
             return found_member->second;
@@ -1403,7 +2464,7 @@ struct NativePackage : Object, Scope
     }
 
     bool
-    set_property_or_false(const std::string&, std::shared_ptr<Object>) override
+    set_property_or_false(Symbol, std::shared_ptr<Object>) override
     {
         return false;
     }
@@ -1411,17 +2472,19 @@ struct NativePackage : Object, Scope
     void
     set_property(const std::string& name, std::shared_ptr<Object> value) override
     {
-        assert(members.find(name) == members.end() && "error: member already added (member)");
-        assert(properties.find(name) == properties.end() && "error: member already added (property)");
-        members.insert({name, value});
+        const auto symbol = intern_symbol(name);
+        assert(members.find(symbol) == members.end() && "error: member already added (member)");
+        assert(properties.find(symbol) == properties.end() && "error: member already added (property)");
+        members.insert({symbol, value});
     }
 
     void
     add_property(const std::string& name, ObjectGenerator&& value) override
     {
-        assert(members.find(name) == members.end() && "error: member already added (member)");
-        assert(properties.find(name) == properties.end() && "error: member already added (property)");
-        properties.insert({name, std::move(value)});
+        const auto symbol = intern_symbol(name);
+        assert(members.find(symbol) == members.end() && "error: member already added (member)");
+        assert(properties.find(symbol) == properties.end() && "error: member already added (property)");
+        properties.insert({symbol, std::move(value)});
     }
 };
 
@@ -1449,7 +2512,7 @@ Scope::register_native_klass_impl
     std::function<std::shared_ptr<Instance> (std::shared_ptr<NativeKlass>, ArgumentHelper& ah)>&& c
 )
 {
-    auto new_klass = std::make_shared<NativeKlassImpl>(name, id, std::move(c));
+    auto new_klass = make_tracked<NativeKlassImpl>(name, id, std::move(c));
     set_property(name, new_klass);
     interpreter->register_native_klass(id, new_klass);
     return new_klass;
@@ -1509,13 +2572,21 @@ get_package_scope_from_known_path(Interpreter* interpreter, const std::string& p
     for(const auto& name: path)
     {
         const bool use_global = package == nullptr;
-        std::shared_ptr<Object> object = use_global
-            ? global_environment.get_at_or_null(0, name)
-            : package->get_property_or_null(name)
-            ;
+        std::shared_ptr<Object> object;
+        if(use_global)
+        {
+            if(auto found = global_environment.get_or_null(name); found.has_value())
+            {
+                object = found->as_object();
+            }
+        }
+        else
+        {
+            object = package->get_property_or_null(intern_symbol(name));
+        }
         if(object == nullptr)
         {
-            auto new_package = std::make_shared<NativePackage>(interpreter, name);
+            auto new_package = make_tracked<NativePackage>(interpreter, name);
 
             if(use_global)
             {
@@ -1523,7 +2594,7 @@ get_package_scope_from_known_path(Interpreter* interpreter, const std::string& p
             }
             else
             {
-                package->members.insert({name, new_package});
+                package->members.insert({intern_symbol(name), new_package});
             }
 
             package = new_package;
@@ -1542,6 +2613,18 @@ get_package_scope_from_known_path(Interpreter* interpreter, const std::string& p
     return package;
 }
 
+
+void
+register_native_package(Interpreter* interpreter, const std::string& package_path, std::function<void (Scope&)>&& init)
+{
+    // the walk only creates empty shells, the expensive bindings wait
+    // inside init until a script looks into the package
+    auto scope = get_package_scope_from_known_path(interpreter, package_path);
+    auto package = std::static_pointer_cast<NativePackage>(scope);
+    assert(package->deferred_init == nullptr && "package was already registered lazily");
+    package->deferred_init = std::move(init);
+}
+
 // ----------------------------------------------------------------------------
 
 
@@ -2,8 +2,11 @@
 
 #include <memory>
 #include <functional>
+#include <limits>
+#include <array>
 
 #include "lox/ints.h"
+#include "lox/symbol.h"
 
 
 namespace lox
@@ -14,7 +17,7 @@ using Tf = double;
 
 enum class ObjectType
 {
-    nil, string, boolean, array, number_int, number_float, callable, klass, instance, native_instance, native_package, type
+    nil, string, boolean, array, int_array, float_array, number_int, number_float, callable, klass, instance, native_instance, native_package, type
 };
 
 
@@ -23,6 +26,7 @@ struct ArgumentHelper;
 struct Interpreter;
 struct Instance;
 struct Callable;
+struct Value;
 
 
 constexpr std::string_view objecttype_to_string(ObjectType ot)
@@ -33,6 +37,8 @@ constexpr std::string_view objecttype_to_string(ObjectType ot)
     case ObjectType::string:          return "string";
     case ObjectType::boolean:         return "boolean";
     case ObjectType::array:         return "array";
+    case ObjectType::int_array:       return "int array";
+    case ObjectType::float_array:     return "float array";
     case ObjectType::number_int:      return "int";
     case ObjectType::number_float:    return "float";
     case ObjectType::klass:           return "class";
@@ -46,13 +52,33 @@ constexpr std::string_view objecttype_to_string(ObjectType ot)
 
 // ----------------------------------------------------------------------------
 
-// thrown when there is a native error that needs to be reported back to the script
+// thrown when there is a native error that needs to be reported back to the
+// script; the message can be deferred so hot error paths only pay for
+// formatting when the error actually reaches a reporting sink
 struct NativeError
 {
+    explicit NativeError(std::string msg)
+        : message(std::move(msg))
+    {
+    }
+
+    explicit NativeError(std::function<std::string ()>&& build)
+        : deferred(std::move(build))
+    {
+    }
+
+    // materialize the report text
+    std::string build_message() const
+    {
+        return deferred ? deferred() : message;
+    }
+
     std::string message;
+    std::function<std::string ()> deferred;
 };
 
 void raise_error(const std::string& message);
+void raise_error(std::function<std::string ()>&& build_message);
 
 // ----------------------------------------------------------------------------
 
@@ -102,10 +128,23 @@ struct ToStringOptions
     }
 };
 
+// the cycle collector discovers the script object graph through this
+// interface, overrides of Object::visit_references report every strong
+// reference the object holds
+struct GcReferenceVisitor
+{
+    GcReferenceVisitor() = default;
+    virtual ~GcReferenceVisitor() = default;
+
+    virtual void on_object(const std::shared_ptr<Object>& referenced) = 0;
+    virtual void on_environment(const std::shared_ptr<Environment>& environment) = 0;
+    virtual void on_cell(const std::shared_ptr<Value>& cell) = 0;
+};
+
 struct Object : std::enable_shared_from_this<Object>
 {
     Object() = default;
-    virtual ~Object() = default;
+    virtual ~Object();
 
     std::string to_flat_string(Interpreter* inter, Callable* c, const ToStringOptions& tso);
 
@@ -113,17 +152,91 @@ struct Object : std::enable_shared_from_this<Object>
 
     // if callable is null, use best judgement...
     virtual std::vector<std::string> to_string(Interpreter* inter, Callable* c, const ToStringOptions&) = 0;
+
+    // append the representation into the caller's buffer, lines
+    // separated with \n; the default wraps to_string, hot types
+    // override it so printing doesn't allocate a vector of strings at
+    // every nesting level
+    virtual void write_string(std::string* out, Interpreter* inter, Callable* c, const ToStringOptions& tso);
     virtual bool is_callable() const = 0;
     
     virtual bool has_properties();
-    virtual std::shared_ptr<Object> get_property_or_null(const std::string& name);
-    virtual bool set_property_or_false(const std::string& name, std::shared_ptr<Object> value);
+    virtual std::shared_ptr<Object> get_property_or_null(Symbol name);
+    virtual bool set_property_or_false(Symbol name, std::shared_ptr<Object> value);
     
     virtual bool has_index() const;
     virtual std::shared_ptr<Object> get_index_or_null(std::shared_ptr<Object> index);
     virtual bool set_index_or_false(std::shared_ptr<Object> index, std::shared_ptr<Object> value);
+
+    // report every strong reference this object holds to other script
+    // objects, the default is for objects that hold none
+    virtual void visit_references(GcReferenceVisitor* visitor);
+
+    // called when the cycle collector has proven this object unreachable,
+    // drop the references so plain reference counting can reclaim the cycle
+    virtual void clear_references();
+
+    // written once by count_object_created and read back in the
+    // destructor so the live heap counters go down without a virtual
+    // call; zero bytes means the object isn't tracked
+    ObjectType counted_type = ObjectType::nil;
+    u32 counted_bytes = 0;
 };
 
+
+// ----------------------------------------------------------------------------
+
+// a point in time snapshot of the script heap, taken with get_heap_stats;
+// the counters are process wide relaxed atomics so a snapshot under
+// concurrent execution is approximate but never tears a single counter
+struct HeapStats
+{
+    struct PerType
+    {
+        u64 live_count = 0;
+        u64 live_bytes = 0;
+        u64 total_count = 0;
+        u64 total_bytes = 0;
+    };
+
+    static constexpr std::size_t type_count = static_cast<std::size_t>(ObjectType::type) + 1;
+    std::array<PerType, type_count> types;
+
+    const PerType& of(ObjectType ot) const
+    {
+        return types[static_cast<std::size_t>(ot)];
+    }
+
+    u64 live_objects = 0;
+    u64 live_bytes = 0;
+    u64 total_objects = 0;
+    u64 total_bytes = 0;
+    u64 peak_live_objects = 0;
+    u64 peak_live_bytes = 0;
+
+    u64 live_environments = 0;
+    u64 total_environments = 0;
+    u64 peak_live_environments = 0;
+};
+
+HeapStats get_heap_stats();
+
+// record keeping hooks behind the stats: the tracked factories call the
+// object one right after construction, Environment calls the other two
+void count_object_created(Object* object, std::size_t bytes);
+void count_environment_created();
+void count_environment_destroyed();
+
+// make_shared plus bookkeeping, use for every object a script can make
+// the interpreter allocate
+template<typename T, typename... TArgs>
+std::shared_ptr<T> make_tracked(TArgs&&... args)
+{
+    auto object = std::make_shared<T>(std::forward<TArgs>(args)...);
+    count_object_created(object.get(), sizeof(T));
+    return object;
+}
+
 using ObjectGenerator = std::function<std::shared_ptr<Object>()>;
 
 struct Type : public Object
@@ -148,7 +261,11 @@ struct ArgInfo
 
 struct Callable : public Object
 {
-    virtual std::shared_ptr<Object> call(Interpreter* iner, const Arguments& arguments) = 0;
+    // bumps the profiler's counters when the interpreter has profiling
+    // enabled, then dispatches to do_call
+    std::shared_ptr<Object> call(Interpreter* inter, const Arguments& arguments);
+
+    virtual std::shared_ptr<Object> do_call(Interpreter* iner, const Arguments& arguments) = 0;
     ObjectType get_type() const override;
     bool is_callable() const override;
 
@@ -167,20 +284,35 @@ struct BoundCallable : Callable
     BoundCallable(std::shared_ptr<Object> bound, std::shared_ptr<NativeFunctionObject> callable);
     ~BoundCallable();
     std::vector<std::string> to_string(Interpreter* inter, Callable* c, const ToStringOptions&) override;
-    std::shared_ptr<Object> call(Interpreter* inter, const Arguments& arguments) override;
+    std::shared_ptr<Object> do_call(Interpreter* inter, const Arguments& arguments) override;
     std::shared_ptr<Callable> bind(std::shared_ptr<Object> instance) override;
     bool is_bound() const override;
     ArgInfo get_arg_info(Interpreter* inter, Callable*) override;
+    void visit_references(GcReferenceVisitor* visitor) override;
 };
 
 // ----------------------------------------------------------------------------
 
+// a method reachable through the inheritance chain: the callable plus
+// how many instance parent links down the defining class lives, so the
+// method still binds to the sub-instance of the class that defined it
+struct FlatMethod
+{
+    std::shared_ptr<Callable> method;
+    std::size_t parent_depth = 0;
+};
+
+
 struct Klass : Type
 {
     std::string klass_name;
     std::shared_ptr<Klass> superklass;
-    std::unordered_map<std::string, std::shared_ptr<Callable>> methods;
-    std::unordered_map<std::string, std::shared_ptr<Callable>> static_methods;
+    std::unordered_map<Symbol, std::shared_ptr<Callable>> methods;
+    std::unordered_map<Symbol, std::shared_ptr<Callable>> static_methods;
+
+    // every method reachable from this klass, overrides applied
+    std::unordered_map<Symbol, FlatMethod> flat_methods;
+    bool methods_flattened = false;
 
     Klass(const std::string& n, std::shared_ptr<Klass> sk);
     
@@ -192,18 +324,57 @@ struct Klass : Type
 
     virtual std::shared_ptr<Instance> constructor(Interpreter* inter, const Arguments& arguments) = 0;
 
+    // registration still happens by name, the name is interned on the way in
     bool add_method_or_false(const std::string& name, std::shared_ptr<Callable> method);
-    std::shared_ptr<Callable> find_method_or_null(const std::string& name);
+    std::shared_ptr<Callable> find_method_or_null(Symbol name);
+
+    // merge the superklass's flattened table into this one so inherited
+    // method lookup is a single probe regardless of hierarchy depth;
+    // called eagerly when a class statement executes and lazily on the
+    // first lookup for klasses defined outside a class statement
+    void flatten_method_table();
+    const FlatMethod* find_flat_method_or_null(Symbol name);
 
     bool add_static_method_or_false(const std::string& name, std::shared_ptr<Callable> method);
     bool has_properties() override;
-    std::shared_ptr<Object> get_property_or_null(const std::string& name) override;
-    bool set_property_or_false(const std::string& name, std::shared_ptr<Object> value) override;
+    std::shared_ptr<Object> get_property_or_null(Symbol name) override;
+    bool set_property_or_false(Symbol name, std::shared_ptr<Object> value) override;
+    void visit_references(GcReferenceVisitor* visitor) override;
 };
 
 // ----------------------------------------------------------------------------
 
 
+// per call-site inline cache for instance property access: remembers the
+// last seen klass and where the member was found, so a repeat hit on the
+// same klass is a pointer compare and a single probe instead of the
+// field/method/parent lookup chain
+struct PropertyCache
+{
+    // also keeps the klass alive so the pointer compare can't hit a
+    // recycled address
+    std::shared_ptr<Klass> seen_klass;
+
+    // how many parent links to follow to the instance holding the member
+    std::size_t parent_depth = 0;
+
+    // set when the member is a method, null when it is a field
+    std::shared_ptr<Callable> method;
+
+    // slot in the owning instance's field array when the member is a
+    // field and the instance stores its fields in a shape, no_field_slot
+    // otherwise; a valid slot turns a cached field access into an index
+    // load with no name hashing
+    std::size_t field_slot = no_field_slot;
+
+    // set by freeze_for_sharing, the interpreter then skips the cache
+    // entirely so concurrent executions never write into it
+    bool frozen = false;
+
+    static constexpr std::size_t no_field_slot = std::numeric_limits<std::size_t>::max();
+};
+
+
 struct Instance : Object
 {
     std::shared_ptr<Instance> parent;
@@ -214,15 +385,31 @@ struct Instance : Object
     bool has_properties() override;
 
     //property = method or member variable
-    std::shared_ptr<Object> get_property_or_null(const std::string& name) override;
-    bool set_property_or_false(const std::string& name, std::shared_ptr<Object> value) override;
+    std::shared_ptr<Object> get_property_or_null(Symbol name) override;
+    bool set_property_or_false(Symbol name, std::shared_ptr<Object> value) override;
+
+    // cache aware versions of the above, used by the interpreter when the
+    // access site has an inline cache
+    std::shared_ptr<Object> get_property_or_null(Symbol name, PropertyCache& cache);
+    bool set_property_or_false(Symbol name, std::shared_ptr<Object> value, PropertyCache& cache);
 
     // use this to call member functions on instance
     std::shared_ptr<Callable> get_bound_method_or_null(const std::string& name);
 
     // member variable only
-    virtual std::shared_ptr<Object> get_field_or_null(const std::string& name) = 0;
-    virtual bool set_field_or_false(const std::string& name, std::shared_ptr<Object> value) = 0;
+    virtual std::shared_ptr<Object> get_field_or_null(Symbol name) = 0;
+    virtual bool set_field_or_false(Symbol name, std::shared_ptr<Object> value) = 0;
+
+    // shape support: instances that keep their fields in a flat slot
+    // array report the slot for a name so the inline cache can skip the
+    // name lookup on repeat hits; the defaults opt out and map backed
+    // instances keep using the name based path
+    virtual std::size_t get_field_slot_or_npos(Symbol name);
+    virtual std::shared_ptr<Object> get_field_by_slot_or_null(std::size_t slot);
+    virtual bool set_field_by_slot_or_false(std::size_t slot, std::shared_ptr<Object> value);
+
+    void visit_references(GcReferenceVisitor* visitor) override;
+    void clear_references() override;
 };
 
 // ----------------------------------------------------------------------------
@@ -240,7 +427,7 @@ struct Property
 struct NativeKlass : Klass
 {
     std::size_t native_id;
-    std::unordered_map<std::string, std::unique_ptr<Property>> properties;
+    std::unordered_map<Symbol, std::unique_ptr<Property>> properties;
 
     NativeKlass(const std::string& n, std::size_t id, std::shared_ptr<Klass> sk);
 
@@ -256,8 +443,8 @@ struct NativeInstance : Instance
     ObjectType get_type() const override;
     std::vector<std::string> to_string(Interpreter* inter, Callable* c, const ToStringOptions&) override;
 
-    std::shared_ptr<Object> get_field_or_null(const std::string& name) override;
-    bool set_field_or_false(const std::string& name, std::shared_ptr<Object> value) override;
+    std::shared_ptr<Object> get_field_or_null(Symbol name) override;
+    bool set_field_or_false(Symbol name, std::shared_ptr<Object> value) override;
 };
 
 
@@ -273,21 +460,76 @@ struct Array : public Object
 
     ObjectType get_type() const override;
     std::vector<std::string> to_string(Interpreter* inter, Callable* c, const ToStringOptions&) override;
+    void write_string(std::string* out, Interpreter* inter, Callable* c, const ToStringOptions& tso) override;
     bool is_callable() const override;
 
     std::optional<std::string> to_flat_string_representation(Interpreter*, Callable* c, const ToStringOptions&) const;
 
     bool has_properties() override;
-    std::shared_ptr<Object> get_property_or_null(const std::string& name) override;
-    bool set_property_or_false(const std::string& name, std::shared_ptr<Object> value) override;
+    std::shared_ptr<Object> get_property_or_null(Symbol name) override;
+    bool set_property_or_false(Symbol name, std::shared_ptr<Object> value) override;
 
     static std::size_t as_array_index(std::shared_ptr<Object> o);
 
     bool has_index() const override;
     std::shared_ptr<Object> get_index_or_null(std::shared_ptr<Object> index_object) override;
     bool set_index_or_false(std::shared_ptr<Object> index_object, std::shared_ptr<Object> new_value) override;
+
+    void visit_references(GcReferenceVisitor* visitor) override;
+    void clear_references() override;
+};
+
+
+// bulk numeric storage: a million ints is one contiguous allocation instead
+// of a million boxed objects plus a pointer vector; same index and method
+// surface as Array, elements are boxed on the way out; holds no references
+// to other script objects so the cycle collector never needs to look inside
+struct IntArray : public Object
+{
+    ObjectIntegrationImpl* integration;
+    std::vector<Ti> values;
+
+    IntArray(ObjectIntegrationImpl* i, std::vector<Ti>&& v);
+    ~IntArray() = default;
+
+    ObjectType get_type() const override;
+    std::vector<std::string> to_string(Interpreter* inter, Callable* c, const ToStringOptions&) override;
+    void write_string(std::string* out, Interpreter* inter, Callable* c, const ToStringOptions& tso) override;
+    bool is_callable() const override;
+
+    bool has_properties() override;
+    std::shared_ptr<Object> get_property_or_null(Symbol name) override;
+
+    bool has_index() const override;
+    std::shared_ptr<Object> get_index_or_null(std::shared_ptr<Object> index_object) override;
+    bool set_index_or_false(std::shared_ptr<Object> index_object, std::shared_ptr<Object> new_value) override;
+};
+
+
+// the float counterpart of IntArray, stores raw Tf contiguously; accepts
+// ints on writes and stores them as floats so telemetry style code can mix
+struct FloatArray : public Object
+{
+    ObjectIntegrationImpl* integration;
+    std::vector<Tf> values;
+
+    FloatArray(ObjectIntegrationImpl* i, std::vector<Tf>&& v);
+    ~FloatArray() = default;
+
+    ObjectType get_type() const override;
+    std::vector<std::string> to_string(Interpreter* inter, Callable* c, const ToStringOptions&) override;
+    void write_string(std::string* out, Interpreter* inter, Callable* c, const ToStringOptions& tso) override;
+    bool is_callable() const override;
+
+    bool has_properties() override;
+    std::shared_ptr<Object> get_property_or_null(Symbol name) override;
+
+    bool has_index() const override;
+    std::shared_ptr<Object> get_index_or_null(std::shared_ptr<Object> index_object) override;
+    bool set_index_or_false(std::shared_ptr<Object> index_object, std::shared_ptr<Object> new_value) override;
 };
 
+
 // ----------------------------------------------------------------------------
 
 using NativeFunction = std::function<std::shared_ptr<Object>(Callable*, ArgumentHelper& arguments)>;
@@ -299,12 +541,19 @@ std::shared_ptr<Object>     make_number_int       (Ti f);
 std::shared_ptr<Object>     make_number_float     (Tf f);
 std::shared_ptr<Callable>   make_native_function  (const std::string& name, NativeFunction&& func);
 
+// the interpreter's append-to-self fast path: grows the string object
+// in place instead of allocating a replacement, only valid when the
+// object is a string that nothing else references
+void string_append_in_place(Object* string_object, std::string_view tail);
+
 struct ObjectIntegration
 {
     ObjectIntegration() = default;
     virtual ~ObjectIntegration() = default;
 
     virtual std::shared_ptr<Object> make_array(std::vector<std::shared_ptr<Object>>&& values) = 0;
+    virtual std::shared_ptr<Object> make_int_array(std::vector<Ti>&& values) = 0;
+    virtual std::shared_ptr<Object> make_float_array(std::vector<Tf>&& values) = 0;
 };
 
 std::unique_ptr<ObjectIntegration> make_object_integration();
@@ -319,6 +568,8 @@ std::optional<Ti>           as_int         (std::shared_ptr<Object> o);
 std::optional<Tf>           as_float       (std::shared_ptr<Object> o);
 std::shared_ptr<Callable>   as_callable    (std::shared_ptr<Object> o);
 std::shared_ptr<Array>      as_array       (std::shared_ptr<Object> o);
+std::shared_ptr<IntArray>   as_int_array   (std::shared_ptr<Object> o);
+std::shared_ptr<FloatArray> as_float_array (std::shared_ptr<Object> o);
 std::shared_ptr<Instance>   as_instance    (std::shared_ptr<Object> o);
 std::shared_ptr<Klass>      as_klass       (std::shared_ptr<Object> o);
 std::shared_ptr<NativeInstance> as_native_instance_of_type(std::shared_ptr<Object> o, std::size_t type);
@@ -367,7 +618,7 @@ namespace detail
     std::shared_ptr<NativeInstance>
     make_native_instance(std::shared_ptr<NativeKlass> k, T&& t)
     {
-        return std::make_shared<NativeInstanceT<T>>(std::move(t), k);
+        return make_tracked<NativeInstanceT<T>>(std::move(t), k);
     }
 
     template<typename T> T get_from_obj_or_error(std::shared_ptr<Object>);
@@ -626,19 +877,21 @@ struct ArgumentHelper
 
     // todo(Gustav): add some match/switch helper to handle overloads
 
-    std::shared_ptr<Instance>   require_instance (const std::string& name);
-    std::shared_ptr<Object>     require_object   (const std::string& name);
-    std::string                 require_string   (const std::string& name);
-    bool                        require_bool     (const std::string& name);
-    Ti                          require_int      (const std::string& name);
-    Tf                          require_float    (const std::string& name);
-    std::shared_ptr<Callable>   require_callable (const std::string& name);
-    std::shared_ptr<Array>      require_array    (const std::string& name);
+    // names are string_views so the hot path never materializes a
+    // std::string from the literal, only the introspection pass does
+    std::shared_ptr<Instance>   require_instance (std::string_view name);
+    std::shared_ptr<Object>     require_object   (std::string_view name);
+    std::string                 require_string   (std::string_view name);
+    bool                        require_bool     (std::string_view name);
+    Ti                          require_int      (std::string_view name);
+    Tf                          require_float    (std::string_view name);
+    std::shared_ptr<Callable>   require_callable (std::string_view name);
+    std::shared_ptr<Array>      require_array    (std::string_view name);
 
-    std::shared_ptr<NativeInstance> impl_require_native_instance(const std::string& name, std::size_t klass);
+    std::shared_ptr<NativeInstance> impl_require_native_instance(std::string_view name, std::size_t klass);
 
     template<typename T>
-    NativeRef<T> require_native(const std::string& name)
+    NativeRef<T> require_native(std::string_view name)
     {
         return NativeRef<T>{impl_require_native_instance(name, detail::get_unique_id<T>())};
     }
@@ -752,6 +1005,14 @@ get_global_scope(Interpreter* interpreter);
 std::shared_ptr<Scope>
 get_package_scope_from_known_path(Interpreter* interpreter, const std::string& package_path);
 
+// register a package without building its bindings: init runs the
+// first time a script looks inside the package, so startup cost and
+// resident memory scale with what scripts actually import. Note that
+// native classes inside the package only register with the interpreter
+// (for make_native) once the package has been touched
+void
+register_native_package(Interpreter* interpreter, const std::string& package_path, std::function<void (Scope&)>&& init);
+
 // ----------------------------------------------------------------------------
 
 
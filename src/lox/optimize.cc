@@ -0,0 +1,533 @@
+#include "lox/optimize.h"
+
+#include <cassert>
+
+#include "lox/program.h"
+#include "lox/object.h"
+#include "lox/tokentype.h"
+
+
+namespace lox { namespace
+{
+
+
+// the generated visitors expose the tree as const nodes, a rewrite pass
+// needs to replace child pointers in place, so this dispatches on the node
+// type instead; replacement nodes go in the same arena and reuse the uid
+// and offset of what they replace, keeping error reporting intact
+struct Optimizer
+{
+    AstArena& arena;
+
+    explicit Optimizer(AstArena& a)
+        : arena(a)
+    {
+    }
+
+    //---------------------------------------------------------------------
+    // expressions
+
+    static LiteralExpression*
+    as_literal(Expression* x)
+    {
+        if(x != nullptr && x->get_type() == ExpressionType::literal_expression)
+        {
+            return static_cast<LiteralExpression*>(x);
+        }
+        return nullptr;
+    }
+
+    static Tf
+    get_number_as_float(const std::shared_ptr<Object>& o)
+    {
+        if(auto i = as_int(o); i.has_value())
+        {
+            return static_cast<Tf>(*i);
+        }
+        auto f = as_float(o);
+        assert(f.has_value());
+        return *f;
+    }
+
+    static bool
+    is_number(const std::shared_ptr<Object>& o)
+    {
+        const auto t = o->get_type();
+        return t == ObjectType::number_int || t == ObjectType::number_float;
+    }
+
+    static bool
+    is_float(const std::shared_ptr<Object>& o)
+    {
+        return o->get_type() == ObjectType::number_float;
+    }
+
+    // equality the interpreter can decide: nil, ints, bools and strings;
+    // everything else keeps its runtime behaviour
+    static std::optional<bool>
+    constant_equals(const std::shared_ptr<Object>& left, const std::shared_ptr<Object>& right)
+    {
+        const auto supported = [](ObjectType t)
+        {
+            return t == ObjectType::nil || t == ObjectType::number_int
+                || t == ObjectType::boolean || t == ObjectType::string;
+        };
+
+        const auto left_type = left->get_type();
+        const auto right_type = right->get_type();
+        if(supported(left_type) == false || supported(right_type) == false)
+        {
+            return std::nullopt;
+        }
+        if(left_type != right_type)
+        {
+            return false;
+        }
+
+        switch(left_type)
+        {
+        case ObjectType::nil: return true;
+        case ObjectType::number_int: return *as_int(left) == *as_int(right);
+        case ObjectType::boolean: return *as_bool(left) == *as_bool(right);
+        case ObjectType::string: return *as_string(left) == *as_string(right);
+        default:
+            assert(false && "unhandled type in constant_equals(...)");
+            return std::nullopt;
+        }
+    }
+
+    // null when the operands aren't constants the runtime would accept,
+    // those keep their runtime type error
+    static std::shared_ptr<Object>
+    fold_binary_value
+    (
+        TokenType op,
+        const std::shared_ptr<Object>& left,
+        const std::shared_ptr<Object>& right
+    )
+    {
+        const auto both_numbers = is_number(left) && is_number(right);
+        const auto either_float = is_float(left) || is_float(right);
+
+        switch(op)
+        {
+        case TokenType::MINUS:
+            if(both_numbers == false) { return nullptr; }
+            if(either_float)
+            {
+                return make_number_float(get_number_as_float(left) - get_number_as_float(right));
+            }
+            return make_number_int(*as_int(left) - *as_int(right));
+        case TokenType::SLASH:
+            // division is always float at runtime, so 1/0 folds to the
+            // same infinity it would evaluate to
+            if(both_numbers == false) { return nullptr; }
+            return make_number_float(get_number_as_float(left) / get_number_as_float(right));
+        case TokenType::STAR:
+            if(both_numbers == false) { return nullptr; }
+            return make_number_float(get_number_as_float(left) * get_number_as_float(right));
+        case TokenType::PLUS:
+            if(both_numbers)
+            {
+                if(either_float)
+                {
+                    return make_number_float(get_number_as_float(left) + get_number_as_float(right));
+                }
+                return make_number_int(*as_int(left) + *as_int(right));
+            }
+            if(auto l = as_string(left), r = as_string(right); l.has_value() && r.has_value())
+            {
+                return make_string(*l + *r);
+            }
+            return nullptr;
+        case TokenType::LESS:
+            if(both_numbers == false) { return nullptr; }
+            return make_bool(get_number_as_float(left) < get_number_as_float(right));
+        case TokenType::LESS_EQUAL:
+            if(both_numbers == false) { return nullptr; }
+            return make_bool(get_number_as_float(left) <= get_number_as_float(right));
+        case TokenType::GREATER:
+            if(both_numbers == false) { return nullptr; }
+            return make_bool(get_number_as_float(left) > get_number_as_float(right));
+        case TokenType::GREATER_EQUAL:
+            if(both_numbers == false) { return nullptr; }
+            return make_bool(get_number_as_float(left) >= get_number_as_float(right));
+        case TokenType::BANG_EQUAL:
+            if(auto eq = constant_equals(left, right); eq.has_value())
+            {
+                return make_bool(*eq == false);
+            }
+            return nullptr;
+        case TokenType::EQUAL_EQUAL:
+            if(auto eq = constant_equals(left, right); eq.has_value())
+            {
+                return make_bool(*eq);
+            }
+            return nullptr;
+        default:
+            return nullptr;
+        }
+    }
+
+    Expression*
+    fold_binary(BinaryExpression* x)
+    {
+        auto* left = as_literal(x->left);
+        auto* right = as_literal(x->right);
+        if(left == nullptr || right == nullptr)
+        {
+            return x;
+        }
+
+        auto folded = fold_binary_value(x->op, left->value, right->value);
+        if(folded == nullptr)
+        {
+            return x;
+        }
+        return make_literal_expression(arena, x->offset, x->uid, std::move(folded));
+    }
+
+    Expression*
+    fold_unary(UnaryExpression* x)
+    {
+        auto* right = as_literal(x->right);
+        if(right == nullptr)
+        {
+            return x;
+        }
+
+        switch(x->op)
+        {
+        case TokenType::BANG:
+            return make_literal_expression(arena, x->offset, x->uid, make_bool(is_truthy(right->value) == false));
+        case TokenType::MINUS:
+            if(auto i = as_int(right->value); i.has_value())
+            {
+                return make_literal_expression(arena, x->offset, x->uid, make_number_int(-*i));
+            }
+            if(auto f = as_float(right->value); f.has_value())
+            {
+                return make_literal_expression(arena, x->offset, x->uid, make_number_float(-*f));
+            }
+            return x;
+        default:
+            return x;
+        }
+    }
+
+    Expression*
+    fold_logical(LogicalExpression* x)
+    {
+        // only a constant left side decides: evaluating a literal has no
+        // side effect, so short circuiting straight to one operand is safe
+        auto* left = as_literal(x->left);
+        if(left == nullptr)
+        {
+            return x;
+        }
+
+        const auto truthy = is_truthy(left->value);
+        switch(x->op)
+        {
+        case TokenType::OR: return truthy ? x->left : x->right;
+        case TokenType::AND: return truthy ? x->right : x->left;
+        default: return x;
+        }
+    }
+
+    Expression*
+    optimize_expression(Expression* x)
+    {
+        switch(x->get_type())
+        {
+        case ExpressionType::assign_expression:
+        {
+            auto* a = static_cast<AssignExpression*>(x);
+            a->value = optimize_expression(a->value);
+            return x;
+        }
+        case ExpressionType::binary_expression:
+        {
+            auto* b = static_cast<BinaryExpression*>(x);
+            b->left = optimize_expression(b->left);
+            b->right = optimize_expression(b->right);
+            return fold_binary(b);
+        }
+        case ExpressionType::call_expression:
+        {
+            auto* c = static_cast<CallExpression*>(x);
+            c->callee = optimize_expression(c->callee);
+            for(auto& argument: c->arguments)
+            {
+                argument = optimize_expression(argument);
+            }
+            return x;
+        }
+        case ExpressionType::array_expression:
+        {
+            auto* a = static_cast<ArrayExpression*>(x);
+            for(auto& value: a->values)
+            {
+                value = optimize_expression(value);
+            }
+            return x;
+        }
+        case ExpressionType::constructor_expression:
+        {
+            auto* c = static_cast<ConstructorExpression*>(x);
+            c->klass = optimize_expression(c->klass);
+            for(auto& argument: c->arguments)
+            {
+                argument = optimize_expression(argument);
+            }
+            return x;
+        }
+        case ExpressionType::superconstructorcall_expression:
+        {
+            auto* s = static_cast<SuperConstructorCallExpression*>(x);
+            for(auto& argument: s->arguments)
+            {
+                argument = optimize_expression(argument);
+            }
+            return x;
+        }
+        case ExpressionType::getproperty_expression:
+        {
+            auto* g = static_cast<GetPropertyExpression*>(x);
+            g->object = optimize_expression(g->object);
+            return x;
+        }
+        case ExpressionType::setproperty_expression:
+        {
+            auto* s = static_cast<SetPropertyExpression*>(x);
+            s->object = optimize_expression(s->object);
+            s->value = optimize_expression(s->value);
+            return x;
+        }
+        case ExpressionType::getindex_expression:
+        {
+            auto* g = static_cast<GetIndexExpression*>(x);
+            g->object = optimize_expression(g->object);
+            g->index = optimize_expression(g->index);
+            return x;
+        }
+        case ExpressionType::setindex_expression:
+        {
+            auto* s = static_cast<SetIndexExpression*>(x);
+            s->object = optimize_expression(s->object);
+            s->index = optimize_expression(s->index);
+            s->value = optimize_expression(s->value);
+            return x;
+        }
+        case ExpressionType::grouping_expression:
+        {
+            auto* g = static_cast<GroupingExpression*>(x);
+            g->expression = optimize_expression(g->expression);
+            // a grouped literal is just the literal, and dropping the
+            // group lets an enclosing operation fold through it
+            if(as_literal(g->expression) != nullptr)
+            {
+                return g->expression;
+            }
+            return x;
+        }
+        case ExpressionType::logical_expression:
+        {
+            auto* l = static_cast<LogicalExpression*>(x);
+            l->left = optimize_expression(l->left);
+            l->right = optimize_expression(l->right);
+            return fold_logical(l);
+        }
+        case ExpressionType::unary_expression:
+        {
+            auto* u = static_cast<UnaryExpression*>(x);
+            u->right = optimize_expression(u->right);
+            return fold_unary(u);
+        }
+        case ExpressionType::super_expression:
+        case ExpressionType::this_expression:
+        case ExpressionType::literal_expression:
+        case ExpressionType::variable_expression:
+            return x;
+        default:
+            assert(false && "unhandled expression in optimize_expression(...)");
+            return x;
+        }
+    }
+
+    //---------------------------------------------------------------------
+    // statements
+
+    // like optimize_statement but never drops: statement slots that must
+    // stay filled (branch bodies) get an empty block instead
+    Statement*
+    optimize_statement_slot(Statement* s)
+    {
+        auto* optimized = optimize_statement(s);
+        if(optimized == nullptr)
+        {
+            return make_block_statement(arena, s->offset, s->uid, {});
+        }
+        return optimized;
+    }
+
+    // returns the replacement statement, or null when the statement turned
+    // out to be dead and can be dropped entirely
+    Statement*
+    optimize_statement(Statement* s)
+    {
+        switch(s->get_type())
+        {
+        case StatementType::block_statement:
+        {
+            auto* b = static_cast<BlockStatement*>(s);
+            optimize_statements(b->statements);
+            return s;
+        }
+        case StatementType::class_statement:
+        {
+            auto* c = static_cast<ClassStatement*>(s);
+            if(c->parent != nullptr)
+            {
+                c->parent = optimize_expression(c->parent);
+            }
+            for(auto* member: c->members)
+            {
+                if(member->initializer != nullptr)
+                {
+                    member->initializer = optimize_expression(member->initializer);
+                }
+            }
+            for(auto* method: c->methods)
+            {
+                optimize_statements(method->body);
+            }
+            for(auto* method: c->static_methods)
+            {
+                optimize_statements(method->body);
+            }
+            return s;
+        }
+        case StatementType::function_statement:
+        {
+            auto* f = static_cast<FunctionStatement*>(s);
+            optimize_statements(f->body);
+            return s;
+        }
+        case StatementType::expression_statement:
+        {
+            auto* e = static_cast<ExpressionStatement*>(s);
+            e->expression = optimize_expression(e->expression);
+            // an expression statement that folded down to a literal has
+            // no effect left
+            if(as_literal(e->expression) != nullptr)
+            {
+                return nullptr;
+            }
+            return s;
+        }
+        case StatementType::if_statement:
+        {
+            auto* i = static_cast<IfStatement*>(s);
+            i->condition = optimize_expression(i->condition);
+
+            // a constant condition keeps only the live branch, the dead
+            // one is neither optimized nor resolved
+            if(auto* condition = as_literal(i->condition); condition != nullptr)
+            {
+                if(is_truthy(condition->value))
+                {
+                    return optimize_statement(i->then_branch);
+                }
+                if(i->else_branch != nullptr)
+                {
+                    return optimize_statement(i->else_branch);
+                }
+                return nullptr;
+            }
+
+            i->then_branch = optimize_statement_slot(i->then_branch);
+            if(i->else_branch != nullptr)
+            {
+                i->else_branch = optimize_statement(i->else_branch);
+            }
+            return s;
+        }
+        case StatementType::print_statement:
+        {
+            auto* p = static_cast<PrintStatement*>(s);
+            p->expression = optimize_expression(p->expression);
+            return s;
+        }
+        case StatementType::return_statement:
+        {
+            auto* r = static_cast<ReturnStatement*>(s);
+            if(r->value != nullptr)
+            {
+                r->value = optimize_expression(r->value);
+            }
+            return s;
+        }
+        case StatementType::var_statement:
+        {
+            auto* v = static_cast<VarStatement*>(s);
+            if(v->initializer != nullptr)
+            {
+                v->initializer = optimize_expression(v->initializer);
+            }
+            return s;
+        }
+        case StatementType::while_statement:
+        {
+            auto* w = static_cast<WhileStatement*>(s);
+            w->condition = optimize_expression(w->condition);
+
+            if(auto* condition = as_literal(w->condition); condition != nullptr)
+            {
+                if(is_truthy(condition->value) == false)
+                {
+                    return nullptr;
+                }
+            }
+
+            w->body = optimize_statement_slot(w->body);
+            return s;
+        }
+        default:
+            assert(false && "unhandled statement in optimize_statement(...)");
+            return s;
+        }
+    }
+
+    void
+    optimize_statements(std::vector<Statement*>& statements)
+    {
+        std::size_t kept = 0;
+        for(auto* statement: statements)
+        {
+            auto* optimized = optimize_statement(statement);
+            if(optimized != nullptr)
+            {
+                statements[kept] = optimized;
+                kept += 1;
+            }
+        }
+        statements.resize(kept);
+    }
+};
+
+
+}}
+
+
+namespace lox
+{
+
+void
+optimize(Program& program)
+{
+    auto optimizer = Optimizer{program.arena};
+    optimizer.optimize_statements(program.statements);
+}
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+
+namespace lox
+{
+
+struct Program;
+
+// constant folding and dead code elimination, run between parse and
+// resolve: arithmetic, comparisons and string concatenation over literals
+// collapse into their result, if statements with a constant condition keep
+// only the live branch and while(false) loops disappear, so the pruned
+// code is never resolved or executed
+void optimize(Program& program);
+
+}
@@ -0,0 +1,131 @@
+#include "catch.hpp"
+#include "catchy/stringeq.h"
+
+#include "lox/printhandler.h"
+#include "lox/scanner.h"
+#include "lox/ast.h"
+#include "lox/parser.h"
+#include "lox/optimize.h"
+
+#include "test.h"
+
+
+using namespace catchy;
+
+
+namespace
+{
+    ParseOutput
+    optimize_to_string(const std::string source)
+    {
+        auto output = ParseOutput{"<syntax errors>", {}};
+
+        auto printer = AddStringErrors{&output.err};
+        auto tokens = lox::scan_tokens(source, &printer);
+        auto program = lox::parse_program(tokens.tokens, &printer);
+
+        if(tokens.errors == 0 && program.errors == 0)
+        {
+            lox::optimize(*program.program);
+            output.out = lox::print_ast(*program.program);
+        }
+
+        return output;
+    }
+}
+
+
+TEST_CASE("optimize", "[optimize]")
+{
+    SECTION("fold int arithmetic")
+    {
+        const auto out = optimize_to_string
+        (R"lox(
+            print 1 + 2 - 3;
+        )lox");
+        REQUIRE(StringEq(out.err, {}));
+        CHECK(StringEq(out.out, "(program (print 0))"));
+    }
+
+    SECTION("fold through grouping")
+    {
+        const auto out = optimize_to_string
+        (R"lox(
+            var seconds_per_day = (60 * 60) * 24;
+        )lox");
+        REQUIRE(StringEq(out.err, {}));
+        CHECK(StringEq(out.out, "(program (decl seconds_per_day 86400))"));
+    }
+
+    SECTION("fold string concatenation")
+    {
+        const auto out = optimize_to_string
+        (R"lox(
+            print "hello" + " " + "world";
+        )lox");
+        REQUIRE(StringEq(out.err, {}));
+        CHECK(StringEq(out.out, "(program (print \"hello world\"))"));
+    }
+
+    SECTION("fold comparisons and logic")
+    {
+        const auto out = optimize_to_string
+        (R"lox(
+            var a = 1 < 2;
+            var b = !true;
+            var c = false or x;
+            var d = false and x;
+        )lox");
+        REQUIRE(StringEq(out.err, {}));
+        CHECK(StringEq(out.out, "(program (decl a true) (decl b false) (decl c (get x)) (decl d false))"));
+    }
+
+    SECTION("non constant operands are left alone")
+    {
+        const auto out = optimize_to_string
+        (R"lox(
+            print x + 1;
+            print 1 + "one";
+        )lox");
+        REQUIRE(StringEq(out.err, {}));
+        CHECK(StringEq(out.out, "(program (print (+ (get x) 1)) (print (+ 1 \"one\")))"));
+    }
+
+    SECTION("prune constant if branches")
+    {
+        const auto out = optimize_to_string
+        (R"lox(
+            if(1 < 2) { print "yes"; } else { print "no"; }
+            if(false) { print "never"; }
+        )lox");
+        REQUIRE(StringEq(out.err, {}));
+        CHECK(StringEq(out.out, "(program ({} (print \"yes\")))"));
+    }
+
+    SECTION("drop while false")
+    {
+        const auto out = optimize_to_string
+        (R"lox(
+            while(false) { print "never"; }
+            print "after";
+        )lox");
+        REQUIRE(StringEq(out.err, {}));
+        CHECK(StringEq(out.out, "(program (print \"after\"))"));
+    }
+
+    SECTION("fold inside functions and loops")
+    {
+        const auto out = optimize_to_string
+        (R"lox(
+            fun f()
+            {
+                while(x)
+                {
+                    print 2 + 3;
+                }
+            }
+        )lox");
+        REQUIRE(StringEq(out.err, {}));
+        CHECK(StringEq(out.out, "(program (fun f (params) ({} (while (get x) ({} (print 5))))))"));
+    }
+}
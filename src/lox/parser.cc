@@ -1,6 +1,7 @@
 #include "lox/parser.h"
 
 #include "lox/errorhandler.h"
+#include "lox/scanner.h"
 #include "lox/config.h"
 
 
@@ -64,9 +65,20 @@ token_to_string(const Token& tok)
 
 struct Parser
 {
-    std::vector<Token>& tokens;
+    // pulls the next raw token, either from a live scanner or from an
+    // already materialized vector; must return EOF forever once the
+    // source is exhausted
+    std::function<Token()> pull_token;
     ErrorHandler* error_handler;
-    std::size_t current = 0;
+    AstArena& arena;
+
+    Token current_token;
+
+    // only valid once the first token has been consumed, see
+    // at_first_token
+    Token previous_token;
+    bool at_first_token = true;
+
     int error_count = 0;
 
     u64 next_statement_uid = 0;
@@ -76,9 +88,12 @@ struct Parser
     // --------------------------------------------------------------------------------------------
     // constructor
 
-    explicit Parser(std::vector<Token>& t, ErrorHandler* eh)
-        : tokens(t)
+    explicit Parser(std::function<Token()> pull, ErrorHandler* eh, AstArena& a)
+        : pull_token(std::move(pull))
         , error_handler(eh)
+        , arena(a)
+        , current_token(pull_token())
+        , previous_token(current_token)
     {
     }
 
@@ -92,24 +107,20 @@ struct Parser
     // --------------------------------------------------------------------------------------------
     // parser
 
-    std::shared_ptr<Program>
-    parse_program()
+    void
+    parse_program(Program& program)
     {
-        auto program = std::make_shared<Program>();
-
         while(!is_at_end())
         {
             auto dec = parse_declaration_or_null();
             if(dec != nullptr)
             {
-                program->statements.emplace_back(std::move(dec));
+                program.statements.emplace_back(dec);
             }
         }
-
-        return program;
     }
 
-    std::shared_ptr<Statement>
+    Statement*
     parse_declaration_or_null()
     {
         try
@@ -136,31 +147,31 @@ struct Parser
         }
     }
 
-    std::shared_ptr<Statement>
+    Statement*
     parse_class_declaration()
     {
         const auto className = consume(TokenType::IDENTIFIER, "Expected class name").lexeme;
         const auto start = previous_offset();
 
-        std::shared_ptr<Expression> superclass;
+        Expression* superclass = nullptr;
         if(match({TokenType::COLON}))
         {
-            auto& id = consume(TokenType::IDENTIFIER, "Expected namespace or superclass name");
-            superclass = std::make_shared<VariableExpression>(id.offset, new_expr(), std::string(id.lexeme));
+            const auto id = consume(TokenType::IDENTIFIER, "Expected namespace or superclass name");
+            superclass = make_variable_expression(arena, id.offset, new_expr(), std::string(id.lexeme));
 
             while(match({TokenType::DOT}))
             {
-                const auto& getName = consume(TokenType::IDENTIFIER, "Expected super class or namespace name after '.'");
-                superclass = std::make_shared<GetPropertyExpression>(getName.offset, new_expr(), std::move(superclass), std::string(getName.lexeme));
+                const auto getName = consume(TokenType::IDENTIFIER, "Expected super class or namespace name after '.'");
+                superclass = make_getproperty_expression(arena, getName.offset, new_expr(), superclass, std::string(getName.lexeme));
             }
         }
 
         consume(TokenType::LEFT_BRACE, "Expected { before class body");
 
 
-        std::vector<std::shared_ptr<FunctionStatement>> methods;
-        std::vector<std::shared_ptr<FunctionStatement>> static_methods;
-        std::vector<std::shared_ptr<VarStatement>> members;
+        std::vector<FunctionStatement*> methods;
+        std::vector<FunctionStatement*> static_methods;
+        std::vector<VarStatement*> members;
         while(check(TokenType::RIGHT_BRACE) == false && is_at_end() == false)
         {
             const auto is_static = match({TokenType::STATIC});
@@ -170,18 +181,18 @@ struct Parser
                 auto method = parse_function_or_method("method");
                 if(is_static)
                 {
-                    static_methods.emplace_back(std::move(method));
+                    static_methods.emplace_back(method);
                 }
                 else
                 {
-                    methods.emplace_back(std::move(method));
+                    methods.emplace_back(method);
                 }
             }
             else if(match({TokenType::VAR}))
             {
                 assert(is_static == false && "todo: support static variables");
                 auto mem = parse_var_declaration();
-                members.emplace_back(std::move(mem));
+                members.emplace_back(mem);
             }
             else
             {
@@ -193,19 +204,20 @@ struct Parser
         consume(TokenType::RIGHT_BRACE, "Expected } after class body");
 
         const auto end = previous_offset();
-        return std::make_shared<ClassStatement>
+        return make_class_statement
         (
+            arena,
             offset_start_end(start, end),
             new_stmt(),
             std::string(className),
-            std::move(superclass),
+            superclass,
             std::move(members),
             std::move(methods),
             std::move(static_methods)
         );
     }
 
-    std::shared_ptr<FunctionStatement>
+    FunctionStatement*
     parse_function_or_method(std::string_view kind)
     {
         const auto name = consume(TokenType::IDENTIFIER, fmt::format("Expected {} name", kind)).lexeme;
@@ -232,16 +244,16 @@ struct Parser
         consume(TokenType::LEFT_BRACE, fmt::format("Expect '{{' before {} body", kind));
         auto body = parse_block_to_statements();
         const auto end = previous_offset();
-        return std::make_shared<FunctionStatement>(offset_start_end(start, end), new_stmt(), std::string(name), std::move(params), std::move(body));
+        return make_function_statement(arena, offset_start_end(start, end), new_stmt(), std::string(name), std::move(params), std::move(body));
     }
 
-    std::shared_ptr<VarStatement>
+    VarStatement*
     parse_var_declaration()
     {
         const auto start = previous_offset();
-        auto& name = consume(TokenType::IDENTIFIER, "Expected variable name");
+        const auto name = consume(TokenType::IDENTIFIER, "Expected variable name");
 
-        std::shared_ptr<Expression> initializer = nullptr;
+        Expression* initializer = nullptr;
 
         if(match({TokenType::EQUAL}))
         {
@@ -250,10 +262,10 @@ struct Parser
 
         consume_semicolon("print statement");
         const auto end = previous_offset();
-        return std::make_shared<VarStatement>(offset_start_end(start, end), new_stmt(), std::string(name.lexeme), std::move(initializer));
+        return make_var_statement(arena, offset_start_end(start, end), new_stmt(), std::string(name.lexeme), initializer);
     }
 
-    std::shared_ptr<Statement>
+    Statement*
     parse_statement()
     {
         if(match({TokenType::IF})) { return parse_if_statement(); }
@@ -266,12 +278,12 @@ struct Parser
         return parse_expression_statement();
     }
 
-    std::shared_ptr<Statement>
+    Statement*
     parse_return_statement()
     {
         const auto start = previous_offset();
 
-        std::shared_ptr<Expression> value;
+        Expression* value = nullptr;
         if(check(TokenType::SEMICOLON) == false)
         {
             value = parse_expression();
@@ -279,16 +291,16 @@ struct Parser
 
         consume(TokenType::SEMICOLON, "Expected ';' after return value");
         const auto end = previous_offset();
-        return std::make_shared<ReturnStatement>(offset_start_end(start, end), new_stmt(), std::move(value));
+        return make_return_statement(arena, offset_start_end(start, end), new_stmt(), value);
     }
 
-    std::shared_ptr<Statement>
+    Statement*
     parse_for_statement()
     {
         const auto start = previous_offset();
         consume(TokenType::LEFT_PAREN, "Expected '(' after for");
         
-        std::shared_ptr<Statement> initializer;
+        Statement* initializer = nullptr;
 
         if(match({TokenType::SEMICOLON}))
         {
@@ -303,7 +315,7 @@ struct Parser
             initializer = parse_expression_statement();
         }
 
-        std::shared_ptr<Expression> condition;
+        Expression* condition = nullptr;
         if(check(TokenType::SEMICOLON) == false)
         {
             condition = parse_expression();
@@ -311,7 +323,7 @@ struct Parser
         consume(TokenType::SEMICOLON, "Expected ';' after loop confition");
 
 
-        std::shared_ptr<Expression> increment;
+        Expression* increment = nullptr;
         if(check(TokenType::RIGHT_PAREN) == false)
         {
             increment = parse_expression();
@@ -324,33 +336,33 @@ struct Parser
         if(increment != nullptr)
         {
             const auto io = increment->offset;
-            std::vector<std::shared_ptr<Statement>> statements;
-            statements.emplace_back(std::move(body));
-            statements.emplace_back(std::make_shared<ExpressionStatement>(io, new_stmt(), std::move(increment)));
-            body = std::make_shared<BlockStatement>(offset_start_end(io, end), new_stmt(), std::move(statements));
+            std::vector<Statement*> statements;
+            statements.emplace_back(body);
+            statements.emplace_back(make_expression_statement(arena, io, new_stmt(), increment));
+            body = make_block_statement(arena, offset_start_end(io, end), new_stmt(), std::move(statements));
         }
 
         {
             const auto co_start = condition == nullptr ? body->offset.start : condition->offset.start;
             if(condition == nullptr)
             {
-                condition = std::make_shared<LiteralExpression>(Offset{nullptr, 0}, new_expr(), make_bool(true));
+                condition = make_literal_expression(arena, Offset{nullptr, 0}, new_expr(), make_bool(true));
             }
-            body = std::make_shared<WhileStatement>(Offset{end.source, co_start, end.end}, new_stmt(), std::move(condition), std::move(body));
+            body = make_while_statement(arena, Offset{end.source, co_start, end.end}, new_stmt(), condition, body);
         }
 
         if(initializer != nullptr)
         {
-            std::vector<std::shared_ptr<Statement>> statements;
-            statements.emplace_back(std::move(initializer));
-            statements.emplace_back(std::move(body));
-            body = std::make_shared<BlockStatement>(offset_start_end(start, end), new_stmt(), std::move(statements));
+            std::vector<Statement*> statements;
+            statements.emplace_back(initializer);
+            statements.emplace_back(body);
+            body = make_block_statement(arena, offset_start_end(start, end), new_stmt(), std::move(statements));
         }
         
         return body;
     }
 
-    std::shared_ptr<Statement>
+    Statement*
     parse_while_statement()
     {
         const auto start = previous_offset();
@@ -362,10 +374,10 @@ struct Parser
         auto body = parse_statement();
         const auto end = previous_offset();
         
-        return std::make_shared<WhileStatement>(offset_start_end(start, end), new_stmt(), std::move(condition), std::move(body));
+        return make_while_statement(arena, offset_start_end(start, end), new_stmt(), condition, body);
     }
 
-    std::shared_ptr<Statement>
+    Statement*
     parse_if_statement()
     {
         const auto start = previous_offset();
@@ -374,7 +386,7 @@ struct Parser
         consume(TokenType::RIGHT_PAREN, "Expected ')' after if condition");
 
         auto then_branch = parse_statement();
-        std::shared_ptr<Statement> else_branch = nullptr;
+        Statement* else_branch = nullptr;
 
         if(match({TokenType::ELSE}))
         {
@@ -383,26 +395,26 @@ struct Parser
 
         const auto end = previous_offset();
         
-        return std::make_shared<IfStatement>(offset_start_end(start, end), new_stmt(), std::move(condition), std::move(then_branch), std::move(else_branch));
+        return make_if_statement(arena, offset_start_end(start, end), new_stmt(), condition, then_branch, else_branch);
     }
 
-    std::vector<std::shared_ptr<Statement>>
+    std::vector<Statement*>
     parse_block_to_statements()
     {
-        std::vector<std::shared_ptr<Statement>> statements;
+        std::vector<Statement*> statements;
         while(check(TokenType::RIGHT_BRACE)==false && is_at_end() == false)
         {
             auto st = parse_declaration_or_null();
             if(st != nullptr)
             {
-                statements.emplace_back(std::move(st));
+                statements.emplace_back(st);
             }
         }
         consume(TokenType::RIGHT_BRACE, "Expected '}' after block.");
         return statements;
     }
 
-    std::shared_ptr<Statement>
+    Statement*
     parse_block_statement()
     {
         auto start = previous_offset();
@@ -410,72 +422,75 @@ struct Parser
         auto statements = parse_block_to_statements();
 
         auto end = previous_offset();
-        return std::make_shared<BlockStatement>(offset_start_end(start, end), new_stmt(), std::move(statements));
+        return make_block_statement(arena, offset_start_end(start, end), new_stmt(), std::move(statements));
     }
 
-    std::shared_ptr<Statement>
+    Statement*
     parse_print_statement()
     {
         const auto print = previous_offset();
         auto value = parse_expression();
         consume_semicolon("print statement");
         const auto end = previous_offset();
-        return std::make_shared<PrintStatement>(offset_start_end(print, end), new_stmt(), std::move(value));
+        return make_print_statement(arena, offset_start_end(print, end), new_stmt(), value);
     }
 
-    std::shared_ptr<Statement>
+    Statement*
     parse_expression_statement()
     {
         auto value = parse_expression();
         const auto start = value->offset;
         consume_semicolon("expression");
         const auto end = previous_offset();
-        return std::make_shared<ExpressionStatement>(offset_start_end(start, end), new_stmt(), std::move(value));
+        return make_expression_statement(arena, offset_start_end(start, end), new_stmt(), value);
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_expression()
     {
         return parse_assignment();
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_assignment()
     {
         auto expr = parse_or();
 
         if(match({TokenType::EQUAL}))
         {
-            auto& equals = previous();
+            const auto equals = previous();
             auto rhs = parse_assignment();
 
             // todo(Gustav): is new_expr needed here or can we reuse the existing expression id?
 
             if(expr->get_type() == ExpressionType::variable_expression)
             {
-                const auto name = static_cast<VariableExpression*>(expr.get())->name;
-                return std::make_shared<AssignExpression>
+                const auto name = static_cast<VariableExpression*>(expr)->name;
+                return make_assign_expression
                 (
+                    arena,
                     offset_start_end(expr->offset, rhs->offset), new_expr(),
-                    name, expr->offset, std::move(rhs)
+                    name, expr->offset, rhs
                 );
             }
             else if(expr->get_type() == ExpressionType::getproperty_expression)
             {
-                auto* set = static_cast<GetPropertyExpression*>(expr.get());
-                return std::make_shared<SetPropertyExpression>
+                auto* set = static_cast<GetPropertyExpression*>(expr);
+                return make_setproperty_expression
                 (
+                    arena,
                     offset_start_end(expr->offset, rhs->offset), new_expr(), 
-                    std::move(set->object), set->name, std::move(rhs)
+                    set->object, set->name, rhs
                 );
             }
             else if(expr->get_type() == ExpressionType::getindex_expression)
             {
-                auto* set = static_cast<GetIndexExpression*>(expr.get());
-                return std::make_shared<SetIndexExpression>
+                auto* set = static_cast<GetIndexExpression*>(expr);
+                return make_setindex_expression
                 (
+                    arena,
                     offset_start_end(expr->offset, rhs->offset), new_expr(), 
-                    std::move(set->object), std::move(set->index), std::move(rhs)
+                    set->object, set->index, rhs
                 );
             }
 
@@ -483,7 +498,7 @@ struct Parser
         }
         else if(match({TokenType::PLUSEQ, TokenType::MINUSEQ, TokenType::STAREQ, TokenType::SLASHEQ}))
         {
-            auto& op = previous();
+            const auto op = previous();
             auto rhs = parse_assignment();
 
             const TokenType bin_op = [op]() {
@@ -499,33 +514,36 @@ struct Parser
 
             const auto full_offset = offset_start_end(expr->offset, rhs->offset);
             auto exprc = expr;
-            rhs = std::make_shared<BinaryExpression>(full_offset, new_expr(), std::move(exprc), bin_op, op.offset, std::move(rhs));
+            rhs = make_binary_expression(arena, full_offset, new_expr(), std::move(exprc), bin_op, op.offset, rhs);
 
             if(expr->get_type() == ExpressionType::variable_expression)
             {
-                const auto name = static_cast<VariableExpression*>(expr.get())->name;
-                return std::make_shared<AssignExpression>
+                const auto name = static_cast<VariableExpression*>(expr)->name;
+                return make_assign_expression
                 (
+                    arena,
                     full_offset, new_expr(),
-                    name, expr->offset, std::move(rhs)
+                    name, expr->offset, rhs
                 );
             }
             else if(expr->get_type() == ExpressionType::getproperty_expression)
             {
-                auto* set = static_cast<GetPropertyExpression*>(expr.get());
-                return std::make_shared<SetPropertyExpression>
+                auto* set = static_cast<GetPropertyExpression*>(expr);
+                return make_setproperty_expression
                 (
+                    arena,
                     full_offset, new_expr(), 
-                    std::move(set->object), set->name, std::move(rhs)
+                    set->object, set->name, rhs
                 );
             }
             else if(expr->get_type() == ExpressionType::getindex_expression)
             {
-                auto* set = static_cast<GetIndexExpression*>(expr.get());
-                return std::make_shared<SetIndexExpression>
+                auto* set = static_cast<GetIndexExpression*>(expr);
+                return make_setindex_expression
                 (
+                    arena,
                     full_offset, new_expr(), 
-                    std::move(set->object), std::move(set->index), std::move(rhs)
+                    set->object, set->index, rhs
                 );
             }
 
@@ -535,7 +553,7 @@ struct Parser
         return expr;
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_or()
     {
         auto left = parse_and();
@@ -543,16 +561,16 @@ struct Parser
 
         while(match({TokenType::OR}))
         {
-            auto& op = previous();
+            const auto op = previous();
             auto right = parse_and();
             const auto end = right->offset;
-            left = std::make_shared<LogicalExpression>(offset_start_end(start, end), new_expr(), std::move(left), op.type, std::move(right));
+            left = make_logical_expression(arena, offset_start_end(start, end), new_expr(), left, op.type, right);
         }
 
         return left;
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_and()
     {
         auto left = parse_equality();
@@ -560,16 +578,16 @@ struct Parser
 
         while(match({TokenType::AND}))
         {
-            auto& op = previous();
+            const auto op = previous();
             auto right = parse_equality();
             const auto end = right->offset;
-            left = std::make_shared<LogicalExpression>(offset_start_end(start, end), new_expr(), std::move(left), op.type, std::move(right));
+            left = make_logical_expression(arena, offset_start_end(start, end), new_expr(), left, op.type, right);
         }
 
         return left;
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_equality()
     {
         auto expr = parse_comparison();
@@ -577,16 +595,16 @@ struct Parser
         while (match({TokenType::BANG_EQUAL, TokenType::EQUAL_EQUAL}))
         {
             const auto start = expr->offset;
-            auto& op = previous();
+            const auto op = previous();
             auto right = parse_comparison();
             const auto end = right->offset;
-            expr = std::make_shared<BinaryExpression>(offset_start_end(start, end), new_expr(), std::move(expr), op.type, op.offset, std::move(right));
+            expr = make_binary_expression(arena, offset_start_end(start, end), new_expr(), expr, op.type, op.offset, right);
         }
 
         return expr;
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_comparison()
     {
         auto expr = parse_term();
@@ -594,16 +612,16 @@ struct Parser
         while (match({TokenType::GREATER, TokenType::GREATER_EQUAL, TokenType::LESS, TokenType::LESS_EQUAL}))
         {
             const auto start = expr->offset;
-            auto& op = previous();
+            const auto op = previous();
             auto right = parse_term();
             const auto end = right->offset;
-            expr = std::make_shared<BinaryExpression>(offset_start_end(start, end), new_expr(), std::move(expr), op.type, op.offset, std::move(right));
+            expr = make_binary_expression(arena, offset_start_end(start, end), new_expr(), expr, op.type, op.offset, right);
         }
 
         return expr;
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_term()
     {
         auto expr = parse_factor();
@@ -611,16 +629,16 @@ struct Parser
         while (match({TokenType::MINUS, TokenType::PLUS}))
         {
             const auto start = expr->offset;
-            auto& op = previous();
+            const auto op = previous();
             auto right = parse_factor();
             const auto end = right->offset;
-            expr = std::make_shared<BinaryExpression>(offset_start_end(start, end), new_expr(), std::move(expr), op.type, op.offset, std::move(right));
+            expr = make_binary_expression(arena, offset_start_end(start, end), new_expr(), expr, op.type, op.offset, right);
         }
 
         return expr;
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_factor()
     {
         auto expr = parse_unary();
@@ -628,57 +646,58 @@ struct Parser
         while (match({TokenType::SLASH, TokenType::STAR}))
         {
             const auto start = expr->offset;
-            auto& op = previous();
+            const auto op = previous();
             auto right = parse_unary();
             const auto end = right->offset;
-            expr = std::make_shared<BinaryExpression>(offset_start_end(start, end), new_expr(), std::move(expr), op.type, op.offset, std::move(right));
+            expr = make_binary_expression(arena, offset_start_end(start, end), new_expr(), expr, op.type, op.offset, right);
         }
 
         return expr;
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_unary()
     {
         if (match({TokenType::BANG, TokenType::MINUS}))
         {
-            auto& op = previous();
+            const auto op = previous();
             auto right = parse_unary();
-            return std::make_shared<UnaryExpression>(offset_start_end(op.offset, right->offset), new_expr(), op.type, op.offset, std::move(right));
+            return make_unary_expression(arena, offset_start_end(op.offset, right->offset), new_expr(), op.type, op.offset, right);
         }
 
         return parse_call();
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_call()
     {
-        std::shared_ptr<Expression> expr;
+        Expression* expr = nullptr;
         
         if(match({TokenType::NEW}))
         {
             consume(TokenType::IDENTIFIER, "expected name of class");
-            auto& prev = previous();
-            expr = std::make_shared<VariableExpression>(prev.offset, new_expr(), std::string(prev.lexeme));
+            const auto prev = previous();
+            expr = make_variable_expression(arena, prev.offset, new_expr(), std::string(prev.lexeme));
 
             while (true)
             {
                 if (match({TokenType::LEFT_PAREN}))
                 {
-                    auto call_ptr = finish_parsing_of_call(std::move(expr));
+                    auto call_ptr = finish_parsing_of_call(expr);
                     assert(call_ptr->get_type() == ExpressionType::call_expression);
-                    auto call = std::static_pointer_cast<CallExpression>(call_ptr);
+                    auto* call = static_cast<CallExpression*>(call_ptr);
                     // transform from CallExpression to ConstructorExpression
-                    expr = std::make_shared<ConstructorExpression>
+                    expr = make_constructor_expression
                     (
-                        call->offset, call->uid, std::move(call->callee), std::move(call->arguments)
+                        arena,
+                        call->offset, call->uid, call->callee, std::move(call->arguments)
                     );
                     break;
                 }
                 else if(match({TokenType::DOT}))
                 {
-                    const auto& name = consume(TokenType::IDENTIFIER, "Expected property name after '.'");
-                    expr = std::make_shared<GetPropertyExpression>(name.offset, new_expr(), std::move(expr), std::string(name.lexeme));
+                    const auto name = consume(TokenType::IDENTIFIER, "Expected property name after '.'");
+                    expr = make_getproperty_expression(arena, name.offset, new_expr(), expr, std::string(name.lexeme));
                 }
                 else
                 {
@@ -697,12 +716,12 @@ struct Parser
         {
             if (match({TokenType::LEFT_PAREN}))
             {
-                expr = finish_parsing_of_call(std::move(expr));
+                expr = finish_parsing_of_call(expr);
             }
             else if(match({TokenType::DOT}))
             {
-                const auto& name = consume(TokenType::IDENTIFIER, "Expected property name after '.'");
-                expr = std::make_shared<GetPropertyExpression>(name.offset, new_expr(), std::move(expr), std::string(name.lexeme));
+                const auto name = consume(TokenType::IDENTIFIER, "Expected property name after '.'");
+                expr = make_getproperty_expression(arena, name.offset, new_expr(), expr, std::string(name.lexeme));
             }
             else if(match({TokenType::LEFT_BRACKET}))
             {
@@ -711,7 +730,7 @@ struct Parser
                 auto index = parse_expression();
                 consume(TokenType::RIGHT_BRACKET, "expected ']' after array indexer");
                 const auto end = previous_offset();
-                expr = std::make_shared<GetIndexExpression>(offset_start_end(start, end), new_expr(), std::move(expr), std::move(index));
+                expr = make_getindex_expression(arena, offset_start_end(start, end), new_expr(), expr, index);
             }
             else
             {
@@ -722,10 +741,10 @@ struct Parser
         return expr;
     }
 
-    std::vector<std::shared_ptr<Expression>>
+    std::vector<Expression*>
     parse_arguments()
     {
-        std::vector<std::shared_ptr<Expression>> arguments;
+        std::vector<Expression*> arguments;
         if (check(TokenType::RIGHT_PAREN) == false)
         {
             do
@@ -748,8 +767,8 @@ struct Parser
         }
     }
 
-    std::shared_ptr<Expression>
-    finish_parsing_of_call(std::shared_ptr<Expression>&& callee)
+    Expression*
+    finish_parsing_of_call(Expression* callee)
     {
         const auto start = previous_offset();
         
@@ -760,15 +779,15 @@ struct Parser
 
         validate_argument_size(arguments.size(), off);
 
-        return std::make_shared<CallExpression>(off, new_expr(), std::move(callee), std::move(arguments));
+        return make_call_expression(arena, off, new_expr(), callee, std::move(arguments));
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_primary()
     {
-        if (match({TokenType::FALSE})) { return std::make_shared<LiteralExpression>(previous_offset(), new_expr(), make_bool(false)); }
-        if (match({TokenType::TRUE})) { return std::make_shared<LiteralExpression>(previous_offset(), new_expr(), make_bool(true)); }
-        if (match({TokenType::NIL})) { return std::make_shared<LiteralExpression>(previous_offset(), new_expr(), make_nil()); }
+        if (match({TokenType::FALSE})) { return make_literal_expression(arena, previous_offset(), new_expr(), make_bool(false)); }
+        if (match({TokenType::TRUE})) { return make_literal_expression(arena, previous_offset(), new_expr(), make_bool(true)); }
+        if (match({TokenType::NIL})) { return make_literal_expression(arena, previous_offset(), new_expr(), make_nil()); }
 
         if(match({TokenType::LEFT_BRACKET}))
         {
@@ -777,8 +796,8 @@ struct Parser
 
         if (match({TokenType::NUMBER_INT, TokenType::NUMBER_FLOAT, TokenType::STRING}))
         {
-            auto& prev = previous();
-            return std::make_shared<LiteralExpression>(prev.offset, new_expr(), std::move(prev.literal));
+            auto prev = previous();
+            return make_literal_expression(arena, prev.offset, new_expr(), std::move(prev.literal));
         }
 
         if(match({TokenType::SUPER}))
@@ -792,25 +811,25 @@ struct Parser
                 const auto off = offset_start_end(start, end);
                 validate_argument_size(arguments.size(), off);
 
-                return std::make_shared<SuperConstructorCallExpression>(off, new_expr(), std::move(arguments));
+                return make_superconstructorcall_expression(arena, off, new_expr(), std::move(arguments));
             }
 
             consume(TokenType::DOT, "Expected '.' after 'super' keyword");
             auto name = consume(TokenType::IDENTIFIER, "Expected superclass property").lexeme;
             const auto end = previous_offset();
-            return std::make_shared<SuperExpression>(offset_start_end(start, end), new_expr(), std::string(name));
+            return make_super_expression(arena, offset_start_end(start, end), new_expr(), std::string(name));
         }
 
         if( match({TokenType::THIS}))
         {
-            auto& prev = previous();
-            return std::make_shared<ThisExpression>(prev.offset, new_expr());
+            const auto prev = previous();
+            return make_this_expression(arena, prev.offset, new_expr());
         }
 
         if (match({TokenType::IDENTIFIER}))
         {
-            auto& prev = previous();
-            return std::make_shared<VariableExpression>(prev.offset, new_expr(), std::string(prev.lexeme));
+            const auto prev = previous();
+            return make_variable_expression(arena, prev.offset, new_expr(), std::string(prev.lexeme));
         }
 
         if (match({TokenType::LEFT_PAREN}))
@@ -819,17 +838,17 @@ struct Parser
             auto expr = parse_expression();
             consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
             const Offset right_paren = previous_offset();
-            return std::make_shared<GroupingExpression>(offset_start_end(left_paren, right_paren), new_expr(), std::move(expr));
+            return make_grouping_expression(arena, offset_start_end(left_paren, right_paren), new_expr(), expr);
         }
 
         throw error(offset_for_range_error(previous_offset(), peek()), "Expected expression.");
     }
 
-    std::shared_ptr<Expression>
+    Expression*
     parse_array()
     {
         const Offset start = previous_offset();
-        std::vector<std::shared_ptr<Expression>> values;
+        std::vector<Expression*> values;
         if (check(TokenType::RIGHT_BRACKET) == false)
         {
             do
@@ -840,7 +859,7 @@ struct Parser
 
         const auto end = consume(TokenType::RIGHT_BRACKET, "Expect ']' to end array").offset;
 
-        return std::make_shared<ArrayExpression>(offset_start_end(start, end), new_expr(), std::move(values));
+        return make_array_expression(arena, offset_start_end(start, end), new_expr(), std::move(values));
     }
 
 
@@ -881,37 +900,39 @@ struct Parser
     {
         if (is_at_end() == false)
         {
-            current += 1;
+            previous_token = std::move(current_token);
+            current_token = pull_token();
+            at_first_token = false;
         }
 
         return previous();
     }
 
     bool
-    is_at_end() 
+    is_at_end()
     {
         return peek().type == TokenType::EOF;
     }
 
     Token&
-    peek() 
+    peek()
     {
-        return tokens[current];
+        return current_token;
     }
 
     Token&
-    previous() 
+    previous()
     {
-        assert(current != 0);
-        return tokens[current - 1];
+        assert(at_first_token == false);
+        return previous_token;
     }
 
     Offset
     previous_offset()
     {
-        if(current == 0)
+        if(at_first_token)
         {
-            return {tokens[current].offset.source, 0};
+            return {current_token.offset.source, 0};
         }
         else
         {
@@ -1004,19 +1025,57 @@ struct Parser
 namespace lox
 {
 
-ParseResult
-parse_program(std::vector<Token>& tokens, ErrorHandler* error_handler)
+namespace
 {
-    auto parser = Parser{tokens, error_handler};
-    try
-    {
-        auto prog = parser.parse_program();
-        return {parser.error_count, prog};
-    }
-    catch(const ParseError&)
+    ParseResult
+    parse_pulled_tokens(std::function<Token()> pull, ErrorHandler* error_handler)
     {
-        return {parser.error_count, nullptr};
+        auto program = std::make_shared<Program>();
+        auto parser = Parser{std::move(pull), error_handler, program->arena};
+        try
+        {
+            parser.parse_program(*program);
+            return {parser.error_count, program};
+        }
+        catch(const ParseError&)
+        {
+            return {parser.error_count, nullptr};
+        }
     }
 }
 
+ParseResult
+parse_program(std::vector<Token>& tokens, ErrorHandler* error_handler)
+{
+    assert(tokens.empty() == false && "the scanner always emits a EOF token");
+    std::size_t index = 0;
+    return parse_pulled_tokens
+    (
+        [&tokens, index]() mutable -> Token
+        {
+            // the vector ends with EOF, keep handing that out
+            const auto& token = tokens[index];
+            if(index + 1 < tokens.size())
+            {
+                index += 1;
+            }
+            return token;
+        },
+        error_handler
+    );
+}
+
+ParseResult
+parse_program(TokenStream& tokens, ErrorHandler* error_handler)
+{
+    return parse_pulled_tokens
+    (
+        [&tokens]() -> Token
+        {
+            return tokens.scan_next();
+        },
+        error_handler
+    );
+}
+
 }
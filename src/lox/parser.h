@@ -12,6 +12,7 @@ namespace lox
 {
 
 struct ErrorHandler;
+struct TokenStream;
 
 
 // return nullptr when parsing failed
@@ -25,5 +26,10 @@ struct ParseResult
 ParseResult
 parse_program(std::vector<Token>& tokens, ErrorHandler* error_handler);
 
+// pull tokens straight from the scanner as they are needed, so a big
+// script never materializes its whole token vector
+ParseResult
+parse_program(TokenStream& tokens, ErrorHandler* error_handler);
+
 }
 
@@ -116,6 +116,32 @@ print_message(PrintHandler* print, std::string_view type, const Offset& offset,
 namespace lox
 {
 
+void
+for_each_line(std::string_view batch, const std::function<void (std::string_view)>& on_line)
+{
+    while(batch.empty() == false)
+    {
+        const auto end = batch.find('\n');
+        if(end == std::string_view::npos)
+        {
+            // a trailing unterminated line, still hand it over
+            on_line(batch);
+            return;
+        }
+
+        on_line(batch.substr(0, end));
+        batch = batch.substr(end + 1);
+    }
+}
+
+
+void
+PrintHandler::write(std::string_view batch)
+{
+    for_each_line(batch, [this](std::string_view line) { on_line(line); });
+}
+
+
 void
 PrintHandler::on_errors(const Offset& offset, const std::vector<std::string>& message)
 {
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include "lox/errorhandler.h"
 
 
@@ -8,7 +10,26 @@ namespace lox
 {
 
 
-struct PrintHandler : ErrorHandler
+// batched destination for print output: the interpreter appends lines
+// into one reused buffer and hands over whole chunks instead of paying
+// a type erased callback and a string allocation per line
+struct LineWriter
+{
+    LineWriter() = default;
+    virtual ~LineWriter() = default;
+
+    // a batch of newline terminated lines
+    virtual void
+    write(std::string_view batch) = 0;
+};
+
+
+// call the callback once per newline terminated line in a batch
+void
+for_each_line(std::string_view batch, const std::function<void (std::string_view)>& on_line);
+
+
+struct PrintHandler : ErrorHandler, LineWriter
 {
     PrintHandler() = default;
     virtual ~PrintHandler() = default;
@@ -16,6 +37,11 @@ struct PrintHandler : ErrorHandler
     virtual void
     on_line(std::string_view line) = 0;
 
+    // splits a batch back into on_line calls; handlers that can sink
+    // whole chunks should override this instead
+    void
+    write(std::string_view batch) override;
+
     void
     on_errors(const Offset& offset, const std::vector<std::string>& message) override;
 
@@ -1,2 +1,197 @@
 #include "lox/program.h"
 
+#include "lox/symbol.h"
+
+
+namespace lox
+{
+
+
+namespace
+{
+    // walks every node and retires the caches that interpreters write
+    // during execution, see freeze_for_sharing
+    struct FreezeVisitor : ExpressionVoidVisitor, StatementVoidVisitor
+    {
+        void freeze(const Expression* x)
+        {
+            if(x == nullptr) { return; }
+            dispatch(*x, this);
+        }
+
+        void freeze(const Statement* x)
+        {
+            if(x == nullptr) { return; }
+            dispatch(*x, this);
+        }
+
+        //-----------------------------------------------------------------
+        // expressions
+
+        void on_assign_expression(const AssignExpression& x) override
+        {
+            freeze(x.value);
+        }
+
+        void on_binary_expression(const BinaryExpression& x) override
+        {
+            // generic is the only state the interpreter never writes to
+            x.quickening = BinaryQuickening::generic;
+            freeze(x.left);
+            freeze(x.right);
+        }
+
+        void on_call_expression(const CallExpression& x) override
+        {
+            freeze(x.callee);
+            for(const auto* a: x.arguments) { freeze(a); }
+        }
+
+        void on_array_expression(const ArrayExpression& x) override
+        {
+            for(const auto* v: x.values) { freeze(v); }
+        }
+
+        void on_constructor_expression(const ConstructorExpression& x) override
+        {
+            freeze(x.klass);
+            for(const auto* a: x.arguments) { freeze(a); }
+        }
+
+        void on_superconstructorcall_expression(const SuperConstructorCallExpression& x) override
+        {
+            for(const auto* a: x.arguments) { freeze(a); }
+        }
+
+        void on_getproperty_expression(const GetPropertyExpression& x) override
+        {
+            // interned here, once, so execution never writes the optional
+            x.name_symbol = intern_symbol(x.name);
+            x.property_cache.frozen = true;
+            freeze(x.object);
+        }
+
+        void on_setproperty_expression(const SetPropertyExpression& x) override
+        {
+            x.name_symbol = intern_symbol(x.name);
+            x.property_cache.frozen = true;
+            freeze(x.object);
+            freeze(x.value);
+        }
+
+        void on_getindex_expression(const GetIndexExpression& x) override
+        {
+            freeze(x.object);
+            freeze(x.index);
+        }
+
+        void on_setindex_expression(const SetIndexExpression& x) override
+        {
+            freeze(x.object);
+            freeze(x.index);
+            freeze(x.value);
+        }
+
+        void on_super_expression(const SuperExpression& x) override
+        {
+            x.name_symbol = intern_symbol(x.property);
+        }
+
+        void on_this_expression(const ThisExpression&) override
+        {
+        }
+
+        void on_grouping_expression(const GroupingExpression& x) override
+        {
+            freeze(x.expression);
+        }
+
+        void on_literal_expression(const LiteralExpression&) override
+        {
+        }
+
+        void on_logical_expression(const LogicalExpression& x) override
+        {
+            freeze(x.left);
+            freeze(x.right);
+        }
+
+        void on_unary_expression(const UnaryExpression& x) override
+        {
+            freeze(x.right);
+        }
+
+        void on_variable_expression(const VariableExpression&) override
+        {
+        }
+
+        //-----------------------------------------------------------------
+        // statements
+
+        void on_block_statement(const BlockStatement& x) override
+        {
+            for(const auto* s: x.statements) { freeze(s); }
+        }
+
+        void on_class_statement(const ClassStatement& x) override
+        {
+            freeze(x.parent);
+            for(const auto* m: x.members) { freeze(m); }
+            for(const auto* m: x.methods) { freeze(m); }
+            for(const auto* m: x.static_methods) { freeze(m); }
+        }
+
+        void on_function_statement(const FunctionStatement& x) override
+        {
+            for(const auto* s: x.body) { freeze(s); }
+        }
+
+        void on_expression_statement(const ExpressionStatement& x) override
+        {
+            freeze(x.expression);
+        }
+
+        void on_if_statement(const IfStatement& x) override
+        {
+            freeze(x.condition);
+            freeze(x.then_branch);
+            freeze(x.else_branch);
+        }
+
+        void on_print_statement(const PrintStatement& x) override
+        {
+            freeze(x.expression);
+        }
+
+        void on_return_statement(const ReturnStatement& x) override
+        {
+            freeze(x.value);
+        }
+
+        void on_var_statement(const VarStatement& x) override
+        {
+            freeze(x.initializer);
+        }
+
+        void on_while_statement(const WhileStatement& x) override
+        {
+            freeze(x.condition);
+            freeze(x.body);
+        }
+    };
+}
+
+
+void
+freeze_for_sharing(Program& program)
+{
+    auto freezer = FreezeVisitor{};
+    for(const auto* statement: program.statements)
+    {
+        freezer.freeze(statement);
+    }
+    program.is_frozen = true;
+}
+
+
+}
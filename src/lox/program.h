@@ -2,6 +2,7 @@
 
 #include <vector>
 
+#include "lox/ast_arena.h"
 #include "lox/ast.h"
 
 
@@ -10,7 +11,23 @@ namespace lox
 
 struct Program
 {
-    std::vector<std::shared_ptr<Statement>> statements;
+    // owns every node reachable from statements, so the program must
+    // outlive anything that keeps pointers into the tree
+    AstArena arena;
+    std::vector<Statement*> statements;
+
+    // set by freeze_for_sharing, after that the tree is immutable
+    bool is_frozen = false;
 };
 
+
+// make a resolved program safely executable by several interpreters on
+// different threads at once: property names are interned up front,
+// binary sites are pinned to the generic path and the inline caches
+// are retired, so execution never writes into the shared tree. The
+// trade is that a frozen program runs without type feedback or
+// property caches; freeze only what a worker pool actually shares
+void
+freeze_for_sharing(Program& program);
+
 }
@@ -19,6 +19,57 @@ struct Var
 {
     Offset offset;
     VarStatus status;
+
+    // declaration index within the scope, becomes the environment slot
+    std::size_t slot;
+
+    // where to record that a closure captured this variable so the
+    // interpreter boxes it in a cell; null for declarations that are
+    // always boxed ("this", "super") or tracked elsewhere (parameters)
+    bool* captured_flag = nullptr;
+};
+
+using ResolverScope = std::unordered_map<std::string, Var>;
+
+}}
+
+
+namespace lox
+{
+
+// cleared scope maps kept between resolves, begin_scope reuses their
+// buckets instead of allocating fresh maps for every snippet
+struct ResolverSession
+{
+    std::vector<ResolverScope> scope_pool;
+};
+
+std::shared_ptr<ResolverSession>
+make_resolver_session()
+{
+    return std::make_shared<ResolverSession>();
+}
+
+}
+
+
+namespace lox { namespace
+{
+
+// one entry per function the resolver is currently inside, so variable
+// references that cross a function boundary become upvalue captures
+// instead of walks through the (no longer retained) environment chain
+struct FunctionBoundary
+{
+    // scopes from this index and up belong to the function's frame
+    std::size_t first_scope;
+
+    // the scope holding the parameters, captured parameters are flagged
+    // on the function statement itself
+    std::size_t param_scope;
+
+    const FunctionStatement* function;
+    std::vector<UpvalueSource> upvalues;
 };
 
 enum class FunctionType
@@ -34,10 +85,12 @@ enum class ClassType
 
 struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
 {
-    using Scope = std::unordered_map<std::string, Var>;
+    using Scope = ResolverScope;
     ErrorHandler* error_handler;
+    ResolverSession* session; // may be null, then nothing is recycled
     bool has_errors = false;
     std::vector<Scope> scopes;
+    std::vector<FunctionBoundary> function_boundaries;
     FunctionType current_function = FunctionType::none;
     ClassType current_class = ClassType::none;
     bool inside_static_method = false;
@@ -45,21 +98,16 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
     //-------------------------------------------------------------------------
     // constructor
 
-    explicit MainResolver(ErrorHandler* eh)
+    MainResolver(ErrorHandler* eh, ResolverSession* s)
         : error_handler(eh)
+        , session(s)
     {
     }
 
     //---------------------------------------------------------------------------------------------
     // util functions
 
-    std::unordered_map<u64, std::size_t> locals;
-    void interpreter_resolve(u64 id, std::size_t dist)
-    {
-        locals.insert({id, dist});
-    }
-
-    void resolve(const std::vector<std::shared_ptr<Statement>>& statements)
+    void resolve(const std::vector<Statement*>& statements)
     {
         for(const auto& st: statements)
         {
@@ -67,27 +115,40 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
         }
     }
 
-    void resolve(std::shared_ptr<Statement> statement)
+    void resolve(const Statement* statement)
     {
         statement->accept(this);
     }
 
-    void resolve(std::shared_ptr<Expression> statement)
+    void resolve(const Expression* statement)
     {
         statement->accept(this);
     }
 
     void begin_scope()
     {
-        scopes.emplace_back();
+        if(session != nullptr && session->scope_pool.empty() == false)
+        {
+            scopes.emplace_back(std::move(session->scope_pool.back()));
+            session->scope_pool.pop_back();
+        }
+        else
+        {
+            scopes.emplace_back();
+        }
     }
 
     void end_scope()
     {
+        if(session != nullptr)
+        {
+            scopes.back().clear();
+            session->scope_pool.emplace_back(std::move(scopes.back()));
+        }
         scopes.pop_back();
     }
 
-    void declare_var(const std::string& name, const Offset& off)
+    void declare_var(const std::string& name, const Offset& off, bool* captured_flag = nullptr)
     {
         if(scopes.empty()) { return; }
 
@@ -100,7 +161,7 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
             return;
         }
 
-        scope.insert({name, Var{off, VarStatus::declared}});
+        scope.insert({name, Var{off, VarStatus::declared, scope.size(), captured_flag}});
     }
 
     void define_var(const std::string& name)
@@ -112,30 +173,126 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
         found->second.status = VarStatus::defined;
     }
 
-    void resolve_local(const Expression& x, const std::string& name)
+    // a resolved reference is either a walk through the environment chain
+    // or, when it crosses a function boundary, an upvalue cell index
+    struct ResolvedAccess
     {
-        if(scopes.empty()) { return; }
+        std::optional<VarLocation> location;
+        std::optional<std::size_t> upvalue;
+    };
+
+    // frame 0 is top level code, frame f+1 is function_boundaries[f]
+    std::size_t get_frame_for_scope(std::size_t scope_index)
+    {
+        std::size_t frame = 0;
+        while(frame < function_boundaries.size() && function_boundaries[frame].first_scope <= scope_index)
+        {
+            frame += 1;
+        }
+        return frame;
+    }
+
+    std::size_t add_upvalue(FunctionBoundary& boundary, const UpvalueSource& source)
+    {
+        for(std::size_t index = 0; index < boundary.upvalues.size(); index += 1)
+        {
+            const auto& existing = boundary.upvalues[index];
+            if
+            (
+                existing.from_enclosing_upvalue == source.from_enclosing_upvalue
+                && existing.distance == source.distance
+                && existing.slot == source.slot
+            )
+            {
+                return index;
+            }
+        }
+
+        boundary.upvalues.emplace_back(source);
+        return boundary.upvalues.size() - 1;
+    }
+
+    // mark the declaration boxed and thread the capture through every
+    // function between the declaring frame and the innermost one, like the
+    // clox upvalue chain; returns the innermost upvalue index
+    std::size_t capture_upvalue(std::size_t scope_index, Var& var, std::size_t declaring_frame)
+    {
+        if(var.captured_flag != nullptr)
+        {
+            *var.captured_flag = true;
+        }
+        if(declaring_frame > 0)
+        {
+            // parameters share the frame scope with body locals, only the
+            // first params.size() slots are actual parameters
+            FunctionBoundary& owner = function_boundaries[declaring_frame - 1];
+            if
+            (
+                owner.param_scope == scope_index
+                && owner.function != nullptr
+                && var.slot < owner.function->params.size()
+            )
+            {
+                owner.function->param_is_captured[var.slot] = true;
+            }
+        }
+
+        // the function statement executes one scope outside its own frame,
+        // so that is where the creation-site distance is measured from
+        FunctionBoundary& innermost_sharing = function_boundaries[declaring_frame];
+        const auto creation_scope = innermost_sharing.first_scope - 1;
+        auto index = add_upvalue(innermost_sharing, UpvalueSource{false, creation_scope - scope_index, var.slot});
+
+        for(std::size_t frame = declaring_frame + 1; frame < function_boundaries.size(); frame += 1)
+        {
+            index = add_upvalue(function_boundaries[frame], UpvalueSource{true, 0, index});
+        }
+
+        return index;
+    }
+
+    ResolvedAccess resolve_access(const std::string& name)
+    {
+        if(scopes.empty()) { return {}; }
 
         for (std::size_t scope_index = scopes.size() - 1; true; scope_index -= 1)
         {
             Scope& scope = scopes[scope_index];
-            if(scopes[scope_index].find(name) != scope.end())
+            if(auto found = scope.find(name); found != scope.end())
             {
-                interpreter_resolve(x.uid.value, scopes.size() - 1 - scope_index);
-                return;
+                const auto declaring_frame = get_frame_for_scope(scope_index);
+                if(declaring_frame == function_boundaries.size())
+                {
+                    return {VarLocation{scopes.size() - 1 - scope_index, found->second.slot}, std::nullopt};
+                }
+                return {std::nullopt, capture_upvalue(scope_index, found->second, declaring_frame)};
             }
 
             if(scope_index == 0)
             {
-                return;
+                return {};
             }
         }
     }
 
-    void resolve_function(const FunctionStatement& s, FunctionType type)
+    void resolve_local(const Expression& x, const std::string& name)
+    {
+        const auto access = resolve_access(name);
+        x.resolved_location = access.location;
+        x.resolved_upvalue = access.upvalue;
+    }
+
+    // enclosed_scopes counts already open scopes that belong to the new
+    // frame: the synthetic "super"/"this" scopes around method bodies
+    void resolve_function(const FunctionStatement& s, FunctionType type, std::size_t enclosed_scopes = 0)
     {
         auto enclosing_function = current_function;
         current_function = type;
+
+        s.param_is_captured.assign(s.params.size(), false);
+        s.upvalue_sources.clear();
+        function_boundaries.emplace_back(FunctionBoundary{scopes.size() - enclosed_scopes, scopes.size(), &s, {}});
+
         begin_scope();
 
         for(const auto& p: s.params)
@@ -147,6 +304,9 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
         resolve(s.body);
 
         end_scope();
+
+        s.upvalue_sources = std::move(function_boundaries.back().upvalues);
+        function_boundaries.pop_back();
         current_function = enclosing_function;
     }
 
@@ -158,6 +318,19 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
     {
         begin_scope();
         resolve(s.statements);
+
+        // capture flags are set while resolving the statements above, so
+        // this is the earliest the block knows if its locals escape
+        const Scope& scope = scopes.back();
+        s.has_captured_declarations = std::any_of
+        (
+            scope.begin(), scope.end(), [](const auto& entry)
+            {
+                const Var& var = entry.second;
+                return var.captured_flag != nullptr && *var.captured_flag;
+            }
+        );
+
         end_scope();
     }
     
@@ -166,7 +339,7 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
         auto enclosing_class = current_class;
         current_class = ClassType::klass;
 
-        declare_var(x.name, x.offset);
+        declare_var(x.name, x.offset, &x.is_captured);
         define_var(x.name);
 
         // todo(Gustav): this only means that the error in class Test : Test {} is a undefined variable
@@ -221,7 +394,7 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
         }
 
         begin_scope();
-        declare_var("this", x.offset);
+        declare_var("this", x.offset, &x.this_is_captured);
         define_var("this");
 
         for(auto& method: x.methods)
@@ -231,7 +404,10 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
                 ? FunctionType::initializer
                 : FunctionType::method
                 ;
-            resolve_function(*method, function_type);
+            // the synthetic "super"/"this" scopes are part of each method's
+            // frame: at runtime they sit between the body environment and
+            // the global environment instead of the defining chain
+            resolve_function(*method, function_type, x.parent != nullptr ? 2 : 1);
         }
 
         end_scope();
@@ -264,7 +440,7 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
 
     void on_var_statement(const VarStatement& s) override
     {
-        declare_var(s.name, s.offset);
+        declare_var(s.name, s.offset, &s.is_captured);
         if(s.initializer != nullptr)
         {
             resolve(s.initializer);
@@ -275,7 +451,7 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
     void on_function_statement(const FunctionStatement& s) override
     {
         // todo(Gustav): only function "header"?
-        declare_var(s.name, s.offset);
+        declare_var(s.name, s.offset, &s.is_captured);
         define_var(s.name);
         resolve_function(s, FunctionType::function);
     }
@@ -394,6 +570,7 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
         error_for_incorrect_super_usage(x.offset);
 
         resolve_local(x, "super");
+        x.this_upvalue = resolve_this_alongside_super(x);
         for(const auto& a: x.arguments)
         {
             resolve(a);
@@ -453,10 +630,22 @@ struct MainResolver : ExpressionVoidVisitor, StatementVoidVisitor
         }
     }
 
+    // a nested function reaching "super" has no distance to anchor "this"
+    // from, so it captures "this" in a cell of its own
+    std::optional<std::size_t> resolve_this_alongside_super(const Expression& x)
+    {
+        if(x.resolved_upvalue.has_value() == false)
+        {
+            return std::nullopt;
+        }
+        return resolve_access("this").upvalue;
+    }
+
     void on_super_expression(const SuperExpression& x) override
     {
         error_for_incorrect_super_usage(x.offset);
         resolve_local(x, "super");
+        x.this_upvalue = resolve_this_alongside_super(x);
     }
 
     void on_this_expression(const ThisExpression& x) override
@@ -509,7 +698,13 @@ namespace lox
 std::optional<Resolved>
 resolve(Program& program, ErrorHandler* eh)
 {
-    auto main = MainResolver{eh};
+    return resolve(program, eh, nullptr);
+}
+
+std::optional<Resolved>
+resolve(Program& program, ErrorHandler* eh, ResolverSession* session)
+{
+    auto main = MainResolver{eh, session};
 
     for(auto& s: program.statements)
     {
@@ -518,7 +713,7 @@ resolve(Program& program, ErrorHandler* eh)
 
     if(main.has_errors) { return std::nullopt; }
 
-    return Resolved{main.locals};
+    return Resolved{};
 }
 
 }
@@ -9,14 +9,27 @@ namespace lox
 
 struct ErrorHandler;
 
+// resolution results are written straight into the ast
+// (Expression::resolved_location), a Resolved value is evidence that
+// resolving succeeded
 struct Resolved
 {
-    std::unordered_map<u64, std::size_t> locals;
 };
 
+// scratch state recycled between resolves, so a long lived session
+// running many small snippets doesn't reallocate the resolver's scope
+// maps for every call; create one and pass it to every resolve
+struct ResolverSession;
+
+std::shared_ptr<ResolverSession>
+make_resolver_session();
+
 std::optional<Resolved>
 resolve(Program& program, ErrorHandler* err);
 
+std::optional<Resolved>
+resolve(Program& program, ErrorHandler* err, ResolverSession* session);
+
 
 }
 
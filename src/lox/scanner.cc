@@ -1,10 +1,11 @@
 #include "lox/scanner.h"
 
-#include <unordered_map>
+#include <array>
 #include <sstream>
 
 #include "lox/errorhandler.h"
 #include "lox/object.h"
+#include "lox/symbol.h"
 
 
 namespace lox { namespace
@@ -27,11 +28,20 @@ is_alpha_char(char c)
 }
 
 
-bool
-is_alphanum_char(char c)
+// one entry per character so the identifier run loop is a single table
+// load per character instead of a chain of range compares
+constexpr auto is_identifier_char_table = []() constexpr
 {
-    return is_alpha_char(c) || is_num_char(c);
-}
+    std::array<bool, 256> table = {};
+    for(int c = 0; c < 256; c += 1)
+    {
+        const bool is_lower_case = 'a' <= c && c <= 'z';
+        const bool is_upper_case = 'A' <= c && c <= 'Z';
+        const bool is_digit = '0' <= c && c <= '9';
+        table[static_cast<std::size_t>(c)] = is_lower_case || is_upper_case || is_digit || c == '_';
+    }
+    return table;
+}();
 
 
 template<typename T>
@@ -69,49 +79,69 @@ substr(std::string_view str, std::size_t start_index, std::size_t end_index)
 }
 
 
-std::optional<TokenType>
+// the keyword set is fixed by tokentype.h, so recognition is a constexpr
+// switch on the first character followed by one full compare instead of a
+// hash map built at runtime
+constexpr std::optional<TokenType>
 find_keyword_or_null(std::string_view str)
 {
-    // todo(Gustav): just constinit this instead of going via a local function
-    static const std::unordered_map<std::string_view, TokenType> keywords = []() -> auto
+    switch(str.empty() ? '\0' : str[0])
     {
-        std::unordered_map<std::string_view, TokenType> kw;
-        
-        kw["and"] = TokenType::AND;
-        kw["class"] = TokenType::CLASS;
-        kw["else"] = TokenType::ELSE;
-        kw["false"] = TokenType::FALSE;
-        kw["for"] = TokenType::FOR;
-        kw["fun"] = TokenType::FUN;
-        kw["if"] = TokenType::IF;
-        kw["nil"] = TokenType::NIL;
-        kw["or"] = TokenType::OR;
-        kw["print"] = TokenType::PRINT;
-        kw["return"] = TokenType::RETURN;
-        kw["super"] = TokenType::SUPER;
-        kw["this"] = TokenType::THIS;
-        kw["true"] = TokenType::TRUE;
-        kw["var"] = TokenType::VAR;
-        kw["while"] = TokenType::WHILE;
-        
-        kw["new"] = TokenType::NEW;
-        kw["static"] = TokenType::STATIC;
-        kw["const"] = TokenType::CONST;
-
-        return kw;
-    }();
-
-    const auto found = keywords.find(str);
-    if(found != keywords.end())
-    {
-        return found->second;
-    }
-    else
-    {
-        return std::nullopt;
+    case 'a':
+        if(str == "and")    { return TokenType::AND; }
+        break;
+    case 'c':
+        if(str == "class")  { return TokenType::CLASS; }
+        if(str == "const")  { return TokenType::CONST; }
+        break;
+    case 'e':
+        if(str == "else")   { return TokenType::ELSE; }
+        break;
+    case 'f':
+        if(str == "false")  { return TokenType::FALSE; }
+        if(str == "for")    { return TokenType::FOR; }
+        if(str == "fun")    { return TokenType::FUN; }
+        break;
+    case 'i':
+        if(str == "if")     { return TokenType::IF; }
+        break;
+    case 'n':
+        if(str == "new")    { return TokenType::NEW; }
+        if(str == "nil")    { return TokenType::NIL; }
+        break;
+    case 'o':
+        if(str == "or")     { return TokenType::OR; }
+        break;
+    case 'p':
+        if(str == "print")  { return TokenType::PRINT; }
+        break;
+    case 'r':
+        if(str == "return") { return TokenType::RETURN; }
+        break;
+    case 's':
+        if(str == "static") { return TokenType::STATIC; }
+        if(str == "super")  { return TokenType::SUPER; }
+        break;
+    case 't':
+        if(str == "this")   { return TokenType::THIS; }
+        if(str == "true")   { return TokenType::TRUE; }
+        break;
+    case 'v':
+        if(str == "var")    { return TokenType::VAR; }
+        break;
+    case 'w':
+        if(str == "while")  { return TokenType::WHILE; }
+        break;
+    default:
+        break;
     }
+
+    return std::nullopt;
 }
 
+static_assert(find_keyword_or_null("while") == TokenType::WHILE);
+static_assert(find_keyword_or_null("whale").has_value() == false);
+
 
 struct Scanner
 {
@@ -119,29 +149,45 @@ struct Scanner
     std::shared_ptr<Source> file;
     ErrorHandler* error_handler;
 
-    ScanResult result; // output "variable"
+    std::optional<Token> pending; // set by add_token
+    int errors = 0;
 
     std::size_t start = 0; // first character in lexeme being scanned
     std::size_t current = 0; // character currently being scanned
 
-    explicit Scanner(std::string_view s, ErrorHandler* eh)
-        : source(s)
-        , file(std::make_shared<Source>(std::string(s)))
+    explicit Scanner(std::shared_ptr<Source> f, ErrorHandler* eh)
+        : source(f->source)
+        , file(std::move(f))
         , error_handler(eh)
     {
     }
 
-    void
-    scan_many_tokens()
+    // the next token; EOF forever once all characters are consumed
+    Token
+    scan_next()
     {
-        while (!is_at_end())
+        pending.reset();
+        while (pending.has_value() == false && is_at_end() == false)
         {
+            // skip whitespace runs in one go, the standard library search
+            // is vectorized where the platform supports it
+            skip_until(source.find_first_not_of(" \r\t\n", current));
+            if (is_at_end())
+            {
+                break;
+            }
+
             // We are at the beginning of the next lexeme.
             start = current;
             scan_single_token();
         }
 
-        result.tokens.emplace_back(TokenType::EOF, "", nullptr, Offset{file, current, current});
+        if(pending.has_value())
+        {
+            return std::move(*pending);
+        }
+
+        return Token{TokenType::EOF, "", nullptr, Offset{file, current, current}};
     }
 
     void
@@ -204,33 +250,45 @@ struct Scanner
             }
             else
             {
-                result.errors += 1;
+                errors += 1;
                 error_handler->on_error(Offset{file, start}, "Unexpected character.");
             }
             break;
         }
     }
 
+    // move the cursor to a position returned by a bulk search, npos means
+    // everything up to the end was skipped
+    void
+    skip_until(std::size_t position)
+    {
+        current = position == std::string_view::npos ? source.length() : position;
+    }
+
     void
     scan_identifier_or_keyword()
     {
-        while (is_alphanum_char(peek()))
+        while (current < source.length()
+               && is_identifier_char_table[static_cast<unsigned char>(source[current])])
         {
-            advance();
+            current += 1;
         }
 
         const auto text = substr(source, start, current);
         const auto keyword_type = find_keyword_or_null(text);
+        if(keyword_type.has_value() == false)
+        {
+            // warm the symbol table so runtime property lookups on this name
+            // find an already interned entry
+            intern_symbol(text);
+        }
         add_token(keyword_type.value_or(TokenType::IDENTIFIER));
     }
 
     void
     scan_number()
     {
-        while (is_num_char(peek()))
-        {
-            advance();
-        }
+        skip_until(source.find_first_not_of("0123456789", current));
 
         bool is_int = true;
 
@@ -241,10 +299,7 @@ struct Scanner
             // Consume the "."
             advance();
 
-            while (is_num_char(peek()))
-            {
-                advance();
-            }
+            skip_until(source.find_first_not_of("0123456789", current));
         }
 
         const auto str = substr(source, start, current);
@@ -267,14 +322,13 @@ struct Scanner
         // todo(Gustav): add format strings?
         // todo(Gustav): concat many strings like c
         // todo(Gustav): add support for here-docs?: https://en.wikipedia.org/wiki/Here_document
-        while (peek() != end_char && !is_at_end())
-        {
-            advance();
-        }
+        // find the closing quote with one bulk search instead of a per
+        // character loop
+        skip_until(source.find(end_char, current));
 
         if (is_at_end())
         {
-            result.errors += 1;
+            errors += 1;
             error_handler->on_error(Offset{file, start, current}, "Unterminated string.");
             return;
         }
@@ -285,16 +339,15 @@ struct Scanner
         // Trim the surrounding quotes.
         assert(current > 0);
         auto value = substr(source, start + 1, current - 1);
+        intern_symbol(value);
         add_token(TokenType::STRING, make_string(std::string(value)));
     }
 
     void
     eat_line()
     {
-        while (peek() != '\n' && !is_at_end())
-        {
-            advance();
-        }
+        // the newline itself is left for the whitespace skip
+        skip_until(source.find('\n', current));
     }
 
     // only consume if the character is what we are looking for
@@ -369,7 +422,7 @@ struct Scanner
     add_token(TokenType type, std::shared_ptr<Object> literal)
     {
         auto text = substr(source, start, current);
-        result.tokens.emplace_back(Token(type, text, std::move(literal), Offset{file, start, current}));
+        pending = Token(type, text, std::move(literal), Offset{file, start, current});
     }
 };
 } }
@@ -412,12 +465,53 @@ parse_package_path(const std::string& path)
     return {};
 }
 
+ScanResult
+scan_tokens(std::shared_ptr<Source> source, ErrorHandler* error_handler)
+{
+    auto scanner = Scanner(std::move(source), error_handler);
+
+    ScanResult result;
+    while(true)
+    {
+        auto token = scanner.scan_next();
+        const auto found_eof = token.type == TokenType::EOF;
+        result.tokens.emplace_back(std::move(token));
+        if(found_eof) { break; }
+    }
+    result.errors = scanner.errors;
+    return result;
+}
+
+
+struct TokenStreamImpl
+{
+    Scanner scanner;
+};
+
+
+TokenStream::TokenStream(std::shared_ptr<Source> source, ErrorHandler* error_handler)
+    : impl(std::make_unique<TokenStreamImpl>(TokenStreamImpl{Scanner{std::move(source), error_handler}}))
+{
+}
+
+TokenStream::~TokenStream() = default;
+
+Token
+TokenStream::scan_next()
+{
+    return impl->scanner.scan_next();
+}
+
+int
+TokenStream::get_error_count() const
+{
+    return impl->scanner.errors;
+}
+
 ScanResult
 scan_tokens(std::string_view source, ErrorHandler* error_handler)
 {
-    auto scanner = Scanner(source, error_handler);
-    scanner.scan_many_tokens();
-    return std::move(scanner.result);
+    return scan_tokens(std::make_shared<Source>(std::string(source)), error_handler);
 }
 
 }
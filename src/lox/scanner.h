@@ -17,6 +17,32 @@ struct ScanResult
 ScanResult
 scan_tokens(const std::string_view source, ErrorHandler* error_handler);
 
+// scan an existing source without copying its text, lexemes and error
+// reports point straight into Source::source
+ScanResult
+scan_tokens(std::shared_ptr<Source> source, ErrorHandler* error_handler);
+
+
+struct TokenStreamImpl;
+
+// hands tokens to the parser one at a time, so a big script never
+// materializes its whole token vector
+struct TokenStream
+{
+    TokenStream(std::shared_ptr<Source> source, ErrorHandler* error_handler);
+    ~TokenStream();
+
+    // the next token; EOF forever once the source is exhausted
+    Token
+    scan_next();
+
+    // scan errors reported so far
+    int
+    get_error_count() const;
+
+    std::unique_ptr<TokenStreamImpl> impl;
+};
+
 std::vector<std::string>
 parse_package_path(const std::string& path);
 
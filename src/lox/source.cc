@@ -1,9 +1,99 @@
 #include "lox/source.h"
 
+#if defined(_WIN32)
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace lox
 {
 
 
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::string& path)
+{
+    std::ifstream handle(path, std::ios::binary);
+    if(handle.good() == false)
+    {
+        return;
+    }
+
+    std::ostringstream buffer;
+    buffer << handle.rdbuf();
+    fallback = buffer.str();
+    open = true;
+}
+
+MappedFile::~MappedFile() = default;
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return;
+    }
+
+    struct stat file_info {};
+    if(::fstat(fd, &file_info) != 0)
+    {
+        ::close(fd);
+        return;
+    }
+
+    size = static_cast<std::size_t>(file_info.st_size);
+    if(size > 0)
+    {
+        data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED)
+        {
+            data = nullptr;
+            size = 0;
+            ::close(fd);
+            return;
+        }
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    open = true;
+}
+
+MappedFile::~MappedFile()
+{
+    if(data != nullptr)
+    {
+        ::munmap(data, size);
+    }
+}
+
+#endif
+
+bool
+MappedFile::is_open() const
+{
+    return open;
+}
+
+std::string_view
+MappedFile::view() const
+{
+    if(data != nullptr)
+    {
+        return std::string_view{static_cast<const char*>(data), size};
+    }
+    return fallback;
+}
+
+
 Offset::Offset(std::shared_ptr<Source> src, std::size_t s, std::size_t e)
     : source(src)
     , start(s)
@@ -21,7 +111,15 @@ Offset::Offset(std::shared_ptr<Source> src, std::size_t where)
 
 
 Source::Source(std::string str)
-    : source(std::move(str))
+    : owned_source(std::move(str))
+    , source(owned_source)
+{
+}
+
+
+Source::Source(std::shared_ptr<MappedFile> file)
+    : mapped(std::move(file))
+    , source(mapped->view())
 {
 }
 
@@ -32,11 +32,42 @@ struct StringMap
 };
 
 
+// a read only memory mapping of a file, the zero copy backing for mapped
+// sources; not open when the file can't be read
+struct MappedFile
+{
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    bool is_open() const;
+    std::string_view view() const;
+
+    MappedFile(MappedFile&&) = delete;
+    MappedFile(const MappedFile&) = delete;
+    void operator=(MappedFile&&) = delete;
+    void operator=(const MappedFile&) = delete;
+
+    void* data = nullptr;
+    std::size_t size = 0;
+    bool open = false;
+
+    // used when the platform (or a zero sized file) can't be mapped
+    std::string fallback;
+};
+
+
 struct Source
 {
+    // owns a copy of the text
     explicit Source(std::string str);
 
-    std::string source;
+    // zero copy: the text stays in the mapping and the source keeps the
+    // mapping alive, tokens and error reports point straight into it
+    explicit Source(std::shared_ptr<MappedFile> file);
+
+    std::string owned_source;
+    std::shared_ptr<MappedFile> mapped;
+    std::string_view source;
     std::optional<StringMap> map;
 
     StringMap& get_or_create_map();
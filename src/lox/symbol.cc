@@ -0,0 +1,67 @@
+#include "lox/symbol.h"
+
+#include <cassert>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace lox { namespace
+{
+
+struct SymbolTable
+{
+    // compiles can run on worker threads (Lox::compile_many) and all of
+    // them intern into this one table
+    std::mutex mutex;
+
+    std::unordered_map<std::string, u32> ids;
+
+    // deque so the references symbol_text hands out stay valid while
+    // other threads keep interning
+    std::deque<std::string> texts;
+};
+
+SymbolTable&
+get_symbol_table()
+{
+    static SymbolTable table;
+    return table;
+}
+
+}}
+
+
+namespace lox
+{
+
+Symbol
+intern_symbol(std::string_view text)
+{
+    auto& table = get_symbol_table();
+    const auto lock = std::scoped_lock{table.mutex};
+
+    // todo(Gustav): transparent lookup so interning a string_view doesn't allocate
+    auto text_string = std::string(text);
+    if(auto found = table.ids.find(text_string); found != table.ids.end())
+    {
+        return Symbol{found->second};
+    }
+
+    const auto id = static_cast<u32>(table.texts.size());
+    table.texts.emplace_back(text_string);
+    table.ids.insert({std::move(text_string), id});
+    return Symbol{id};
+}
+
+
+const std::string&
+symbol_text(Symbol symbol)
+{
+    auto& table = get_symbol_table();
+    const auto lock = std::scoped_lock{table.mutex};
+    assert(symbol.id < table.texts.size());
+    return table.texts[symbol.id];
+}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "lox/ints.h"
+
+
+namespace lox
+{
+
+// id of an interned string, the same text always interns to the same id so
+// maps keyed by Symbol hash a 32-bit int instead of rehashing the text on
+// every lookup
+struct Symbol
+{
+    u32 id;
+
+    bool operator==(const Symbol& rhs) const { return id == rhs.id; }
+    bool operator!=(const Symbol& rhs) const { return id != rhs.id; }
+};
+
+// get the symbol for some text, interning it if it hasn't been seen before
+Symbol intern_symbol(std::string_view text);
+
+// the text a symbol was interned from
+const std::string& symbol_text(Symbol symbol);
+
+}
+
+
+template<>
+struct std::hash<lox::Symbol>
+{
+    std::size_t operator()(const lox::Symbol& s) const
+    {
+        return std::hash<u32>{}(s.id);
+    }
+};
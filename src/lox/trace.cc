@@ -0,0 +1,66 @@
+#include "lox/trace.h"
+
+#if LOX_ENABLE_TRACING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+
+namespace lox { namespace
+{
+
+// must be a power of two so the cursor wraps with a mask
+constexpr std::size_t ring_size = 16 * 1024;
+
+std::array<TraceEntry, ring_size> ring;
+
+// total number of events ever recorded, the slot is cursor modulo
+// ring_size
+std::atomic<u64> cursor{0};
+
+
+u64
+now_ns()
+{
+    return static_cast<u64>
+    (
+        std::chrono::duration_cast<std::chrono::nanoseconds>
+        (
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count()
+    );
+}
+
+}}
+
+
+namespace lox
+{
+
+void
+record_trace(TraceEvent event)
+{
+    const auto index = cursor.fetch_add(1, std::memory_order_relaxed);
+    ring[index & (ring_size - 1)] = TraceEntry{event, now_ns()};
+}
+
+
+std::vector<TraceEntry>
+snapshot_trace()
+{
+    const auto total = cursor.load(std::memory_order_relaxed);
+    const auto available = total < ring_size ? total : ring_size;
+
+    std::vector<TraceEntry> entries;
+    entries.reserve(available);
+    for(u64 entry_index = total - available; entry_index < total; entry_index += 1)
+    {
+        entries.emplace_back(ring[entry_index & (ring_size - 1)]);
+    }
+    return entries;
+}
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "lox/config.h"
+#include "lox/ints.h"
+
+
+namespace lox
+{
+
+
+// what happened at a traced site, see LOX_TRACE below
+enum class TraceEvent : unsigned char
+{
+    function_enter,
+    function_exit,
+    environment_created,
+    object_allocated,
+    property_cache_miss
+};
+
+
+#if LOX_ENABLE_TRACING
+
+// one recorded event, time is steady clock nanoseconds
+struct TraceEntry
+{
+    TraceEvent event;
+    u64 time_ns;
+};
+
+// store a event in the trace ring buffer, lock free: one relaxed
+// fetch_add on the write cursor plus a plain store into the slot
+void
+record_trace(TraceEvent event);
+
+// copy out the most recent events, oldest first; entries that are
+// being overwritten while the snapshot runs can come out torn, that is
+// the price of not locking the hot path
+std::vector<TraceEntry>
+snapshot_trace();
+
+#endif
+
+
+}
+
+
+#if LOX_ENABLE_TRACING
+
+#define LOX_TRACE(event) ::lox::record_trace(::lox::TraceEvent::event)
+
+// function_enter now and the matching exit when the scope unwinds,
+// also on exceptions
+#define LOX_TRACE_FUNCTION() \
+    ::lox::record_trace(::lox::TraceEvent::function_enter); \
+    const ::lox::detail::TraceFunctionScope lox_trace_function_scope{}
+
+namespace lox { namespace detail
+{
+    struct TraceFunctionScope
+    {
+        ~TraceFunctionScope()
+        {
+            record_trace(TraceEvent::function_exit);
+        }
+    };
+}}
+
+#else
+
+// the hooks compile to nothing in a normal build
+#define LOX_TRACE(event) do {} while(false)
+#define LOX_TRACE_FUNCTION() do {} while(false)
+
+#endif
@@ -0,0 +1,208 @@
+#include "lox/value.h"
+
+#include <cassert>
+
+
+namespace lox
+{
+
+
+Value::Value()
+    : type(ObjectType::nil)
+    , number_int(0)
+{
+}
+
+
+Value::Value(std::shared_ptr<Object> o)
+    : type(ObjectType::nil)
+    , number_int(0)
+{
+    if(o == nullptr)
+    {
+        return;
+    }
+
+    type = o->get_type();
+    switch(type)
+    {
+    case ObjectType::nil:
+        break;
+    case ObjectType::boolean:
+        boolean = *lox::as_bool(o);
+        break;
+    case ObjectType::number_int:
+        number_int = *lox::as_int(o);
+        break;
+    case ObjectType::number_float:
+        number_float = *lox::as_float(o);
+        break;
+    default:
+        object = std::move(o);
+        break;
+    }
+}
+
+
+Value
+Value::from_bool(bool b)
+{
+    Value v;
+    v.type = ObjectType::boolean;
+    v.boolean = b;
+    return v;
+}
+
+
+Value
+Value::from_int(Ti i)
+{
+    Value v;
+    v.type = ObjectType::number_int;
+    v.number_int = i;
+    return v;
+}
+
+
+Value
+Value::from_float(Tf f)
+{
+    Value v;
+    v.type = ObjectType::number_float;
+    v.number_float = f;
+    return v;
+}
+
+
+ObjectType
+Value::get_type() const
+{
+    return type;
+}
+
+
+std::shared_ptr<Object>
+Value::as_object() const
+{
+    switch(type)
+    {
+    case ObjectType::nil:            return make_nil();
+    case ObjectType::boolean:        return make_bool(boolean);
+    case ObjectType::number_int:     return make_number_int(number_int);
+    case ObjectType::number_float:   return make_number_float(number_float);
+    default:
+        assert(object != nullptr);
+        return object;
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+
+
+bool
+is_nil(const Value& v)
+{
+    return v.type == ObjectType::nil;
+}
+
+
+bool
+is_truthy(const Value& v)
+{
+    switch(v.type)
+    {
+    case ObjectType::nil:
+        return false;
+    case ObjectType::boolean:
+        return v.boolean;
+    default:
+        return true;
+    }
+}
+
+
+std::optional<std::string>
+as_string(const Value& v)
+{
+    if(v.type != ObjectType::string) { return std::nullopt; }
+    return as_string(v.object);
+}
+
+
+std::optional<bool>
+as_bool(const Value& v)
+{
+    if(v.type != ObjectType::boolean) { return std::nullopt; }
+    return v.boolean;
+}
+
+
+std::optional<Ti>
+as_int(const Value& v)
+{
+    if(v.type != ObjectType::number_int) { return std::nullopt; }
+    return v.number_int;
+}
+
+
+std::optional<Tf>
+as_float(const Value& v)
+{
+    if(v.type != ObjectType::number_float) { return std::nullopt; }
+    return v.number_float;
+}
+
+
+std::shared_ptr<Callable>
+as_callable(const Value& v)
+{
+    if(v.object == nullptr) { return nullptr; }
+    return as_callable(v.object);
+}
+
+
+std::shared_ptr<Klass>
+as_klass(const Value& v)
+{
+    if(v.object == nullptr) { return nullptr; }
+    return as_klass(v.object);
+}
+
+
+// ----------------------------------------------------------------------------
+
+
+bool
+get_bool_or_ub(const Value& v)
+{
+    assert(v.type == ObjectType::boolean);
+    return v.boolean;
+}
+
+
+Ti
+get_int_or_ub(const Value& v)
+{
+    assert(v.type == ObjectType::number_int);
+    return v.number_int;
+}
+
+
+Tf
+get_float_or_ub(const Value& v)
+{
+    assert(v.type == ObjectType::number_float);
+    return v.number_float;
+}
+
+
+std::string
+get_string_or_ub(const Value& v)
+{
+    assert(v.type == ObjectType::string);
+    return get_string_or_ub(v.object);
+}
+
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+#include "lox/ints.h"
+#include "lox/object.h"
+
+
+namespace lox
+{
+
+// small tagged value used by the interpreter and environments, nil, bools,
+// ints and floats are stored inline instead of heap allocated and the
+// shared_ptr<Object> is reserved for strings, arrays, instances and callables
+struct Value
+{
+    ObjectType type;
+    union
+    {
+        bool boolean;
+        Ti number_int;
+        Tf number_float;
+    };
+    std::shared_ptr<Object> object;
+
+    // nil
+    Value();
+
+    // unwraps primitive objects so the inline representation stays canonical,
+    // a null object also becomes nil
+    Value(std::shared_ptr<Object> o);
+
+    template
+    <
+        typename T,
+        typename = std::enable_if_t<std::is_base_of_v<Object, T> && std::is_same_v<T, Object> == false>
+    >
+    Value(std::shared_ptr<T> o)
+        : Value(std::static_pointer_cast<Object>(std::move(o)))
+    {
+    }
+
+    static Value from_bool(bool b);
+    static Value from_int(Ti i);
+    static Value from_float(Tf f);
+
+    ObjectType get_type() const;
+
+    // boxes primitives back into a heap Object, used at the native binding
+    // and Callable boundaries where the old signatures are kept
+    std::shared_ptr<Object> as_object() const;
+};
+
+
+bool                        is_nil         (const Value& v);
+bool                        is_truthy      (const Value& v);
+std::optional<std::string>  as_string      (const Value& v);
+std::optional<bool>         as_bool        (const Value& v);
+std::optional<Ti>           as_int         (const Value& v);
+std::optional<Tf>           as_float       (const Value& v);
+std::shared_ptr<Callable>   as_callable    (const Value& v);
+std::shared_ptr<Klass>      as_klass       (const Value& v);
+
+
+bool         get_bool_or_ub    (const Value& v);
+Ti           get_int_or_ub     (const Value& v);
+Tf           get_float_or_ub   (const Value& v);
+std::string  get_string_or_ub  (const Value& v);
+
+}